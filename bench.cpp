@@ -0,0 +1,2353 @@
+/* Benchmarks for the smoothing code in smoothing.h.
+ *
+ * The benchmarks run headless (no OpenGL) on .obj meshes and print plain
+ * text tables. Run ./bench without arguments to see the available ones.
+ *
+ * Wherever a mesh is expected, "torus:NUxNV" can be given instead of a file
+ * to generate a torus of NU x NV quads split into triangles, and
+ * "torus:NUxNV@S" to scale it by S. "K*mesh" makes a mesh of K separate
+ * copies of any of these side by side.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <malloc.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "structs.h"
+#include "halfedge.h"
+#include "obj_io.h"
+#include "smoothing.h"
+#include "history.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* Mesh loading and timing helpers */
+
+struct Bench_Mesh
+{
+    Mesh_Data *mesh;
+    vector<HEV *> *hevs;
+    vector<HEF *> *hefs;
+};
+
+/* Fills mesh with a torus of nu x nv quads, each split into two triangles.
+ * At scale 1 its radii are 1 and 0.4.
+ */
+void make_torus(Mesh_Data *mesh, int nu, int nv, double scale)
+{
+    const double R = scale, r = 0.4 * scale;
+    mesh->vertices = new vector<Vertex *>();
+    mesh->faces = new vector<Face *>();
+    mesh->vertices->push_back(NULL);
+
+    for (int i = 0; i < nu; i++) {
+        for (int j = 0; j < nv; j++) {
+            double u = 2 * M_PI * i / nu, v = 2 * M_PI * j / nv;
+            Vertex *vert = new Vertex;
+            vert->x = (R + r * cos(v)) * cos(u);
+            vert->y = (R + r * cos(v)) * sin(u);
+            vert->z = r * sin(v);
+            mesh->vertices->push_back(vert);
+        }
+    }
+
+    for (int i = 0; i < nu; i++) {
+        for (int j = 0; j < nv; j++) {
+            int a = 1 + i * nv + j;
+            int b = 1 + ((i + 1) % nu) * nv + j;
+            int c = 1 + ((i + 1) % nu) * nv + (j + 1) % nv;
+            int d = 1 + i * nv + (j + 1) % nv;
+            mesh->faces->push_back(new Face{a, b, c});
+            mesh->faces->push_back(new Face{a, c, d});
+        }
+    }
+}
+
+/* Turns mesh into copies of itself next to each other along x, as separate
+ * shells
+ */
+void replicate_mesh(Mesh_Data *mesh, int copies)
+{
+    int num_vertices = mesh->vertices->size() - 1;
+    int num_faces = mesh->faces->size();
+    float low = mesh->vertices->at(1)->x, high = low;
+    for (int i = 1; i <= num_vertices; i++) {
+        low = min(low, mesh->vertices->at(i)->x);
+        high = max(high, mesh->vertices->at(i)->x);
+    }
+    float spacing = 1.25f * (high - low);
+
+    for (int c = 1; c < copies; c++) {
+        for (int i = 1; i <= num_vertices; i++) {
+            Vertex *vert = new Vertex(*mesh->vertices->at(i));
+            vert->x += c * spacing;
+            mesh->vertices->push_back(vert);
+        }
+        int offset = c * num_vertices;
+        for (int f = 0; f < num_faces; f++) {
+            Face *face = mesh->faces->at(f);
+            mesh->faces->push_back(new Face{face->idx1 + offset, face->idx2 + offset,
+                                            face->idx3 + offset});
+        }
+    }
+}
+
+/* Parses an obj file (or generates a torus for "torus:NUxNV[@S]"), makes
+ * copies of it for "K*mesh" and builds its indexed halfedge structures
+ */
+Bench_Mesh load_mesh(string filename)
+{
+    Bench_Mesh m;
+    m.mesh = new Mesh_Data;
+    int nu, nv, copies = 1, prefix = 0;
+    if (sscanf(filename.c_str(), "%d*%n", &copies, &prefix) == 1 && prefix > 0) {
+        filename = filename.substr(prefix);
+    }
+    double scale = 1;
+    if (sscanf(filename.c_str(), "torus:%dx%d@%lf", &nu, &nv, &scale) >= 2) {
+        make_torus(m.mesh, nu, nv, scale);
+    } else {
+        parse_OBJ(m.mesh, filename);
+    }
+    if (copies > 1) {
+        replicate_mesh(m.mesh, copies);
+    }
+
+    m.hevs = new vector<HEV *>();
+    m.hefs = new vector<HEF *>();
+    build_HE(m.mesh, m.hevs, m.hefs);
+    for (int vIdx = 1; vIdx < m.hevs->size(); vIdx++) {
+        m.hevs->at(vIdx)->index = vIdx;
+    }
+    return m;
+}
+
+// Resets the halfedge vertex positions to the ones parsed from the file
+void reset_positions(Bench_Mesh &m)
+{
+    for (int i = 1; i < m.hevs->size(); i++) {
+        m.hevs->at(i)->x = m.mesh->vertices->at(i)->x;
+        m.hevs->at(i)->y = m.mesh->vertices->at(i)->y;
+        m.hevs->at(i)->z = m.mesh->vertices->at(i)->z;
+    }
+}
+
+void free_mesh(Bench_Mesh &m)
+{
+    for (int i = 1; i < m.mesh->vertices->size(); i++) {
+        delete m.mesh->vertices->at(i);
+    }
+    for (int i = 0; i < m.mesh->faces->size(); i++) {
+        delete m.mesh->faces->at(i);
+    }
+    delete m.mesh->vertices;
+    delete m.mesh->faces;
+    delete m.mesh;
+    delete_HE(m.hevs, m.hefs);
+}
+
+typedef chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Returns a "Vm..." field of /proc/self/status in kB, or 0 if unavailable
+long read_memory_kb(const string &field)
+{
+    ifstream status("/proc/self/status");
+    string key;
+    long kb;
+    while (status >> key) {
+        if (key == field + ":" && status >> kb) {
+            return kb;
+        }
+        status.ignore(256, '\n');
+    }
+    return 0;
+}
+
+/* Resets the peak resident set size (VmHWM) to the current one. Freed heap
+ * memory is returned to the system first, so that it counts again when the
+ * next allocations reuse it.
+ */
+void reset_peak_memory()
+{
+    malloc_trim(0);
+    ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'precision' benchmark:
+ *
+ * Smooths the mesh for a number of generations in float, double and mixed
+ * precision and reports the time per generation together with the distance
+ * of the float and mixed results from the double results.
+ */
+int bench_precision(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench precision mesh.obj [generations=100] [h=0.0001]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 100;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    Bench_Mesh m = load_mesh(argv[0]);
+
+    const char *names[] = {"double", "float", "mixed"};
+    Precision_Mode modes[] = {PRECISION_DOUBLE, PRECISION_FLOAT, PRECISION_MIXED};
+
+    // Positions of the double run after every generation are the reference
+    vector<Positions<double> > reference(generations);
+
+    printf("%s: %d vertices, %d generations, h = %g\n",
+           argv[0], (int) m.hevs->size() - 1, generations, h);
+    printf("%-8s %12s %12s %14s %14s\n",
+           "mode", "total (s)", "ms / gen", "max err", "rms err");
+
+    for (int mode = 0; mode < 3; mode++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.precision = modes[mode];
+        reset_positions(m);
+        Smoother *smoother = make_smoother(m.hevs, opts);
+
+        double total = 0, max_err = 0, sum_sq = 0;
+        Positions<double> pos;
+        for (int gen = 0; gen < generations; gen++) {
+            Clock::time_point start = Clock::now();
+            smoother->step(h);
+            total += seconds_since(start);
+
+            smoother->store(m.hevs);
+            gather_positions(m.hevs, pos);
+            if (mode == 0) {
+                reference[gen] = pos;
+                continue;
+            }
+            Eigen::VectorXd err = (pos - reference[gen]).rowwise().norm();
+            max_err = max(max_err, err.maxCoeff());
+            sum_sq += err.squaredNorm() / err.size();
+        }
+        delete smoother;
+
+        printf("%-8s %12.3f %12.3f %14.3e %14.3e\n", names[mode], total,
+               1000.0 * total / generations, max_err, sqrt(sum_sq / generations));
+    }
+
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'solvers' benchmark:
+ *
+ * Smooths the mesh with every linear solver backend and reports the time of
+ * the symbolic analysis (once per mesh) and the average factorization and
+ * solve times per generation, together with the peak memory the solver
+ * added on top of the mesh, the nonzeros of its factor or preconditioner and
+ * the relative residual of its last solve.
+ */
+template <typename Scalar, typename FactorScalar>
+void run_solver(Bench_Mesh &m, const Smoothing_Options &opts, int generations, double h)
+{
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<Scalar> pos;
+    reset_positions(m);
+    gather_positions(m.hevs, pos);
+
+    Smoothing_System<Scalar> system;
+    Positions<Scalar> rhs;
+    system.assign(topo, pos, Scalar(h));
+    system.rhs(pos, rhs);
+
+    reset_peak_memory();
+    long base_kb = read_memory_kb("VmRSS");
+    Linear_Solver<Scalar> *solver = make_linear_solver<Scalar, FactorScalar>(opts);
+
+    Clock::time_point start = Clock::now();
+    solver->analyze(system);
+    double analyze = seconds_since(start);
+
+    double factorize = 0, solve = 0;
+    for (int gen = 0; gen < generations; gen++) {
+        if (gen > 0) {
+            system.assign(topo, pos, Scalar(h));
+            system.rhs(pos, rhs);
+        }
+        start = Clock::now();
+        solver->factorize(system);
+        factorize += seconds_since(start);
+
+        start = Clock::now();
+        solver->solve(system, rhs, pos);
+        solve += seconds_since(start);
+    }
+    long peak_kb = read_memory_kb("VmHWM") - base_kb;
+
+    printf("%-10s %12.2f %12.2f %12.2f %12.1f %12ld %8d %12.3e\n",
+           solver_name(opts.solver), 1000 * analyze, 1000 * factorize / generations,
+           1000 * solve / generations, peak_kb / 1024.0, solver->factor_nonzeros(),
+           solver->stats.iterations, solver->stats.residual);
+    delete solver;
+}
+
+int bench_solvers(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench solvers mesh.obj|torus:NUxNV [generations=5] [h=0.0001] "
+                "[precision=double]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 5;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    Smoothing_Options opts = default_smoothing_options();
+    set_smoothing_option(opts, "precision", (argc > 3) ? argv[3] : "double");
+    Bench_Mesh m = load_mesh(argv[0]);
+
+    printf("%s: %d vertices, %d generations, h = %g\n",
+           argv[0], (int) m.hevs->size() - 1, generations, h);
+    printf("%-10s %12s %12s %12s %12s %12s %8s %12s\n", "solver", "analyze ms",
+           "factor ms", "solve ms", "peak MB", "factor nnz", "iters", "residual");
+
+    for (int s = 0; s < NUM_SOLVER_TYPES; s++) {
+        opts.solver = (Solver_Type) s;
+        switch (opts.precision) {
+            case PRECISION_DOUBLE:
+                run_solver<double, double>(m, opts, generations, h);
+                break;
+            case PRECISION_MIXED:
+                run_solver<double, float>(m, opts, generations, h);
+                break;
+            default:
+                run_solver<float, float>(m, opts, generations, h);
+                break;
+        }
+    }
+
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'orderings' benchmark:
+ *
+ * Computes every fill-reducing ordering of the mesh's system and reports the
+ * time to compute it, the fill predicted from the elimination tree, and the
+ * factor nonzeros and average factorization time of the LDLT and LU solvers
+ * under it. For auto, the ordering it picked is shown in parentheses.
+ * Orderings predicted to fill more than 20 times the nonzeros of the matrix
+ * (natural, on most meshes) are not factorized.
+ */
+template <typename Factorization>
+void time_factorization(const Eigen::SparseMatrix<double> &A, int repeats,
+                        long &nonzeros, double &ms)
+{
+    Factorization factorization;
+    factorization.analyzePattern(A);
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+        factorization.factorize(A);
+    }
+    ms = 1000 * seconds_since(start) / repeats;
+    nonzeros = count_factor_nonzeros(factorization);
+}
+
+int bench_orderings(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench orderings mesh.obj|torus:NUxNV [repeats=3] [h=0.0001]\n";
+        return 1;
+    }
+    int repeats = (argc > 1) ? stoi(argv[1]) : 3;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    Bench_Mesh m = load_mesh(argv[0]);
+
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> pos;
+    gather_positions(m.hevs, pos);
+    Smoothing_System<double> system;
+    system.assign(topo, pos, h);
+    Eigen::SparseMatrix<double> A = system.assemble();
+
+    printf("%s: %d vertices, %ld nonzeros\n", argv[0], (int) A.rows(), (long) A.nonZeros());
+    printf("%-14s %10s %14s %14s %12s %14s %12s\n", "ordering", "order ms",
+           "predicted nnz", "ldlt nnz", "ldlt ms", "lu nnz", "lu ms");
+
+    typedef Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>, Eigen::Lower,
+                                  Eigen::NaturalOrdering<int> > LDLT;
+    typedef Counted_SparseLU<Eigen::SparseMatrix<double>, Eigen::NaturalOrdering<int> > LU;
+
+    for (int o = ORDERING_NATURAL; o <= ORDERING_ND + 1; o++) {
+        Ordering_Type requested = (o > ORDERING_ND) ? ORDERING_AUTO : (Ordering_Type) o;
+        Ordering_Permutation inverse_perm;
+        Clock::time_point start = Clock::now();
+        Ordering_Type used = compute_ordering(requested, A, inverse_perm);
+        double order_ms = 1000 * seconds_since(start);
+
+        string name = ordering_name(requested);
+        if (requested == ORDERING_AUTO) {
+            name += string(" (") + ordering_name(used) + ")";
+        }
+        long predicted = predict_fill(A, inverse_perm);
+        printf("%-14s %10.2f %14ld", name.c_str(), order_ms, predicted);
+        if (predicted > 20 * A.nonZeros()) {
+            printf(" %14s %12s %14s %12s\n", "-", "-", "-", "-");
+            continue;
+        }
+
+        Eigen::SparseMatrix<double> permuted;
+        permuted = A.twistedBy(inverse_perm.inverse());
+        long ldlt_nnz, lu_nnz;
+        double ldlt_ms, lu_ms;
+        time_factorization<LDLT>(permuted, repeats, ldlt_nnz, ldlt_ms);
+        time_factorization<LU>(permuted, repeats, lu_nnz, lu_ms);
+        printf(" %14ld %12.2f %14ld %12.2f\n", ldlt_nnz, ldlt_ms, lu_nnz, lu_ms);
+    }
+
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'multigrid' benchmark:
+ *
+ * Solves one generation on tori of growing size with multigrid V-cycles on
+ * their own, multigrid-preconditioned CG and IC-preconditioned CG. For each
+ * it reports the time of the first generation's analyze and factorize, the
+ * setup time of a later generation (factorize only), the iterations or
+ * cycles, the solve time and the time per vertex of a later generation,
+ * which stays flat when the solver scales linearly. The tori have 2.5 times as many vertices
+ * around as across so that their triangles are close to equilateral.
+ *
+ * Larger tori are scaled up so that their vertex areas stay above the
+ * degenerate area, with h scaled by the square of the size to match. That
+ * gives exactly the system of a fixed size torus with finer and finer
+ * triangles, up to a constant factor.
+ */
+int bench_multigrid(int argc, char *argv[])
+{
+    double h = (argc > 0) ? stod(argv[0]) : 0.01;
+    vector<int> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(stoi(argv[i]));
+    }
+    if (sizes.empty()) {
+        int defaults[] = {64, 128, 256, 512};
+        sizes.assign(defaults, defaults + 4);
+    }
+
+    const char *names[] = {"mg", "cg+mg", "cg+ic"};
+    printf("h = %g on a 160x64 torus, relative tolerance 1e-8\n", h);
+    printf("%10s %-8s %10s %10s %8s %12s %8s %14s\n", "vertices", "solver", "analyze ms",
+           "setup ms", "iters", "solve ms", "levels", "us / vertex");
+
+    for (int s = 0; s < sizes.size(); s++) {
+        double scale = sizes[s] / 64.0;
+        Bench_Mesh m = load_mesh("torus:" + to_string((int) (2.5 * sizes[s])) + "x" +
+                                 to_string(sizes[s]) + "@" + to_string(scale));
+        Mesh_Topology topo;
+        build_topology(m.hevs, topo);
+        Positions<double> pos, rhs;
+        gather_positions(m.hevs, pos);
+        Smoothing_System<double> system;
+        system.assign(topo, pos, h * scale * scale);
+        system.rhs(pos, rhs);
+
+        for (int solver = 0; solver < 3; solver++) {
+            Linear_Solver<double> *linear_solver;
+            Multigrid<double> *multigrid = NULL;
+            if (solver == 0) {
+                Multigrid_Solver<double> *mg = new Multigrid_Solver<double>(1e-8, 1000);
+                multigrid = &mg->multigrid;
+                linear_solver = mg;
+            } else {
+                linear_solver = new PCG_Solver<double, double>(
+                    (solver == 1) ? PCG_Solver<double, double>::MG : PCG_Solver<double, double>::IC,
+                    1e-8, 1000);
+            }
+
+            // Times a repeated factorize, which reuses the hierarchy
+            Clock::time_point start = Clock::now();
+            linear_solver->analyze(system);
+            linear_solver->factorize(system);
+            double analyze = seconds_since(start);
+            start = Clock::now();
+            linear_solver->factorize(system);
+            double setup = seconds_since(start);
+
+            Positions<double> X = pos;
+            start = Clock::now();
+            linear_solver->solve(system, rhs, X);
+            double solve = seconds_since(start);
+
+            printf("%10d %-8s %10.1f %10.1f %8d %12.1f %8s %14.3f\n", topo.num_vertices,
+                   names[solver], 1000 * analyze, 1000 * setup,
+                   linear_solver->stats.iterations, 1000 * solve,
+                   multigrid ? to_string(multigrid->num_levels()).c_str() : "-",
+                   1e6 * (setup + solve) / topo.num_vertices);
+            delete linear_solver;
+        }
+        free_mesh(m);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'gauss_seidel' benchmark:
+ *
+ * Times symmetric Gauss-Seidel sweeps on the system of every mesh, first in
+ * index order on one thread and then color by color on 1, 2, 4, ... threads
+ * up to the number of hardware threads. Reports sweeps per second, the
+ * speedup over the serial sweep, and the relative residual after 20 sweeps
+ * from the current positions, which shows that the multicolor order
+ * converges like the serial one.
+ */
+template <typename Sweep>
+double sweeps_per_second(Sweep sweep)
+{
+    int sweeps = 0;
+    Clock::time_point start = Clock::now();
+    do {
+        sweep();
+        sweeps++;
+    } while (seconds_since(start) < 0.5);
+    return sweeps / seconds_since(start);
+}
+
+int bench_gauss_seidel(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench gauss_seidel mesh.obj|torus:NUxNV[@S] ... \n";
+        return 1;
+    }
+    const double h = 0.0001;
+    const int RESIDUAL_SWEEPS = 20;
+    int max_threads = max((int) thread::hardware_concurrency(), 1);
+
+    for (int a = 0; a < argc; a++) {
+        Bench_Mesh m = load_mesh(argv[a]);
+        Mesh_Topology topo;
+        build_topology(m.hevs, topo);
+        Positions<double> pos, rhs;
+        gather_positions(m.hevs, pos);
+        Smoothing_System<double> system;
+        system.assign(topo, pos, h);
+        system.rhs(pos, rhs);
+
+        Gauss_Seidel_Solver<double> solver(0, RESIDUAL_SWEEPS);
+        solver.analyze(system);
+
+        printf("%s: %d vertices, %d colors, h = %g\n", argv[a], topo.num_vertices,
+               solver.coloring.num_colors, h);
+        printf("%-12s %8s %12s %10s %14s\n", "order", "threads", "sweeps / s", "speedup",
+               "residual");
+
+        // Serial sweep in index order
+        Positions<double> X = pos;
+        double serial = sweeps_per_second([&] {
+            for (int i = 0; i < topo.num_vertices; i++)
+                system.relax(i, rhs, X);
+            for (int i = topo.num_vertices - 1; i >= 0; i--)
+                system.relax(i, rhs, X);
+        });
+        X = pos;
+        for (int s = 0; s < RESIDUAL_SWEEPS; s++) {
+            for (int i = 0; i < topo.num_vertices; i++)
+                system.relax(i, rhs, X);
+            for (int i = topo.num_vertices - 1; i >= 0; i--)
+                system.relax(i, rhs, X);
+        }
+        Positions<double> AX;
+        system.apply(X, AX);
+        double residual = ((rhs - AX).colwise().norm().array() /
+                           rhs.colwise().norm().array()).maxCoeff();
+        printf("%-12s %8d %12.1f %10.2f %14.3e\n", "index", 1, serial, 1.0, residual);
+
+        X = pos;
+        solver.solve(system, rhs, X);
+        for (int threads = 1; ; threads = min(2 * threads, max_threads)) {
+            set_num_threads(threads);
+            X = pos;
+            double rate = sweeps_per_second([&] { solver.sweep(system, rhs, X); });
+            printf("%-12s %8d %12.1f %10.2f %14.3e\n", "multicolor", threads, rate,
+                   rate / serial, solver.stats.residual);
+            if (threads == max_threads) {
+                break;
+            }
+        }
+        free_mesh(m);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'cholesky' benchmark:
+ *
+ * Factorizes the system of every mesh, permuted by the auto ordering, with
+ * the supernodal Cholesky on 1, 2, 4, ... threads up to the number of
+ * hardware threads, and with SimplicialLDLT and SparseLU. Reports the time of
+ * the symbolic analysis, the numeric factorization and a three-column solve,
+ * the nonzeros of the factors and the peak memory of each, and the relative
+ * residual of the solve.
+ */
+template <typename Factorization>
+void time_cholesky(const char *name, int threads, const Eigen::SparseMatrix<double> &A,
+                   const Eigen::MatrixXd &B)
+{
+    reset_peak_memory();
+    long base_kb = read_memory_kb("VmRSS");
+    Factorization *factorization = new Factorization;
+
+    Clock::time_point start = Clock::now();
+    factorization->analyzePattern(A);
+    double analyze = seconds_since(start);
+    start = Clock::now();
+    factorization->factorize(A);
+    double factorize = seconds_since(start);
+    start = Clock::now();
+    Eigen::MatrixXd X = factorization->solve(B);
+    double solve = seconds_since(start);
+    long peak_kb = read_memory_kb("VmHWM") - base_kb;
+
+    double residual = (A * X - B).norm() / B.norm();
+    printf("%-12s %8d %12.1f %12.1f %12.1f %14ld %10.1f %12.3e\n", name, threads,
+           1000 * analyze, 1000 * factorize, 1000 * solve, count_factor_nonzeros(*factorization),
+           peak_kb / 1024.0, residual);
+    delete factorization;
+}
+
+int bench_cholesky(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench cholesky mesh.obj|torus:NUxNV[@S] ... \n";
+        return 1;
+    }
+    const double h = 0.0001;
+    int max_threads = max((int) thread::hardware_concurrency(), 1);
+    typedef Eigen::SparseMatrix<double> Matrix;
+
+    for (int a = 0; a < argc; a++) {
+        Bench_Mesh m = load_mesh(argv[a]);
+        Mesh_Topology topo;
+        build_topology(m.hevs, topo);
+        Positions<double> pos, rhs;
+        gather_positions(m.hevs, pos);
+        Smoothing_System<double> system;
+        system.assign(topo, pos, h);
+        system.rhs(pos, rhs);
+        free_mesh(m);
+
+        Matrix A = system.assemble();
+        Ordering_Permutation inverse_perm;
+        Ordering_Type ordering = compute_ordering(ORDERING_AUTO, A, inverse_perm);
+        Matrix permuted;
+        permuted = A.twistedBy(inverse_perm.inverse());
+        Eigen::MatrixXd B = inverse_perm.inverse() * rhs;
+
+        printf("%s: %d vertices, %ld nonzeros, %s ordering\n", argv[a], (int) A.rows(),
+               (long) A.nonZeros(), ordering_name(ordering));
+        printf("%-12s %8s %12s %12s %12s %14s %10s %12s\n", "factor", "threads", "analyze ms",
+               "factor ms", "solve ms", "factor nnz", "peak MB", "residual");
+
+        for (int threads = 1; ; threads = min(2 * threads, max_threads)) {
+            set_num_threads(threads);
+            time_cholesky< Supernodal_Cholesky<Matrix> >("supernodal", threads, permuted, B);
+            if (threads == max_threads) {
+                break;
+            }
+        }
+        time_cholesky< Eigen::SimplicialLDLT<Matrix, Eigen::Lower, Eigen::NaturalOrdering<int> > >(
+            "ldlt", 1, permuted, B);
+        time_cholesky< Counted_SparseLU<Matrix, Eigen::NaturalOrdering<int> > >(
+            "lu", 1, permuted, B);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'explicit' benchmark:
+ *
+ * Smooths the mesh for a few generations at a range of time steps, once with
+ * explicit forward Euler substeps and once with implicit fairing (double
+ * precision, default solver), and reports the substeps per generation, the
+ * time per generation of both, and how far apart their results end up
+ * relative to how far the implicit one moved. Prints the time step at which
+ * the implicit path starts to win, interpolated between the time steps that
+ * were run.
+ */
+double time_generations(Bench_Mesh &m, const Smoothing_Options &opts, int generations, double h,
+                        Positions<double> &result, int *substeps)
+{
+    reset_positions(m);
+    Smoother *smoother = make_smoother(m.hevs, opts);
+    Clock::time_point start = Clock::now();
+    for (int gen = 0; gen < generations; gen++) {
+        smoother->step(h);
+    }
+    double total = seconds_since(start);
+    if (substeps) {
+        *substeps = static_cast<Explicit_Smoother<double> *>(smoother)->substeps;
+    }
+    smoother->store(m.hevs);
+    gather_positions(m.hevs, result);
+    delete smoother;
+    return total / generations;
+}
+
+int bench_explicit(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench explicit mesh.obj [generations=5] [h ...=1e-5 1e-4 3e-4 1e-3 3e-3]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 5;
+    vector<double> steps;
+    for (int a = 2; a < argc; a++) {
+        steps.push_back(stod(argv[a]));
+    }
+    if (steps.empty()) {
+        steps = {1e-5, 1e-4, 3e-4, 1e-3, 3e-3};
+    }
+    Bench_Mesh m = load_mesh(argv[0]);
+    Positions<double> original;
+    gather_positions(m.hevs, original);
+
+    Smoothing_Options implicit_opts = default_smoothing_options();
+    implicit_opts.precision = PRECISION_DOUBLE;
+    Smoothing_Options explicit_opts = implicit_opts;
+    explicit_opts.method = METHOD_EXPLICIT;
+
+    printf("%s: %d vertices, %d generations, implicit solver %s\n", argv[0],
+           (int) original.rows(), generations, solver_name(implicit_opts.solver));
+    printf("%-10s %10s %14s %14s %10s %14s\n", "h", "substeps", "explicit ms", "implicit ms",
+           "speedup", "difference");
+
+    double crossover = -1, last_h = 0, last_ratio = 0;
+    for (int s = 0; s < steps.size(); s++) {
+        Positions<double> explicit_result, implicit_result;
+        int substeps;
+        double t_explicit = time_generations(m, explicit_opts, generations, steps[s],
+                                             explicit_result, &substeps);
+        double t_implicit = time_generations(m, implicit_opts, generations, steps[s],
+                                             implicit_result, NULL);
+        double difference = (explicit_result - implicit_result).norm() /
+                            max((implicit_result - original).norm(), 1e-300);
+        double ratio = t_implicit / t_explicit;
+        printf("%-10g %10d %14.3f %14.3f %10.2f %14.3e\n", steps[s], substeps,
+               1000 * t_explicit, 1000 * t_implicit, ratio, difference);
+
+        // Log-log interpolation of where the speedup crosses 1
+        if (crossover < 0 && s > 0 && last_ratio >= 1 && ratio < 1) {
+            double t = log(last_ratio) / (log(last_ratio) - log(ratio));
+            crossover = exp(log(last_h) + t * (log(steps[s]) - log(last_h)));
+        }
+        last_h = steps[s];
+        last_ratio = ratio;
+    }
+    if (crossover > 0) {
+        printf("implicit is faster above h = %.3g\n", crossover);
+    } else {
+        printf("no crossover in the given range of h\n");
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'taubin' benchmark:
+ *
+ * Smooths the mesh for a number of generations with the Taubin filter on the
+ * uniform and the cotangent Laplacian and with implicit fairing, and reports
+ * the time per generation, the enclosed volume relative to the original and
+ * the RMS distance every vertex moved. The Taubin filter should keep the
+ * volume where the implicit flow shrinks it.
+ */
+double enclosed_volume(const Bench_Mesh &m, const Positions<double> &pos)
+{
+    double volume = 0;
+    for (int f = 0; f < m.mesh->faces->size(); f++) {
+        Face *face = m.mesh->faces->at(f);
+        Eigen::Vector3d a = pos.row(face->idx1 - 1), b = pos.row(face->idx2 - 1),
+                        c = pos.row(face->idx3 - 1);
+        volume += a.dot(b.cross(c)) / 6;
+    }
+    return volume;
+}
+
+int bench_taubin(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench taubin mesh.obj [generations=10] [iterations=10] [kpb=0.1] "
+                "[h=0.0001]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 10;
+    Smoothing_Options taubin = default_smoothing_options();
+    taubin.precision = PRECISION_DOUBLE;
+    taubin.method = METHOD_TAUBIN;
+    if (argc > 2) {
+        taubin.taubin_iterations = stoi(argv[2]);
+    }
+    if (argc > 3) {
+        set_smoothing_option(taubin, "taubin_kpb", argv[3]);
+    }
+    double h = (argc > 4) ? stod(argv[4]) : 0.0001;
+    Bench_Mesh m = load_mesh(argv[0]);
+    Positions<double> original;
+    gather_positions(m.hevs, original);
+    double original_volume = enclosed_volume(m, original);
+
+    Smoothing_Options uniform = taubin;
+    uniform.taubin_uniform = true;
+    Smoothing_Options implicit = default_smoothing_options();
+    implicit.precision = PRECISION_DOUBLE;
+
+    const char *names[] = {"taubin_uniform", "taubin_cot", "implicit"};
+    Smoothing_Options *options[] = {&uniform, &taubin, &implicit};
+
+    printf("%s: %d vertices, %d generations, %d iterations, k_PB = %g, h = %g\n", argv[0],
+           (int) original.rows(), generations, taubin.taubin_iterations, taubin.taubin_kpb, h);
+    printf("%-16s %12s %12s %14s\n", "method", "ms / gen", "volume", "rms moved");
+    for (int r = 0; r < 3; r++) {
+        reset_positions(m);
+        Smoother *smoother = make_smoother(m.hevs, *options[r]);
+        Clock::time_point start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            smoother->step(h);
+        }
+        double total = seconds_since(start);
+        smoother->store(m.hevs);
+        delete smoother;
+
+        Positions<double> pos;
+        gather_positions(m.hevs, pos);
+        printf("%-16s %12.3f %12.4f %14.3e\n", names[r], 1000 * total / generations,
+               enclosed_volume(m, pos) / original_volume,
+               (pos - original).norm() / sqrt((double) pos.rows()));
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'spectral' benchmark:
+ *
+ * Builds the spectral smoother of the mesh three times: without a cache,
+ * which computes the eigenbasis, and twice with the cache in a temporary
+ * directory, the second of which loads the basis the first saved. Then
+ * reports the smallest eigenvalues with the largest relative residual
+ * ||Kφ - λMφ|| / ||λMφ|| over the basis, the time of a jump to a new amount
+ * of smoothing, and for comparison the time of one implicit generation.
+ */
+int bench_spectral(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench spectral mesh.obj [modes=100] [h=0.0001]\n";
+        return 1;
+    }
+    Smoothing_Options opts = default_smoothing_options();
+    opts.precision = PRECISION_DOUBLE;
+    opts.method = METHOD_SPECTRAL;
+    if (argc > 1) {
+        set_smoothing_option(opts, "spectral_modes", argv[1]);
+    }
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    Bench_Mesh m = load_mesh(argv[0]);
+
+    printf("%s: %d vertices, %d modes\n", argv[0], (int) m.hevs->size() - 1,
+           opts.spectral_modes);
+    char cache[] = "/tmp/bench_spectral_XXXXXX";
+    if (!mkdtemp(cache)) {
+        cerr << "cannot create a temporary directory for the cache\n";
+        return 1;
+    }
+    const char *names[] = {"no cache", "cache", "cache"};
+    Spectral_Smoother *smoother = NULL;
+    for (int r = 0; r < 3; r++) {
+        Smoothing_Options run = opts;
+        run.spectral_cache = (r == 0) ? "" : cache;
+        delete smoother;
+        Clock::time_point start = Clock::now();
+        smoother = new Spectral_Smoother(m.hevs, run);
+        printf("%-10s %10.3f s  %s\n", names[r], seconds_since(start),
+               smoother->loaded_from_cache ? "loaded" : "computed");
+    }
+    std::filesystem::remove_all(cache);
+
+    // Residuals of the eigenpairs, three at a time, with K φ = (M + K)φ - Mφ
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> pos;
+    gather_positions(m.hevs, pos);
+    Smoothing_System<double> system;
+    system.assign(topo, pos, 1);
+    const Eigenbasis &basis = smoother->basis;
+    int k = basis.values.size();
+    double max_residual = 0;
+    for (int j = 0; j < k; j += 3) {
+        Positions<double> phi = Positions<double>::Zero(pos.rows(), 3), A_phi;
+        for (int c = 0; c < 3 && j + c < k; c++) {
+            phi.col(c) = basis.vectors.col(j + c);
+        }
+        system.apply(phi, A_phi);
+        for (int c = 0; c < 3 && j + c < k; c++) {
+            Eigen::VectorXd M_phi = system.mass.cwiseProduct(phi.col(c));
+            Eigen::VectorXd residual = A_phi.col(c) - M_phi - basis.values(j + c) * M_phi;
+            // The constant mode has λ = 0, so it is measured against Mφ
+            double scale = max(basis.values(j + c), 1.0) * M_phi.norm();
+            max_residual = max(max_residual, residual.norm() / scale);
+        }
+    }
+    printf("smallest eigenvalues:");
+    for (int j = 0; j < min(k, 6); j++) {
+        printf(" %.4g", basis.values(j));
+    }
+    printf(" ... %.4g\nlargest relative residual %.3e\n", basis.values(k - 1), max_residual);
+
+    const int JUMPS = 1000;
+    Clock::time_point start = Clock::now();
+    for (int j = 0; j < JUMPS; j++) {
+        smoother->jump_to(h * (j % 100));
+    }
+    printf("jump to an amount of smoothing: %.1f us\n", 1e6 * seconds_since(start) / JUMPS);
+    delete smoother;
+
+    Smoothing_Options implicit = default_smoothing_options();
+    implicit.precision = PRECISION_DOUBLE;
+    reset_positions(m);
+    Smoother *generation = make_smoother(m.hevs, implicit);
+    start = Clock::now();
+    generation->step(h);
+    printf("one implicit generation (%s): %.1f us\n", solver_name(implicit.solver),
+           1e6 * seconds_since(start));
+    delete generation;
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'bilaplacian' benchmark:
+ *
+ * Assembles the second-order system M - hL and the fourth-order one
+ * M + h L M^-1 L of every mesh and reports the nonzeros of both, how much
+ * the sparse product grows them, the time to reassemble the product on its
+ * cached pattern and the ordering auto picks for each. Then it factorizes
+ * both, permuted by that ordering, with the supernodal Cholesky and
+ * SimplicialLDLT like the cholesky benchmark, and reports how much the
+ * factors and the factorization time grow.
+ */
+int bench_bilaplacian(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench bilaplacian mesh.obj|torus:NUxNV[@S] ... \n";
+        return 1;
+    }
+    const double h = 0.0001;
+    const int REPEATS = 5;
+    typedef Eigen::SparseMatrix<double> Matrix;
+    typedef Eigen::SimplicialLDLT<Matrix, Eigen::Lower, Eigen::NaturalOrdering<int> > LDLT;
+
+    for (int a = 0; a < argc; a++) {
+        Bench_Mesh m = load_mesh(argv[a]);
+        Mesh_Topology topo;
+        build_topology(m.hevs, topo);
+        Positions<double> pos;
+        gather_positions(m.hevs, pos);
+        free_mesh(m);
+
+        Smoothing_System<double> second;
+        second.assign(topo, pos, h);
+        Bilaplacian_System<double> fourth;
+        fourth.assign(topo, pos, h);
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < REPEATS; r++) {
+            fourth.assign(topo, pos, h);
+        }
+        double assembly = seconds_since(start) / REPEATS;
+
+        Matrix second_matrix = second.assemble();
+        const Matrix *systems[2] = {&second_matrix, &fourth.assemble()};
+        const char *names[2] = {"second order", "fourth order"};
+        long nonzeros[2], factor_nonzeros[2];
+        double factor_ms[2];
+        printf("%s: %d vertices, fourth-order assembly %.1f ms\n", argv[a], topo.num_vertices,
+               1000 * assembly);
+        for (int s = 0; s < 2; s++) {
+            const Matrix &A = *systems[s];
+            Ordering_Permutation inverse_perm;
+            Ordering_Type ordering = compute_ordering(ORDERING_AUTO, A, inverse_perm);
+            Matrix permuted;
+            permuted = A.twistedBy(inverse_perm.inverse());
+            Eigen::MatrixXd B = Eigen::MatrixXd::Random(A.rows(), 3);
+            nonzeros[s] = A.nonZeros();
+
+            printf("%s: %ld nonzeros, %s ordering, %ld predicted factor nonzeros\n", names[s],
+                   nonzeros[s], ordering_name(ordering), predict_fill(A, inverse_perm));
+            printf("%-12s %8s %12s %12s %12s %14s %10s %12s\n", "factor", "threads",
+                   "analyze ms", "factor ms", "solve ms", "factor nnz", "peak MB", "residual");
+            time_cholesky< Supernodal_Cholesky<Matrix> >("supernodal", thread_pool().size(), permuted, B);
+            time_cholesky<LDLT>("ldlt", 1, permuted, B);
+
+            // The supernodal factorization once more, for the growth below
+            Supernodal_Cholesky<Matrix> cholesky;
+            cholesky.analyzePattern(permuted);
+            start = Clock::now();
+            cholesky.factorize(permuted);
+            factor_ms[s] = 1000 * seconds_since(start);
+            factor_nonzeros[s] = count_factor_nonzeros(cholesky);
+        }
+        printf("growth: %.2fx matrix nonzeros, %.2fx factor nonzeros, %.2fx factorization time\n\n",
+               double(nonzeros[1]) / nonzeros[0], double(factor_nonzeros[1]) / factor_nonzeros[0],
+               factor_ms[1] / factor_ms[0]);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'adaptive' benchmark:
+ *
+ * Smooths the mesh for a total time T, the amount of smoothing the viewer's
+ * smoothness keys also count in, with a few fixed time steps and with
+ * adaptive steps seeded by the smallest of them (double precision,
+ * supernodal solver). The last step of every run is shortened to end at T
+ * exactly. Reports the generations, solves and wall time each run took, the
+ * largest distance of its vertices from the run with the smallest fixed step
+ * relative to the bounding box diagonal, and its roughness, the RMS distance
+ * of the vertices from the mean of their neighbors over the mean edge
+ * length, relative to the original. Then prints the steps the adaptive run
+ * picked.
+ */
+double roughness(const Mesh_Topology &topo, const Positions<double> &pos)
+{
+    Laplacian_Operator<double> umbrella;
+    umbrella.assign_uniform(topo);
+    Positions<double> delta;
+    umbrella.apply(pos, delta);
+    double edges = 0;
+    for (int i = 0; i < topo.num_vertices; i++) {
+        for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+            edges += (pos.row(topo.he_to[k]) - pos.row(i)).norm();
+        }
+    }
+    edges /= topo.he_to.size();
+    return sqrt(delta.squaredNorm() / topo.num_vertices) / edges;
+}
+
+int bench_adaptive(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench adaptive mesh.obj [T=0.003] [h ...]\n";
+        return 1;
+    }
+    double T = (argc > 1) ? stod(argv[1]) : 0.003;
+    vector<double> steps;
+    for (int a = 2; a < argc; a++) {
+        steps.push_back(stod(argv[a]));
+    }
+    if (steps.empty()) {
+        steps = {1e-5, 1e-4, 1e-3};
+    }
+    Smoothing_Options opts = default_smoothing_options();
+    opts.precision = PRECISION_DOUBLE;
+    opts.solver = SOLVER_SUPERNODAL;
+
+    Bench_Mesh m = load_mesh(argv[0]);
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> pos, reference;
+    gather_positions(m.hevs, pos);
+    double original_roughness = roughness(topo, pos);
+    double diagonal = (pos.colwise().maxCoeff() - pos.colwise().minCoeff()).norm();
+
+    printf("%s: %d vertices, smoothing for T = %g\n", argv[0], (int) pos.rows(), T);
+    printf("%-16s %12s %10s %12s %14s %12s\n", "h", "generations", "solves", "seconds",
+           "max deviation", "roughness");
+    Adaptive_Stepper *adaptive = NULL;
+    for (int r = 0; r <= (int) steps.size(); r++) {
+        Smoothing_Options run = opts;
+        run.adaptive_step = (r == (int) steps.size());
+        double h = run.adaptive_step ? steps[0] : steps[r];
+        reset_positions(m);
+        Smoother *smoother = make_smoother(m.hevs, run);
+        if (run.adaptive_step) {
+            adaptive = static_cast<Adaptive_Stepper *>(smoother);
+            adaptive->next_h = h;
+        }
+
+        int generations = 0;
+        double elapsed = 0;
+        Clock::time_point start = Clock::now();
+        while (elapsed < T * (1 - 1e-9)) {
+            if (adaptive) {
+                adaptive->next_h = min(adaptive->next_h, T - elapsed);
+                smoother->step(h);
+                elapsed = adaptive->elapsed;
+            } else {
+                smoother->step(min(h, T - elapsed));
+                elapsed += min(h, T - elapsed);
+            }
+            generations++;
+        }
+        double seconds = seconds_since(start);
+        smoother->store(m.hevs);
+        gather_positions(m.hevs, pos);
+        if (r == 0) {
+            reference = pos;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), adaptive ? "adaptive %g" : "%g", h);
+        int solves = adaptive ? 3 * (generations + adaptive->rejections) : generations;
+        printf("%-16s %12d %10d %12.3f %14.3e %12.4f\n", name, generations, solves, seconds,
+               (pos - reference).rowwise().norm().maxCoeff() / diagonal,
+               roughness(topo, pos) / original_roughness);
+        if (!adaptive) {
+            delete smoother;
+        }
+    }
+
+    printf("adaptive steps (%d retried):", adaptive->rejections);
+    for (int g = 0; g < (int) adaptive->steps.size(); g++) {
+        printf(" %.3g", adaptive->steps[g]);
+    }
+    printf("\n");
+    delete adaptive;
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'idle' benchmark:
+ *
+ * Runs the given methods (by default implicit, taubin and spectral) for up to
+ * the given number of generations the way the viewer does and reports the generation after which the viewer would pause
+ * with the given idle_tol, the metrics of that generation (or the last one)
+ * and the time the generations took.
+ */
+int bench_idle(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench idle mesh.obj [generations=500] [idle_tol=1e-5] [h=0.0001] "
+                "[method ...]\n";
+        return 1;
+    }
+    int max_generations = (argc > 1) ? stoi(argv[1]) : 500;
+    double tol = (argc > 2) ? stod(argv[2]) : 1e-5;
+    double h = (argc > 3) ? stod(argv[3]) : 0.0001;
+    vector<string> methods;
+    for (int a = 4; a < argc; a++) {
+        methods.push_back(argv[a]);
+    }
+    if (methods.empty()) {
+        methods = {"implicit", "taubin", "spectral"};
+    }
+    Bench_Mesh m = load_mesh(argv[0]);
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> before, after;
+    gather_positions(m.hevs, before);
+    double diagonal = (before.colwise().maxCoeff() - before.colwise().minCoeff()).norm();
+    double area, volume;
+    measure_surface(topo, before, area, volume);
+
+    printf("%s: %d vertices, idle_tol %g, h %g\n", argv[0], topo.num_vertices, tol, h);
+    printf("%-12s %12s %12s %12s %12s %12s %10s\n", "method", "idle after", "max moved",
+           "rms moved", "area change", "volume chg", "seconds");
+    for (int r = 0; r < (int) methods.size(); r++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.precision = PRECISION_DOUBLE;
+        set_smoothing_option(opts, "method", methods[r]);
+        reset_positions(m);
+        Smoother *smoother = make_smoother(m.hevs, opts);
+
+        Generation_Metrics metrics;
+        int generation = 0;
+        bool idle = false;
+        double seconds = 0;
+        while (!idle && generation < max_generations) {
+            gather_positions(m.hevs, before);
+            Clock::time_point start = Clock::now();
+            smoother->step(h);
+            seconds += seconds_since(start);
+            smoother->store(m.hevs);
+            gather_positions(m.hevs, after);
+            metrics = measure_generation(topo, before, after, diagonal, area, volume);
+            idle = converged(metrics, tol);
+            generation++;
+        }
+        char when[16] = "-";
+        if (idle) {
+            snprintf(when, sizeof(when), "%d", generation);
+        }
+        printf("%-12s %12s %12.3e %12.3e %12.3e %12.3e %10.2f\n", methods[r].c_str(), when,
+               metrics.max_displacement, metrics.rms_displacement, metrics.area_change,
+               metrics.volume_change, seconds);
+        delete smoother;
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'frozen' benchmark:
+ *
+ * Smooths the mesh for some generations with implicit fairing (double
+ * precision, default solver) refactorizing every generation, and with the
+ * operator frozen for up to K generations at a few weight drift thresholds.
+ * Reports the time per generation, how many generations factorized, and the
+ * largest and RMS distance of the vertices from the exact run relative to
+ * the bounding box diagonal.
+ */
+int bench_frozen(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench frozen mesh.obj [generations=20] [h=0.0001] [K ...]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 20;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    vector<int> frozen;
+    for (int a = 3; a < argc; a++) {
+        frozen.push_back(stoi(argv[a]));
+    }
+    if (frozen.empty()) {
+        frozen = {2, 5, 10, 1000};
+    }
+    const double drifts[] = {0.01, 0.05, 0.2};
+    Bench_Mesh m = load_mesh(argv[0]);
+    Positions<double> exact, pos;
+    gather_positions(m.hevs, pos);
+    double diagonal = (pos.colwise().maxCoeff() - pos.colwise().minCoeff()).norm();
+
+    printf("%s: %d vertices, %d generations, h = %g\n", argv[0], (int) pos.rows(),
+           generations, h);
+    printf("%-8s %8s %12s %16s %14s %14s\n", "K", "drift", "ms / gen", "factorizations",
+           "max distance", "rms distance");
+    for (int r = -1; r < (int) frozen.size() * 3; r++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.precision = PRECISION_DOUBLE;
+        if (r >= 0) {
+            opts.freeze_generations = frozen[r / 3];
+            opts.freeze_drift = drifts[r % 3];
+        }
+        reset_positions(m);
+        Implicit_Smoother<double> smoother(m.hevs, opts);
+        int factorizations = 0;
+        Clock::time_point start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            smoother.step(h);
+            factorizations += smoother.refactorized;
+        }
+        double total = seconds_since(start);
+        if (r < 0) {
+            exact = smoother.positions;
+        }
+        Eigen::VectorXd distances = (smoother.positions - exact).rowwise().norm() / diagonal;
+        char drift[16] = "-";
+        if (r >= 0) {
+            snprintf(drift, sizeof(drift), "%g", opts.freeze_drift);
+        }
+        printf("%-8d %8s %12.2f %16d %14.3e %14.3e\n", opts.freeze_generations, drift,
+               1000 * total / generations, factorizations,
+               distances.maxCoeff(), distances.norm() / sqrt(double(distances.size())));
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'incremental' benchmark:
+ *
+ * Runs implicit fairing (double precision, default solver) for some
+ * generations, recomputing every row of the system each generation and
+ * recomputing only the rows around vertices that moved by more than a few
+ * epsilons relative to the bounding box diagonal. Reports the assembly time
+ * per generation and the fraction of rows recomputed, both over the first
+ * and the last tenth of the generations, the factorizations that were
+ * skipped because nothing moved enough, the total time per generation and
+ * the largest distance from the full run relative to the diagonal.
+ */
+int bench_incremental(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench incremental mesh.obj [generations=200] [h=0.00001] [epsilon ...]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 200;
+    double h = (argc > 2) ? stod(argv[2]) : 0.00001;
+    vector<double> epsilons;
+    for (int a = 3; a < argc; a++) {
+        epsilons.push_back(stod(argv[a]));
+    }
+    if (epsilons.empty()) {
+        epsilons = {1e-5, 1e-4, 1e-3};
+    }
+    Smoothing_Options opts = default_smoothing_options();
+    opts.precision = PRECISION_DOUBLE;
+    Bench_Mesh m = load_mesh(argv[0]);
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> original, exact;
+    gather_positions(m.hevs, original);
+    free_mesh(m);
+    double diagonal = (original.colwise().maxCoeff() - original.colwise().minCoeff()).norm();
+    int tenth = max(generations / 10, 1);
+
+    printf("%s: %d vertices, %d generations, h = %g, solver %s\n", argv[0], topo.num_vertices,
+           generations, h, solver_name(opts.solver));
+    printf("%-10s %16s %16s %12s %12s %10s %14s\n", "epsilon", "assembly ms first",
+           "assembly ms last", "rows first", "rows last", "skipped", "ms / gen");
+    for (int r = -1; r < (int) epsilons.size(); r++) {
+        Smoothing_System<double> system;
+        Linear_Solver<double> *solver = make_linear_solver<double, double>(opts);
+        Positions<double> pos = original, rhs;
+        double epsilon = (r < 0) ? 0 : epsilons[r] * diagonal;
+        double assembly[2] = {0, 0}, rows[2] = {0, 0};
+        int skipped = 0;
+
+        Clock::time_point start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            Clock::time_point assembly_start = Clock::now();
+            int updated = topo.num_vertices;
+            if (r < 0) {
+                system.assign(topo, pos, h);
+            } else {
+                updated = system.update(topo, pos, h, epsilon);
+            }
+            double seconds = seconds_since(assembly_start);
+            int part = (gen < tenth) ? 0 : (gen >= generations - tenth) ? 1 : -1;
+            if (part >= 0) {
+                assembly[part] += seconds;
+                rows[part] += double(updated) / topo.num_vertices;
+            }
+
+            if (gen == 0) {
+                solver->analyze(system);
+            }
+            if (updated > 0) {
+                solver->factorize(system);
+            } else {
+                skipped++;
+            }
+            system.rhs(pos, rhs);
+            solver->solve(system, rhs, pos);
+        }
+        double total = seconds_since(start);
+        delete solver;
+        if (r < 0) {
+            exact = pos;
+        }
+
+        char name[16] = "all";
+        if (r >= 0) {
+            snprintf(name, sizeof(name), "%g", epsilons[r]);
+        }
+        printf("%-10s %16.3f %16.3f %12.3f %12.3f %10d %14.2f  max distance %.3e\n", name,
+               1000 * assembly[0] / tenth, 1000 * assembly[1] / tenth, rows[0] / tenth,
+               rows[1] / tenth, skipped, 1000 * total / generations,
+               (pos - exact).rowwise().norm().maxCoeff() / diagonal);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'roi' benchmark:
+ *
+ * Smooths the region of interest within a number of rings of one vertex
+ * (1-based, as in the .obj file) for some generations, with the rest of the
+ * mesh held in place, and the whole mesh with implicit fairing, both in
+ * double precision with the default solver. Reports the region size, the
+ * time per generation, how far the vertices inside and outside the region
+ * moved and how far the seed ends up from where smoothing the whole mesh
+ * puts it, relative to the bounding box diagonal.
+ */
+int bench_roi(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench roi mesh.obj [vertex=1] [generations=10] [h=0.0001] [rings ...]\n";
+        return 1;
+    }
+    int seed = (argc > 1) ? stoi(argv[1]) : 1;
+    int generations = (argc > 2) ? stoi(argv[2]) : 10;
+    double h = (argc > 3) ? stod(argv[3]) : 0.0001;
+    vector<int> rings;
+    for (int a = 4; a < argc; a++) {
+        rings.push_back(stoi(argv[a]));
+    }
+    if (rings.empty()) {
+        rings = {2, 8, 32};
+    }
+    typedef Direct_Backends<double, double>::LU LU;
+    Bench_Mesh m = load_mesh(argv[0]);
+    Positions<double> original, full;
+    gather_positions(m.hevs, original);
+    double diagonal = (original.colwise().maxCoeff() - original.colwise().minCoeff()).norm();
+
+    Smoothing_Options opts = default_smoothing_options();
+    opts.precision = PRECISION_DOUBLE;
+    Implicit_Smoother<double> whole(m.hevs, opts);
+    Clock::time_point start = Clock::now();
+    for (int gen = 0; gen < generations; gen++) {
+        whole.step(h);
+    }
+    double whole_seconds = seconds_since(start);
+    full = whole.positions;
+
+    printf("%s: %d vertices, vertex %d, %d generations, h = %g\n", argv[0],
+           (int) original.rows(), seed, generations, h);
+    printf("%-8s %10s %12s %10s %14s %14s %14s\n", "rings", "vertices", "ms / gen", "speedup",
+           "moved inside", "moved outside", "seed vs full");
+    printf("%-8s %10d %12.2f %10s %14.3e %14s %14s\n", "all", (int) original.rows(),
+           1000 * whole_seconds / generations, "1.00",
+           (full - original).rowwise().norm().maxCoeff() / diagonal, "-", "0");
+    for (int r = 0; r < rings.size(); r++) {
+        opts.roi_seeds.assign(1, seed - 1);
+        opts.roi_rings = rings[r];
+        reset_positions(m);
+        Region_Smoother<double, LU> smoother(m.hevs, opts);
+        start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            smoother.step(h);
+        }
+        double seconds = seconds_since(start);
+
+        const vector<int> &region = smoother.region_vertices();
+        vector<char> inside(original.rows(), 0);
+        for (int i = 0; i < region.size(); i++) {
+            inside[region[i]] = 1;
+        }
+        double moved_inside = 0, moved_outside = 0;
+        for (int i = 0; i < original.rows(); i++) {
+            double moved = (smoother.positions.row(i) - original.row(i)).norm() / diagonal;
+            double &largest = inside[i] ? moved_inside : moved_outside;
+            largest = max(largest, moved);
+        }
+        printf("%-8d %10d %12.2f %10.2f %14.3e %14.3e %14.3e\n", rings[r], (int) region.size(),
+               1000 * seconds / generations, whole_seconds / seconds, moved_inside, moved_outside,
+               (smoother.positions.row(seed - 1) - full.row(seed - 1)).norm() / diagonal);
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* The whole system of laplacian.h with every pinned vertex held near its
+ * target by a penalty: the row keeps its unknown, and a weight far above the
+ * rest of the diagonal is added to it and, times the target, to its
+ * right-hand side. This is the usual alternative to eliminating the pins.
+ */
+struct Penalty_System
+{
+    static constexpr double PENALTY = 1e8;
+
+    Smoothing_System<double> system;
+    vector<int> pinned;
+    Positions<double> targets;
+    double weight;
+    Eigen::SparseMatrix<double> matrix;
+
+    void assign(const Mesh_Topology &topo, const Positions<double> &pos, double h)
+    {
+        system.assign(topo, pos, h);
+        matrix = system.assemble();
+        weight = PENALTY * system.diagonal().maxCoeff();
+        for (int p = 0; p < pinned.size(); p++) {
+            matrix.coeffRef(pinned[p], pinned[p]) += weight;
+        }
+    }
+
+    void apply(const Positions<double> &X, Positions<double> &Y) const
+    {
+        Y = matrix * X;
+    }
+
+    void rhs(const Positions<double> &X, Positions<double> &B) const
+    {
+        system.rhs(X, B);
+        for (int p = 0; p < pinned.size(); p++) {
+            B.row(pinned[p]) += weight * targets.row(pinned[p]);
+        }
+    }
+
+    const Eigen::SparseMatrix<double> &assemble() const
+    {
+        return matrix;
+    }
+};
+
+/* 'pinned' benchmark:
+ *
+ * Pins a number of vertices spread evenly over the mesh and runs implicit
+ * fairing (double precision, LU) for some generations, once with the pins
+ * eliminated from the unknowns (Region_Smoother) and once with a penalty on
+ * their rows (Penalty_System). Reports the unknowns, the factorization
+ * nonzeros, the time per generation, how far the pinned vertices drifted and
+ * how far apart the two results end up, relative to the bounding box
+ * diagonal.
+ */
+int bench_pinned(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench pinned mesh.obj [generations=10] [h=0.0001] [pins ...]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 10;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    vector<int> counts;
+    for (int a = 3; a < argc; a++) {
+        counts.push_back(stoi(argv[a]));
+    }
+    if (counts.empty()) {
+        counts = {10, 1000, 5000};
+    }
+    typedef Direct_Backends<double, double>::LU LU;
+    Bench_Mesh m = load_mesh(argv[0]);
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> original;
+    gather_positions(m.hevs, original);
+    int n = original.rows();
+    double diagonal = (original.colwise().maxCoeff() - original.colwise().minCoeff()).norm();
+
+    printf("%s: %d vertices, %d generations, h = %g\n", argv[0], n, generations, h);
+    printf("%-8s %-12s %10s %14s %12s %14s %14s\n", "pins", "method", "unknowns",
+           "factor nnz", "ms / gen", "pin drift", "distance");
+    for (int c = 0; c < counts.size(); c++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.precision = PRECISION_DOUBLE;
+        for (int p = 0; p < min(counts[c], n); p++) {
+            opts.pinned.push_back(int((long long) p * n / min(counts[c], n)));
+        }
+
+        reset_positions(m);
+        Region_Smoother<double, LU> eliminated(m.hevs, opts);
+        Clock::time_point start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            eliminated.step(h);
+        }
+        double eliminated_seconds = seconds_since(start);
+
+        Penalty_System penalty;
+        penalty.pinned = opts.pinned;
+        penalty.targets = original;
+        LU solver(opts.ordering, opts.refine_steps, opts.refine_tol);
+        Positions<double> pos = original, rhs;
+        start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            penalty.assign(topo, pos, h);
+            if (gen == 0) {
+                solver.analyze_system(penalty);
+            }
+            solver.factorize_system(penalty);
+            penalty.rhs(pos, rhs);
+            solver.solve_system(penalty, rhs, pos);
+        }
+        double penalty_seconds = seconds_since(start);
+
+        double eliminated_drift = 0, penalty_drift = 0;
+        for (int p = 0; p < opts.pinned.size(); p++) {
+            int i = opts.pinned[p];
+            eliminated_drift = max(eliminated_drift,
+                                   (eliminated.positions.row(i) - original.row(i)).norm());
+            penalty_drift = max(penalty_drift, (pos.row(i) - original.row(i)).norm());
+        }
+        double distance = (eliminated.positions - pos).rowwise().norm().maxCoeff() / diagonal;
+        printf("%-8d %-12s %10d %14ld %12.2f %14.3e %14s\n", (int) opts.pinned.size(),
+               "eliminated", (int) eliminated.region_vertices().size(),
+               eliminated.linear_solver().factor_nonzeros(),
+               1000 * eliminated_seconds / generations, eliminated_drift / diagonal, "");
+        printf("%-8s %-12s %10d %14ld %12.2f %14.3e %14.3e\n", "", "penalty", n,
+               solver.factor_nonzeros(), 1000 * penalty_seconds / generations,
+               penalty_drift / diagonal, distance);
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'components' benchmark:
+ *
+ * Smooths a mesh of several shells, like "8*bunny.obj", for some
+ * generations with implicit fairing (double precision, default solver), once
+ * as one system and once with every connected component as its own system,
+ * solved in parallel on 1, 2, 4, ... threads. Reports the time per
+ * generation, the speedup over one system and the largest distance between
+ * the results relative to the bounding box diagonal.
+ */
+int bench_components(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench components mesh [generations=5] [h=0.0001] [threads ...]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 5;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    vector<int> threads;
+    for (int a = 3; a < argc; a++) {
+        threads.push_back(stoi(argv[a]));
+    }
+    if (threads.empty()) {
+        int hardware = max((int) std::thread::hardware_concurrency(), 1);
+        for (int t = 1; t < hardware; t *= 2) {
+            threads.push_back(t);
+        }
+        threads.push_back(hardware);
+    }
+    Bench_Mesh m = load_mesh(argv[0]);
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> original, joint;
+    gather_positions(m.hevs, original);
+    double diagonal = (original.colwise().maxCoeff() - original.colwise().minCoeff()).norm();
+
+    printf("%s: %d vertices, %d components, %d generations, h = %g, solver %s\n", argv[0],
+           topo.num_vertices, topo.num_components, generations, h,
+           solver_name(default_smoothing_options().solver));
+    printf("%-10s %8s %12s %10s %14s\n", "systems", "threads", "ms / gen", "speedup",
+           "max distance");
+    double joint_seconds = 0;
+    for (int r = -1; r < (int) threads.size(); r++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.precision = PRECISION_DOUBLE;
+        opts.split_components = r >= 0;
+        opts.threads = (r >= 0) ? threads[r] : 0;
+        reset_positions(m);
+        Smoother *smoother = make_smoother(m.hevs, opts);
+        Clock::time_point start = Clock::now();
+        for (int gen = 0; gen < generations; gen++) {
+            smoother->step(h);
+        }
+        double seconds = seconds_since(start);
+        smoother->store(m.hevs);
+        delete smoother;
+
+        Positions<double> pos;
+        gather_positions(m.hevs, pos);
+        if (r < 0) {
+            joint = pos;
+            joint_seconds = seconds;
+            printf("%-10d %8s %12.2f %10.2f %14s\n", 1, "all", 1000 * seconds / generations,
+                   1.0, "-");
+        } else {
+            printf("%-10d %8d %12.2f %10.2f %14.3e\n", topo.num_components, threads[r],
+                   1000 * seconds / generations, joint_seconds / seconds,
+                   (pos - joint).rowwise().norm().maxCoeff() / diagonal);
+        }
+    }
+    set_num_threads(0);
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'objects' benchmark:
+ *
+ * Loads a number of copies of a mesh as separate objects, like a scene of
+ * that many objects in the viewer, and times frames of one generation per
+ * object with the viewer's default options: the objects one after another,
+ * with each solver using the pool, and every object as a task on the pool,
+ * as smoothNextFrame runs them, on 1, 2, 4, ... threads.
+ */
+int bench_objects(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench objects mesh [objects=16] [frames=5] [h=0.0001] [threads ...]\n";
+        return 1;
+    }
+    int num_objects = (argc > 1) ? stoi(argv[1]) : 16;
+    int frames = (argc > 2) ? stoi(argv[2]) : 5;
+    double h = (argc > 3) ? stod(argv[3]) : 0.0001;
+    vector<int> threads;
+    for (int a = 4; a < argc; a++) {
+        threads.push_back(stoi(argv[a]));
+    }
+    if (threads.empty()) {
+        int hardware = max((int) std::thread::hardware_concurrency(), 1);
+        for (int t = 1; t < hardware; t *= 2) {
+            threads.push_back(t);
+        }
+        threads.push_back(hardware);
+    }
+    vector<Bench_Mesh> meshes;
+    for (int o = 0; o < num_objects; o++) {
+        meshes.push_back(load_mesh(argv[0]));
+    }
+
+    printf("%s: %d objects of %d vertices, %d frames, h = %g\n", argv[0], num_objects,
+           (int) meshes[0].hevs->size() - 1, frames, h);
+    printf("%-8s %18s %18s %10s\n", "threads", "sequential ms", "tasks ms", "speedup");
+    for (int r = 0; r < threads.size(); r++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.threads = threads[r];
+        double seconds[2];
+        for (int tasks = 0; tasks < 2; tasks++) {
+            vector<Smoother *> smoothers;
+            for (int o = 0; o < num_objects; o++) {
+                reset_positions(meshes[o]);
+                smoothers.push_back(make_smoother(meshes[o].hevs, opts));
+            }
+            Clock::time_point start = Clock::now();
+            for (int frame = 0; frame < frames; frame++) {
+                auto generation = [&](int o) {
+                    smoothers[o]->step(h);
+                    smoothers[o]->store(meshes[o].hevs);
+                };
+                if (tasks) {
+                    thread_pool().parallel_for(0, num_objects, 1, generation);
+                } else {
+                    for (int o = 0; o < num_objects; o++) {
+                        generation(o);
+                    }
+                }
+            }
+            seconds[tasks] = seconds_since(start);
+            for (int o = 0; o < num_objects; o++) {
+                delete smoothers[o];
+            }
+        }
+        printf("%-8d %18.2f %18.2f %10.2f\n", threads[r], 1000 * seconds[0] / frames,
+               1000 * seconds[1] / frames, seconds[0] / seconds[1]);
+    }
+    set_num_threads(0);
+    for (int o = 0; o < num_objects; o++) {
+        free_mesh(meshes[o]);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'batch' benchmark:
+ *
+ * Smooths many copies of a small mesh, like the assets of a pipeline, for a
+ * few generations each with the default options: once one at a time, with a
+ * smoother of their own that is set up, stepped and stored per mesh, and
+ * once with make_batch_smoother packing them into 1, one per thread and the
+ * other given numbers of block-diagonal systems. Reports meshes per second,
+ * setup included, and the largest distance from the one-at-a-time results
+ * relative to the bounding box diagonal.
+ */
+int bench_batch(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench batch mesh [meshes=1000] [generations=5] [h=0.0001] [batches ...]\n";
+        return 1;
+    }
+    int num_meshes = (argc > 1) ? stoi(argv[1]) : 1000;
+    int generations = (argc > 2) ? stoi(argv[2]) : 5;
+    double h = (argc > 3) ? stod(argv[3]) : 0.0001;
+    vector<int> batches;
+    batches.push_back(1);
+    batches.push_back(0);
+    for (int a = 4; a < argc; a++) {
+        batches.push_back(stoi(argv[a]));
+    }
+    vector<Bench_Mesh> meshes;
+    vector< vector<HEV *> * > hevs;
+    for (int m = 0; m < num_meshes; m++) {
+        meshes.push_back(load_mesh(argv[0]));
+        hevs.push_back(meshes[m].hevs);
+    }
+    Smoothing_Options opts = default_smoothing_options();
+    Positions<double> original;
+    gather_positions(hevs[0], original);
+    double diagonal = (original.colwise().maxCoeff() - original.colwise().minCoeff()).norm();
+
+    printf("%s: %d meshes of %d vertices, %d generations, h = %g, solver %s\n", argv[0],
+           num_meshes, (int) original.rows(), generations, h, solver_name(opts.solver));
+    printf("%-14s %14s %10s %14s\n", "batches", "meshes / s", "speedup", "max distance");
+
+    // One smoother per mesh, as a loop over the assets would
+    vector< Positions<double> > single(num_meshes);
+    Clock::time_point start = Clock::now();
+    for (int m = 0; m < num_meshes; m++) {
+        Smoother *smoother = make_smoother(hevs[m], opts);
+        for (int gen = 0; gen < generations; gen++) {
+            smoother->step(h);
+        }
+        smoother->store(hevs[m]);
+        delete smoother;
+    }
+    double single_seconds = seconds_since(start);
+    for (int m = 0; m < num_meshes; m++) {
+        gather_positions(hevs[m], single[m]);
+    }
+    printf("%-14s %14.0f %10.2f %14s\n", "one at a time", num_meshes / single_seconds, 1.0, "-");
+
+    for (int r = 0; r < batches.size(); r++) {
+        for (int m = 0; m < num_meshes; m++) {
+            reset_positions(meshes[m]);
+        }
+        start = Clock::now();
+        Batch_Smoother *smoother = make_batch_smoother(hevs, opts, batches[r]);
+        for (int gen = 0; gen < generations; gen++) {
+            smoother->step(h);
+        }
+        smoother->store(hevs);
+        double seconds = seconds_since(start);
+        int num_batches = smoother->num_batches();
+        delete smoother;
+
+        double distance = 0;
+        for (int m = 0; m < num_meshes; m++) {
+            Positions<double> pos;
+            gather_positions(hevs[m], pos);
+            distance = max(distance, (pos - single[m]).rowwise().norm().maxCoeff() / diagonal);
+        }
+        printf("%-14d %14.0f %10.2f %14.3e\n", num_batches, num_meshes / seconds,
+               single_seconds / seconds, distance);
+    }
+    for (int m = 0; m < num_meshes; m++) {
+        free_mesh(meshes[m]);
+    }
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Sum of a few square roots, as a body of adjustable cost that cannot be optimized away
+double spin(int work)
+{
+    double sum = 0;
+    for (int w = 0; w < work; w++) {
+        sum += sqrt(double(w + 1));
+    }
+    return sum;
+}
+
+// Prints one loop of the scheduler benchmark; loops run inline have no tasks
+void print_loop(int threads, const char *loop, double ms, double overhead,
+                const Scheduler_Stats &stats)
+{
+    char per_task[32] = "-";
+    if (stats.tasks > 0) {
+        snprintf(per_task, sizeof(per_task), "%.1f", 1e9 * overhead / stats.tasks);
+    }
+    printf("%-8d %-10s %12.4f %10s %10ld %10ld\n", threads, loop, ms, per_task, stats.tasks,
+           stats.steals);
+}
+
+/* 'scheduler' benchmark:
+ *
+ * Measures the work-stealing pool of parallel.h on 1, 2, 4, ... threads:
+ * the cost of a parallel_for call that does nothing, the overhead per chunk
+ * of a loop over 2^20 cheap indices with grains 1, 64 and 4096 against a
+ * serial loop, and a loop whose indices cost more the later they are, where
+ * threads that finish their share steal from the others; for every loop the
+ * chunks run and how many of them were stolen. Then times the stages that
+ * run on the pool for the mesh: parsing it (for a plain .obj file), building
+ * its halfedges, assigning and assembling the system of a generation, and
+ * the area and volume reduction of the generation metrics.
+ */
+int bench_scheduler(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench scheduler mesh [threads ...]\n";
+        return 1;
+    }
+    vector<int> threads;
+    for (int a = 1; a < argc; a++) {
+        threads.push_back(stoi(argv[a]));
+    }
+    if (threads.empty()) {
+        int hardware = max((int) std::thread::hardware_concurrency(), 1);
+        for (int t = 1; t < hardware; t *= 2) {
+            threads.push_back(t);
+        }
+        threads.push_back(hardware);
+    }
+    const int N = 1 << 20, CALLS = 2000, UNEVEN = 1 << 14, REPEATS = 5;
+    vector<double> out(N);
+
+    // Serial references
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < N; i++) {
+        out[i] = sqrt(double(i));
+    }
+    double serial_cheap = seconds_since(start);
+    start = Clock::now();
+    for (int i = 0; i < UNEVEN; i++) {
+        out[i] = spin(i / 64);
+    }
+    double serial_uneven = seconds_since(start);
+
+    printf("scheduler: %d cheap indices (serial %.2f ms), %d uneven ones (serial %.2f ms)\n", N,
+           1000 * serial_cheap, UNEVEN, 1000 * serial_uneven);
+    printf("%-8s %-10s %12s %10s %10s %10s\n", "threads", "loop", "ms", "ns / task", "tasks",
+           "stolen");
+    for (int r = 0; r < threads.size(); r++) {
+        set_num_threads(threads[r]);
+        Thread_Pool &pool = thread_pool();
+
+        // A call that wakes every thread for one index each
+        pool.reset_stats();
+        start = Clock::now();
+        for (int c = 0; c < CALLS; c++) {
+            pool.parallel_for(0, pool.size() + 1, 0, [&](int i) { out[i] = i; });
+        }
+        double seconds = seconds_since(start);
+        Scheduler_Stats stats = pool.stats();
+        stats.tasks /= CALLS;
+        stats.steals /= CALLS;
+        print_loop(threads[r], "empty", 1000 * seconds / CALLS, seconds / CALLS, stats);
+
+        int grains[3] = {1, 64, 4096};
+        for (int g = 0; g < 3; g++) {
+            pool.reset_stats();
+            start = Clock::now();
+            pool.parallel_for(0, N, grains[g], [&](int i) { out[i] = sqrt(double(i)); });
+            seconds = seconds_since(start);
+            stats = pool.stats();
+            char name[32];
+            snprintf(name, sizeof(name), "grain %d", grains[g]);
+            print_loop(threads[r], name, 1000 * seconds, seconds - serial_cheap, stats);
+        }
+
+        pool.reset_stats();
+        start = Clock::now();
+        pool.parallel_for(0, UNEVEN, 16, [&](int i) { out[i] = spin(i / 64); });
+        seconds = seconds_since(start);
+        stats = pool.stats();
+        print_loop(threads[r], "uneven", 1000 * seconds, seconds - serial_uneven, stats);
+    }
+
+    // The stages of the program that run on the pool
+    string spec = argv[0];
+    int nu, nv;
+    bool obj_file = spec.find('*') == string::npos &&
+                    sscanf(spec.c_str(), "torus:%dx%d", &nu, &nv) != 2;
+    Bench_Mesh m = load_mesh(spec);
+    Mesh_Topology topo;
+    build_topology(m.hevs, topo);
+    Positions<double> pos;
+    gather_positions(m.hevs, pos);
+
+    printf("\n%s: %d vertices, %d faces, ms per stage\n", argv[0], topo.num_vertices,
+           (int) m.mesh->faces->size());
+    printf("%-8s %10s %10s %10s %10s\n", "threads", "parse", "halfedge", "assembly", "surface");
+    for (int r = 0; r < threads.size(); r++) {
+        set_num_threads(threads[r]);
+        double parse = 0, halfedge = 0, assembly = 0, surface = 0;
+        for (int rep = 0; rep < REPEATS; rep++) {
+            if (obj_file) {
+                Bench_Mesh parsed;
+                parsed.mesh = new Mesh_Data;
+                start = Clock::now();
+                parse_OBJ(parsed.mesh, spec);
+                parse += seconds_since(start);
+                parsed.hevs = new vector<HEV *>();
+                parsed.hefs = new vector<HEF *>();
+                free_mesh(parsed);
+            }
+
+            vector<HEV *> *hevs = new vector<HEV *>();
+            vector<HEF *> *hefs = new vector<HEF *>();
+            start = Clock::now();
+            build_HE(m.mesh, hevs, hefs);
+            halfedge += seconds_since(start);
+            delete_HE(hevs, hefs);
+
+            Smoothing_System<double> system;
+            start = Clock::now();
+            system.assign(topo, pos, 0.0001);
+            Eigen::SparseMatrix<double> A = system.assemble();
+            assembly += seconds_since(start);
+
+            double area, volume;
+            start = Clock::now();
+            measure_surface(topo, pos, area, volume);
+            surface += seconds_since(start);
+        }
+        char parsed[16] = "-";
+        if (obj_file) {
+            snprintf(parsed, sizeof(parsed), "%.2f", 1000 * parse / REPEATS);
+        }
+        printf("%-8d %10s %10.2f %10.2f %10.2f\n", threads[r], parsed,
+               1000 * halfedge / REPEATS, 1000 * assembly / REPEATS, 1000 * surface / REPEATS);
+    }
+    set_num_threads(0);
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* Builds the render buffers of the mesh from its halfedge vertices the way the viewer does:
+ * area-weighted vertex normals, then three vertices and normals per face
+ */
+void build_buffers(Bench_Mesh &m, vector<Vertex> &vertex_buffer, vector<Vec3f> &normal_buffer)
+{
+    const int GRAIN = 1024;
+    thread_pool().parallel_for(1, m.hevs->size(), GRAIN, [&](int i) {
+        HEV *v = m.hevs->at(i);
+        Eigen::Vector3d p(v->x, v->y, v->z), normal(0, 0, 0);
+        HE *he = v->out;
+        do {
+            HEV *b = he->next->vertex, *c = he->next->next->vertex;
+            Eigen::Vector3d face_normal = (Eigen::Vector3d(b->x, b->y, b->z) - p)
+                                              .cross(Eigen::Vector3d(c->x, c->y, c->z) - p);
+            normal += 0.5 * face_normal.norm() * face_normal;
+            he = he->flip->next;
+        }
+        while (he != v->out);
+        normal.normalize();
+        v->normal = {(float) normal.x(), (float) normal.y(), (float) normal.z()};
+    });
+
+    int num_faces = m.mesh->faces->size();
+    vertex_buffer.resize(3 * num_faces);
+    normal_buffer.resize(3 * num_faces);
+    thread_pool().parallel_for(0, num_faces, GRAIN, [&](int f) {
+        int corners[3] = {m.mesh->faces->at(f)->idx1, m.mesh->faces->at(f)->idx2,
+                          m.mesh->faces->at(f)->idx3};
+        for (int c = 0; c < 3; c++) {
+            HEV *v = m.hevs->at(corners[c]);
+            vertex_buffer[3 * f + c] = {(float) v->x, (float) v->y, (float) v->z};
+            normal_buffer[3 * f + c] = v->normal;
+        }
+    });
+}
+
+/* 'pipeline' benchmark:
+ *
+ * Runs generations the way the viewer's frames do with the default options,
+ * each followed by the normals and render buffers of its positions: in
+ * sequence, and pipelined, where the buffers of generation k are built from
+ * the stored positions while generation k + 1 is solved into the smoother's
+ * own, as two tasks on the pool, on 1, 2, 4, ... threads. Reports
+ * generations per second, and checks that both end with the same buffers.
+ */
+int bench_pipeline(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench pipeline mesh [generations=20] [h=0.0001] [threads ...]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 20;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    vector<int> threads;
+    for (int a = 3; a < argc; a++) {
+        threads.push_back(stoi(argv[a]));
+    }
+    if (threads.empty()) {
+        int hardware = max((int) std::thread::hardware_concurrency(), 1);
+        for (int t = 1; t < hardware; t *= 2) {
+            threads.push_back(t);
+        }
+        threads.push_back(hardware);
+    }
+    Bench_Mesh m = load_mesh(argv[0]);
+    vector<Vertex> vertex_buffer;
+    vector<Vec3f> normal_buffer;
+
+    printf("%s: %d vertices, %d generations, h = %g, solver %s\n", argv[0],
+           (int) m.hevs->size() - 1, generations, h,
+           solver_name(default_smoothing_options().solver));
+    printf("%-8s %14s %14s %10s %10s\n", "threads", "serial gen/s", "pipelined gen/s", "speedup",
+           "same");
+    for (int r = 0; r < threads.size(); r++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.threads = threads[r];
+        double seconds[2];
+        vector<Vertex> serial_buffer;
+        for (int pipelined = 0; pipelined < 2; pipelined++) {
+            reset_positions(m);
+            Smoother *smoother = make_smoother(m.hevs, opts);
+            Clock::time_point start = Clock::now();
+            for (int gen = 0; gen < generations; gen++) {
+                if (!pipelined) {
+                    smoother->step(h);
+                    smoother->store(m.hevs);
+                    build_buffers(m, vertex_buffer, normal_buffer);
+                    continue;
+                }
+                thread_pool().parallel_for(0, 2, 1, [&](int task) {
+                    if (task == 0) {
+                        smoother->step(h);
+                    } else if (gen > 0) {
+                        build_buffers(m, vertex_buffer, normal_buffer);
+                    }
+                });
+                smoother->store(m.hevs);
+            }
+            if (pipelined) {
+                build_buffers(m, vertex_buffer, normal_buffer);
+            }
+            seconds[pipelined] = seconds_since(start);
+            delete smoother;
+            if (!pipelined) {
+                serial_buffer = vertex_buffer;
+            }
+        }
+        bool same = memcmp(serial_buffer.data(), vertex_buffer.data(),
+                           vertex_buffer.size() * sizeof(Vertex)) == 0;
+        printf("%-8d %14.2f %14.2f %10.2f %10s\n", threads[r], generations / seconds[0],
+               generations / seconds[1], seconds[0] / seconds[1], same ? "yes" : "no");
+    }
+    set_num_threads(0);
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The p-th percentile (0 to 100) of some values, the largest one for 100
+double percentile(vector<double> values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    int k = min((int) (p / 100 * values.size()), (int) values.size() - 1);
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+/* 'budget' benchmark: anytime smoothing under a frame budget. Every frame
+ * runs PCG iterations of the current generation (and sets up the next one)
+ * until the budget would be exceeded, so the printed percentiles of the frame
+ * times show how well the budget is kept, next to how many generations and
+ * iterations it buys and how far the shown positions trail the same number of
+ * fully solved generations. A budget of 0 finishes one generation per frame.
+ */
+int bench_budget(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench budget mesh [frames=60] [h=0.0001] [budget_ms ...]\n";
+        return 1;
+    }
+    int frames = (argc > 1) ? stoi(argv[1]) : 60;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    vector<double> budgets;
+    for (int a = 3; a < argc; a++) {
+        budgets.push_back(stod(argv[a]));
+    }
+    if (budgets.empty()) {
+        budgets = {0, 4, 8, 16};
+    }
+    Bench_Mesh m = load_mesh(argv[0]);
+    Positions<double> pos, reference;
+    gather_positions(m.hevs, pos);
+    double diagonal = (pos.colwise().maxCoeff() - pos.colwise().minCoeff()).norm();
+
+    printf("%s: %d vertices, %d frames, h = %g\n", argv[0], (int) pos.rows(), frames, h);
+    printf("%-10s %8s %8s %8s %8s %10s %12s %10s %12s\n", "budget ms", "p50", "p90", "p99", "max",
+           "in budget", "generations", "iter/frame", "lag");
+    for (int b = 0; b < budgets.size(); b++) {
+        Smoothing_Options opts = default_smoothing_options();
+        opts.frame_budget = budgets[b];
+        if (opts.frame_budget > 0) {
+            opts.solver = SOLVER_CG;
+        }
+        reset_positions(m);
+        Smoother *smoother = opts.frame_budget > 0 ? make_smoother(m.hevs, opts) : NULL;
+        Anytime_Stepper *anytime = static_cast<Anytime_Stepper *>(smoother);
+        int generations = frames, iterations = 0;
+        vector<double> frame_ms;
+        for (int f = 0; f < frames; f++) {
+            if (anytime) {
+                anytime->step(h);
+                iterations += anytime->last_iterations;
+                continue;
+            }
+            if (!smoother) {
+                smoother = make_smoother(m.hevs, opts);
+            }
+            Clock::time_point start = Clock::now();
+            smoother->step(h);
+            frame_ms.push_back(1000 * seconds_since(start));
+        }
+        if (anytime) {
+            frame_ms = anytime->frame_ms;
+            generations = anytime->generations;
+        }
+        smoother->store(m.hevs);
+        gather_positions(m.hevs, pos);
+        delete smoother;
+
+        // The same number of generations, each solved completely
+        reset_positions(m);
+        opts.frame_budget = 0;
+        smoother = make_smoother(m.hevs, opts);
+        for (int g = 0; g < generations; g++) {
+            smoother->step(h);
+        }
+        smoother->store(m.hevs);
+        gather_positions(m.hevs, reference);
+        delete smoother;
+
+        int kept = 0;
+        for (int f = 0; f < frame_ms.size(); f++) {
+            kept += budgets[b] <= 0 || frame_ms[f] <= budgets[b];
+        }
+        char iters[16];
+        snprintf(iters, sizeof(iters), anytime ? "%.1f" : "-", (double) iterations / frames);
+        printf("%-10g %8.2f %8.2f %8.2f %8.2f %9.0f%% %12d %10s %12.3e\n", budgets[b],
+               percentile(frame_ms, 50), percentile(frame_ms, 90), percentile(frame_ms, 99),
+               percentile(frame_ms, 100), 100.0 * kept / frames, generations, iters,
+               (pos - reference).rowwise().norm().maxCoeff() / diagonal);
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/* 'history' benchmark: the generation history the viewer scrubs through.
+ * Solves some generations once, then pushes them into histories with
+ * keyframes every k generations, and prints the memory per kept generation
+ * and how much less that is than storing every one whole, how many
+ * generations fit into the memory cap, the time of pushing one and of getting a random one back, and the
+ * largest error of the decoded positions relative to the bounding box
+ * diagonal.
+ */
+int bench_history(int argc, char *argv[])
+{
+    if (argc < 1) {
+        cerr << "usage: bench history mesh [generations=100] [h=0.0001] [memory_mb=64] "
+                "[keyframes ...]\n";
+        return 1;
+    }
+    int generations = (argc > 1) ? stoi(argv[1]) : 100;
+    double h = (argc > 2) ? stod(argv[2]) : 0.0001;
+    double memory_mb = (argc > 3) ? stod(argv[3]) : 64;
+    vector<int> intervals;
+    for (int a = 4; a < argc; a++) {
+        intervals.push_back(stoi(argv[a]));
+    }
+    if (intervals.empty()) {
+        intervals = {1, 4, 16, 64};
+    }
+    Bench_Mesh m = load_mesh(argv[0]);
+    vector< Positions<double> > solved(generations + 1);
+    gather_positions(m.hevs, solved[0]);
+    double diagonal = (solved[0].colwise().maxCoeff() - solved[0].colwise().minCoeff()).norm();
+    Smoother *smoother = make_smoother(m.hevs, default_smoothing_options());
+    for (int g = 1; g <= generations; g++) {
+        smoother->step(h);
+        smoother->store(m.hevs);
+        gather_positions(m.hevs, solved[g]);
+    }
+    delete smoother;
+    double whole = solved[0].size() * sizeof(double);
+
+    printf("%s: %d vertices, %d generations, h = %g, %g MB cap\n", argv[0],
+           (int) solved[0].rows(), generations, h, memory_mb);
+    printf("%-10s %12s %10s %8s %10s %10s %12s\n", "keyframes", "KB/gen", "ratio", "kept",
+           "push ms", "get ms", "max error");
+    Positions<double> pos;
+    for (int r = 0; r < intervals.size(); r++) {
+        Generation_History history((size_t) (memory_mb * (1 << 20)), intervals[r],
+                                   1e-6 * diagonal);
+        double push = 0;
+        for (int g = 0; g <= generations; g++) {
+            Clock::time_point start = Clock::now();
+            history.push(solved[g]);
+            push += seconds_since(start);
+        }
+        int kept = history.last() - history.first() + 1;
+        double per_generation = (double) history.memory() / kept;
+
+        // Random generations back, and the error of every kept one
+        const int GETS = 200;
+        Clock::time_point start = Clock::now();
+        for (int k = 0; k < GETS; k++) {
+            history.get(history.first() + rand() % (history.last() - history.first() + 1), pos);
+        }
+        double get = seconds_since(start) / GETS;
+        double error = 0;
+        for (int g = history.first(); g <= history.last(); g++) {
+            history.get(g, pos);
+            error = max(error, (pos - solved[g]).cwiseAbs().maxCoeff() / diagonal);
+        }
+        printf("%-10d %12.1f %10.2f %8d %10.3f %10.3f %12.3e\n", intervals[r],
+               per_generation / 1024, whole / per_generation, kept,
+               1000 * push / (generations + 1), 1000 * get, error);
+    }
+    free_mesh(m);
+    return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Benchmark
+{
+    const char *name;
+    int (*run)(int argc, char *argv[]);
+    const char *description;
+};
+
+Benchmark benchmarks[] = {
+    {"precision", bench_precision, "accuracy vs time of float, double and mixed precision"},
+    {"solvers", bench_solvers, "time, memory, fill and residual of every linear solver backend"},
+    {"orderings", bench_orderings, "fill and factorization time under every fill-reducing ordering"},
+    {"multigrid", bench_multigrid, "scaling of multigrid with the mesh size"},
+    {"gauss_seidel", bench_gauss_seidel, "serial and multicolor Gauss-Seidel sweeps per second by threads"},
+    {"cholesky", bench_cholesky, "supernodal Cholesky by threads vs SimplicialLDLT and SparseLU"},
+    {"explicit", bench_explicit, "explicit substeps vs implicit fairing by time step"},
+    {"taubin", bench_taubin, "volume and time of the Taubin filter vs implicit fairing"},
+    {"spectral", bench_spectral, "eigenbasis computation, cache and jump times of spectral smoothing"},
+    {"bilaplacian", bench_bilaplacian, "nonzeros, fill and factorization time of fourth-order fairing"},
+    {"adaptive", bench_adaptive, "generations and time to a target smoothness, fixed vs adaptive h"},
+    {"idle", bench_idle, "generations until the viewer would pause smoothing, by method"},
+    {"frozen", bench_frozen, "time and error of reusing a factorization for many generations"},
+    {"incremental", bench_incremental, "assembly time of recomputing only the rows around moved vertices"},
+    {"roi", bench_roi, "time of smoothing only the rings around a vertex against the whole mesh"},
+    {"pinned", bench_pinned, "pinned vertices eliminated from the system against penalty pinning"},
+    {"components", bench_components, "one system per connected component, solved in parallel"},
+    {"objects", bench_objects, "time per frame of smoothing many objects one by one vs as tasks"},
+    {"batch", bench_batch, "meshes per second of many small meshes in block-diagonal batches"},
+    {"scheduler", bench_scheduler, "task overhead and steals of the pool, and the stages on it"},
+    {"pipeline", bench_pipeline, "generations per second with buffers built while the next solves"},
+    {"budget", bench_budget, "frame time percentiles of anytime smoothing under a budget"},
+    {"history", bench_history, "memory, access time and error of the generation history"},
+};
+
+int main(int argc, char *argv[])
+{
+    int num_benchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    for (int i = 0; argc > 1 && i < num_benchmarks; i++) {
+        if (strcmp(argv[1], benchmarks[i].name) == 0) {
+            return benchmarks[i].run(argc - 2, argv + 2);
+        }
+    }
+
+    cerr << "usage: bench benchmark [arguments]\nbenchmarks:\n";
+    for (int i = 0; i < num_benchmarks; i++) {
+        cerr << "\t" << benchmarks[i].name << " - " << benchmarks[i].description << "\n";
+    }
+    return 1;
+}
@@ -0,0 +1,174 @@
+/* This header file contains the system of fourth-order implicit fairing,
+ *
+ *     (I + hΔ²) x_h = x_0,    Δ = M^-1 L
+ *
+ * which flows by the bi-Laplacian and so keeps features that the
+ * second-order flow of laplacian.h rounds off. Like there, every row is
+ * multiplied by its mass to get a symmetric matrix,
+ *
+ *     (M + h L M^-1 L) x_h = M x_0,
+ *
+ * and since L is symmetric, L M^-1 L = K M^-1 K with the stiffness K = -L.
+ * The matrix is formed as a sparse product. K is assembled once per mesh
+ * with an entry for every halfedge slot, and later generations only
+ * overwrite its values, so K, the product and therefore the symbolic
+ * analysis of the factorization all keep the same pattern. The product
+ * couples every vertex to its 2-ring, so it has several times the nonzeros
+ * of M - hL and fills in much more; the bilaplacian benchmark reports both.
+ *
+ * Vertices of degenerate regions are held in place, as in laplacian.h: M^-1
+ * is zero for them inside the product, and their rows and columns of the
+ * result become the identity, with what their neighbors coupled to them
+ * moved to the right-hand side.
+ */
+
+#ifndef BILAPLACIAN_H
+#define BILAPLACIAN_H
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "laplacian.h"
+
+template <typename Scalar>
+struct Bilaplacian_System
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+    const Mesh_Topology *topo;
+    // K, and the index in its values of every halfedge slot and diagonal
+    Eigen::SparseMatrix<Scalar> stiffness;
+    std::vector<int> slot_index, diagonal_index;
+    // Lumped mass 2A_i, and whether the vertex is held in place
+    Vector mass;
+    std::vector<char> fixed;
+    Scalar h;
+    // M + h K M^-1 K with the held vertices eliminated
+    Eigen::SparseMatrix<Scalar> matrix;
+
+    Bilaplacian_System() : topo(NULL) {}
+
+    // Recomputes K, the masses and the matrix for the given positions
+    void assign(const Mesh_Topology &topology, const Positions<Scalar> &pos, Scalar time_step)
+    {
+        if (topo != &topology) {
+            topo = &topology;
+            build_pattern();
+        }
+        h = time_step;
+
+        std::vector<Scalar> weights, areas;
+        compute_cot_weights(topology, pos, weights, areas);
+
+        int num_vertices = topology.num_vertices;
+        mass.resize(num_vertices);
+        fixed.resize(num_vertices);
+        Vector inverse_mass(num_vertices);
+        Scalar *values = stiffness.valuePtr();
+        for (int i = 0; i < num_vertices; i++) {
+            fixed[i] = degenerate_area(areas[i]);
+            mass(i) = fixed[i] ? Scalar(1) : 2 * areas[i];
+            inverse_mass(i) = fixed[i] ? Scalar(0) : 1 / mass(i);
+
+            values[diagonal_index[i]] = 0;
+            for (int k = topology.out_start[i]; k < topology.out_start[i + 1]; k++) {
+                values[slot_index[k]] = -weights[k];
+                values[diagonal_index[i]] += weights[k];
+            }
+        }
+
+        Eigen::SparseMatrix<Scalar> scaled = inverse_mass.asDiagonal() * stiffness;
+        matrix = stiffness * scaled;
+        matrix *= h;
+        for (int i = 0; i < num_vertices; i++) {
+            matrix.coeffRef(i, i) += mass(i);
+        }
+        eliminate_fixed();
+    }
+
+    // Y = A X with the assembled matrix
+    void apply(const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        Y = matrix * X;
+    }
+
+    // Right-hand side M X plus the terms moved over from held vertices
+    void rhs(const Positions<Scalar> &X, Positions<Scalar> &B) const
+    {
+        B = mass.asDiagonal() * X;
+        for (int e = 0; e < moved.size(); e++) {
+            B.row(moved[e].row()) -= moved[e].value() * X.row(moved[e].col());
+        }
+    }
+
+    const Eigen::SparseMatrix<Scalar> &assemble() const
+    {
+        return matrix;
+    }
+
+private:
+    // K with an entry for every halfedge slot and the diagonal
+    void build_pattern()
+    {
+        int num_vertices = topo->num_vertices;
+        stiffness.resize(num_vertices, num_vertices);
+        Eigen::VectorXi nonzeros(num_vertices);
+        for (int i = 0; i < num_vertices; i++) {
+            nonzeros(i) = topo->out_start[i + 1] - topo->out_start[i] + 1;
+        }
+        stiffness.setZero();
+        stiffness.reserve(nonzeros);
+        for (int i = 0; i < num_vertices; i++) {
+            for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+                stiffness.insert(topo->he_to[k], i) = 1;
+            }
+            stiffness.insert(i, i) = 1;
+        }
+        stiffness.makeCompressed();
+
+        // Slot k of vertex i is the entry of row he_to[k] in column i
+        slot_index.resize(topo->he_to.size());
+        diagonal_index.resize(num_vertices);
+        const int *outer = stiffness.outerIndexPtr();
+        const int *inner = stiffness.innerIndexPtr();
+        for (int i = 0; i < num_vertices; i++) {
+            for (int p = outer[i]; p < outer[i + 1]; p++) {
+                if (inner[p] == i) {
+                    diagonal_index[i] = p;
+                }
+            }
+            for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+                slot_index[k] = std::lower_bound(inner + outer[i], inner + outer[i + 1],
+                                                 topo->he_to[k]) - inner;
+            }
+        }
+    }
+
+    /* Turns the rows and columns of held vertices into the identity without
+     * removing entries, so the pattern stays the same, and remembers the
+     * couplings of free rows to held columns for rhs.
+     */
+    void eliminate_fixed()
+    {
+        moved.clear();
+        for (int j = 0; j < matrix.outerSize(); j++) {
+            for (typename Eigen::SparseMatrix<Scalar>::InnerIterator it(matrix, j); it; ++it) {
+                int i = it.row();
+                if (!fixed[i] && !fixed[j]) {
+                    continue;
+                }
+                if (!fixed[i] && it.value() != 0) {
+                    moved.push_back(Eigen::Triplet<Scalar>(i, j, it.value()));
+                }
+                it.valueRef() = (i == j) ? Scalar(1) : Scalar(0);
+            }
+        }
+    }
+
+    std::vector< Eigen::Triplet<Scalar> > moved;
+};
+
+#endif
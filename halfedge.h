@@ -115,12 +115,12 @@
 
 #include <algorithm>
 #include <cassert>
-#include <map>
 #include <iostream>
 #include <utility>
 #include <vector>
 
 #include "structs.h"
+#include "parallel.h"
 
 /* Halfedge structs */
 
@@ -166,15 +166,13 @@ struct HEV // HEV for halfedge vertex
 /* Function prototypes */
 
 static std::pair<int, int> get_edge_key(int x, int y);
-static void hash_edge(std::map<std::pair<int, int>, HE*> &edge_hash,
-                      std::pair<int, int> edge_key,
-                      HE *edge);
+static void match_flips(int num_vertices, const std::vector<HEF*> &faces, int first_face);
 
 static bool check_flip(HE *edge);
 static bool check_edge(HE *edge);
 static bool check_face(HEF *face);
 
-static bool orient_flip_face(HE *edge);
+static bool orient_flip_face(HE *edge, std::vector<HEF*> &pending);
 static bool orient_face(HEF *face);
 
 static bool build_HE(Mesh_Data *mesh,
@@ -191,18 +189,54 @@ static std::pair<int, int> get_edge_key(int x, int y)
     return std::pair<int, int>(std::min(x, y), std::max(x, y));
 }
 
-static void hash_edge(std::map<std::pair<int, int>, HE*> &edge_hash,
-                     std::pair<int, int> edge_key,
-                     HE *edge)
+/* Pairs up the halfedges of the given faces that share an edge. Every
+ * halfedge is bucketed under the lower vertex of its edge, in face order, so
+ * the buckets are matched in parallel without sharing anything. The first
+ * halfedge of an edge is the flip of every later one, and the last of those
+ * is its flip.
+ */
+static void match_flips(int num_vertices, const std::vector<HEF*> &faces, int first_face)
 {
-    if(edge_hash.count(edge_key) != 0)
+    // Bucket of every lower vertex, and per entry the halfedge and its upper vertex
+    std::vector<int> bucket_start(num_vertices + 2, 0);
+    for (int i = first_face; i < faces.size(); ++i)
     {
-        HE *flip = edge_hash[edge_key];
-        flip->flip = edge;
-        edge->flip = flip;
+        HE *he = faces[i]->edge;
+        for (int e = 0; e < 3; ++e, he = he->next)
+            bucket_start[get_edge_key(he->vertex->index, he->next->vertex->index).first + 1]++;
     }
-    else
-        edge_hash[edge_key] = edge;
+    for (int v = 0; v <= num_vertices; ++v)
+        bucket_start[v + 1] += bucket_start[v];
+
+    std::vector<int> fill(bucket_start.begin(), bucket_start.end() - 1);
+    std::vector<HE*> bucket(bucket_start[num_vertices + 1]);
+    std::vector<int> upper(bucket.size());
+    for (int i = first_face; i < faces.size(); ++i)
+    {
+        HE *he = faces[i]->edge;
+        for (int e = 0; e < 3; ++e, he = he->next)
+        {
+            std::pair<int, int> key = get_edge_key(he->vertex->index, he->next->vertex->index);
+            upper[fill[key.first]] = key.second;
+            bucket[fill[key.first]++] = he;
+        }
+    }
+
+    const int GRAIN = 1024;
+    thread_pool().parallel_for(0, num_vertices + 1, GRAIN, [&](int v) {
+        for (int k = bucket_start[v]; k < bucket_start[v + 1]; ++k)
+        {
+            for (int first = bucket_start[v]; first < k; ++first)
+            {
+                if (upper[first] == upper[k])
+                {
+                    bucket[first]->flip = bucket[k];
+                    bucket[k]->flip = bucket[first];
+                    break;
+                }
+            }
+        }
+    });
 }
 
 static bool check_flip(HE *edge)
@@ -229,7 +263,7 @@ static bool check_face(HEF *face)
     return b1 && b2 && b3;
 }
 
-static bool orient_flip_face(HE *edge)
+static bool orient_flip_face(HE *edge, std::vector<HEF*> &pending)
 {
     if(edge->flip == NULL)
         return 1;
@@ -277,16 +311,28 @@ static bool orient_flip_face(HE *edge)
     assert(check_flip(edge));
     assert(check_face(face));
 
-    return check_face(face) && orient_face(face);
+    pending.push_back(face);
+    return check_face(face);
 }
 
 static bool orient_face(HEF *face)
 {
     assert(face->oriented);
-    return orient_flip_face(face->edge)
-           && orient_flip_face(face->edge->next)
-           && orient_flip_face(face->edge->next->next)
-           && check_face(face);
+
+    std::vector<HEF*> pending(1, face);
+    while(!pending.empty())
+    {
+        face = pending.back();
+        pending.pop_back();
+
+        if(!orient_flip_face(face->edge, pending)
+           || !orient_flip_face(face->edge->next, pending)
+           || !orient_flip_face(face->edge->next->next, pending)
+           || !check_face(face))
+            return 0;
+    }
+
+    return 1;
 }
 
 static bool build_HE(Mesh_Data *mesh,
@@ -296,27 +342,28 @@ static bool build_HE(Mesh_Data *mesh,
     std::vector<Vertex*> *vertices = mesh->vertices;
     std::vector<Face*> *faces = mesh->faces;
 
-    hevs->push_back(NULL);
-    std::map<std::pair<int, int>, HE*> edge_hash;
+    // Vertices and faces per task of the shared pool
+    const int GRAIN = 1024;
 
     int size_vertices = vertices->size();
+    hevs->assign(size_vertices, NULL);
 
-    for(int i = 1; i < size_vertices; ++i)
-    {
+    thread_pool().parallel_for(1, size_vertices, GRAIN, [&](int i) {
         HEV *hev = new HEV;
         hev->x = vertices->at(i)->x;
         hev->y = vertices->at(i)->y;
         hev->z = vertices->at(i)->z;
         hev->out = NULL;
+        hev->index = i;
 
-        hevs->push_back(hev);
-    }
+        hevs->at(i) = hev;
+    });
 
-    HEF *first_face = NULL;
+    int first_face = hefs->size();
     int num_faces = faces->size();
+    hefs->resize(first_face + num_faces);
     
-    for (int i = 0; i < num_faces; ++i)
-    {
+    thread_pool().parallel_for(0, num_faces, GRAIN, [&](int i) {
         Face *f = faces->at(i);
 
         HE *e1 = new HE;
@@ -344,24 +391,32 @@ static bool build_HE(Mesh_Data *mesh,
         e2->vertex = hevs->at(f->idx2);
         e3->vertex = hevs->at(f->idx3);
 
-        hevs->at(f->idx1)->out = e1;
-        hevs->at(f->idx2)->out = e2;
-        hevs->at(f->idx3)->out = e3;
+        hefs->at(first_face + i) = hef;
+    });
 
-        hash_edge(edge_hash, get_edge_key(f->idx1, f->idx2), e1);
-        hash_edge(edge_hash, get_edge_key(f->idx2, f->idx3), e2);
-        hash_edge(edge_hash, get_edge_key(f->idx3, f->idx1), e3);
+    // The last face around a vertex gives it its outgoing halfedge
+    for (int i = first_face; i < hefs->size(); ++i)
+    {
+        HE *he = hefs->at(i)->edge;
+        he->vertex->out = he;
+        he->next->vertex->out = he->next;
+        he->next->next->vertex->out = he->next->next;
+    }
 
-        hefs->push_back(hef);
+    match_flips(size_vertices - 1, *hefs, first_face);
 
-        if(first_face == NULL)
-        {
-            first_face = hef;
-            first_face->oriented = 1;
-        }
+    for (int i = first_face; i < hefs->size(); ++i)
+    {
+        HEF *hef = hefs->at(i);
+        if(hef->oriented)
+            continue;
+
+        hef->oriented = 1;
+        if(!orient_face(hef))
+            return 0;
     }
 
-    return orient_face(first_face);
+    return 1;
 }
 
 static void delete_HE(std::vector<HEV*> *hevs, std::vector<HEF*> *hefs)
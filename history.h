@@ -0,0 +1,195 @@
+/* This header file contains the history of smoothing generations the viewer
+ * keeps, so that it can scrub back through them without solving them again.
+ * It only depends on Eigen and laplacian.h.
+ *
+ * Generation_History is a ring of the positions of the last generations,
+ * numbered consecutively. Every keyframe_interval-th generation is a
+ * keyframe stored whole, in double precision. The generations in between
+ * store only their difference to that keyframe, quantized to 16 bits per
+ * coordinate between the smallest and largest difference of each axis,
+ *
+ *     x_g = x_key + lo + q * scale,    scale = (hi - lo) / 65535
+ *
+ * so they take a quarter of a keyframe, and a coordinate is off by at most
+ * scale / 2. Every difference is to its keyframe rather than to the
+ * generation before, so getting any generation decodes one keyframe and at
+ * most one difference however long the history is, and errors do not add
+ * up along it. A difference whose scale / 2 would exceed tolerance, because
+ * the mesh moved too far since the keyframe, starts a new keyframe instead.
+ *
+ * Once the history takes more than max_bytes, it drops its oldest
+ * generations one at a time. The generations share their keyframe, which
+ * stays until the last generation stored relative to it is dropped, so the
+ * cap is kept to within one difference. The newest generation is always
+ * kept.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "laplacian.h"
+
+class Generation_History
+{
+public:
+    Generation_History(size_t max_bytes = 64 << 20, int keyframe_interval = 16,
+                       double tolerance = HUGE_VAL)
+        : max_bytes(max_bytes), keyframe_interval(keyframe_interval), tolerance(tolerance),
+          first_generation(0), total_bytes(0), keyframes(0), since_keyframe(0)
+    {
+        if (keyframe_interval < 1) {
+            throw std::invalid_argument("keyframe_interval must be positive");
+        }
+    }
+
+    /* Appends the positions of the next generation, which is numbered last()
+     * + 1, and drops the oldest generations that no longer fit. Positions of
+     * a different number of vertices start the history over.
+     */
+    void push(const Positions<double> &pos)
+    {
+        if (!entries.empty() && pos.rows() != entries.back().key->rows()) {
+            clear(next());
+        }
+
+        Entry entry;
+        if (!entries.empty() && since_keyframe + 1 < keyframe_interval &&
+                quantize(pos, *entries.back().key, entry)) {
+            entry.key = entries.back().key;
+            since_keyframe++;
+        } else {
+            entry.key = std::make_shared<const Positions<double> >(pos);
+            total_bytes += key_bytes(*entry.key);
+            keyframes++;
+            since_keyframe = 0;
+        }
+        total_bytes += bytes(entry);
+        entries.push_back(std::move(entry));
+
+        while (total_bytes > max_bytes && entries.size() > 1) {
+            Entry &oldest = entries.front();
+            total_bytes -= bytes(oldest);
+            if (oldest.key.use_count() == 1) {
+                total_bytes -= key_bytes(*oldest.key);
+                keyframes--;
+            }
+            entries.pop_front();
+            first_generation++;
+        }
+    }
+
+    /* Decodes the positions of a generation from first() to last() into pos,
+     * returning false if it is not in the history
+     */
+    bool get(int generation, Positions<double> &pos) const
+    {
+        if (generation < first() || generation > last()) {
+            return false;
+        }
+        const Entry &entry = entries[generation - first_generation];
+        const Positions<double> &key = *entry.key;
+        if (entry.q.empty()) {
+            pos = key;
+            return true;
+        }
+        pos.resize(key.rows(), 3);
+        for (int i = 0; i < key.rows(); i++) {
+            for (int c = 0; c < 3; c++) {
+                pos(i, c) = key(i, c) + entry.lo[c] + entry.scale[c] * entry.q[3 * i + c];
+            }
+        }
+        return true;
+    }
+
+    // Drops every generation; the next one pushed is numbered generation
+    void clear(int generation = 0)
+    {
+        entries.clear();
+        first_generation = generation;
+        total_bytes = 0;
+        keyframes = 0;
+        since_keyframe = 0;
+    }
+
+    // Numbers of the oldest and newest generation kept (last() < first() if
+    // there are none), and the number the next one pushed will get
+    int first() const { return first_generation; }
+    int last() const { return first_generation + (int) entries.size() - 1; }
+    int next() const { return last() + 1; }
+    bool empty() const { return entries.empty(); }
+
+    // Memory the kept generations and their keyframes take, and how many
+    // keyframes there are
+    size_t memory() const { return total_bytes; }
+    int num_keyframes() const { return keyframes; }
+
+private:
+    struct Entry
+    {
+        // The keyframe, and the quantized differences to it (row-major, empty
+        // for the keyframe itself) and their offset and step per axis
+        std::shared_ptr<const Positions<double> > key;
+        std::vector<uint16_t> q;
+        double lo[3], scale[3];
+    };
+
+    static size_t bytes(const Entry &entry)
+    {
+        return sizeof(Entry) + entry.q.capacity() * sizeof(uint16_t);
+    }
+
+    static size_t key_bytes(const Positions<double> &key)
+    {
+        return key.size() * sizeof(double);
+    }
+
+    // Quantizes pos - key into entry, or returns false if its error would
+    // exceed tolerance
+    bool quantize(const Positions<double> &pos, const Positions<double> &key, Entry &entry) const
+    {
+        const int LEVELS = 65535;
+        for (int c = 0; c < 3; c++) {
+            double lo = (pos.col(c) - key.col(c)).minCoeff();
+            double hi = (pos.col(c) - key.col(c)).maxCoeff();
+            if (!std::isfinite(hi - lo) || (hi - lo) / LEVELS / 2 > tolerance) {
+                return false;
+            }
+            entry.lo[c] = lo;
+            entry.scale[c] = (hi - lo) / LEVELS;
+        }
+        int n = pos.rows();
+        entry.q.resize(3 * n);
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < 3; c++) {
+                double d = pos(i, c) - key(i, c) - entry.lo[c];
+                entry.q[3 * i + c] = (entry.scale[c] > 0) ? (uint16_t) std::lround(d / entry.scale[c])
+                                                          : 0;
+            }
+        }
+        return true;
+    }
+
+    size_t max_bytes;
+    int keyframe_interval;
+    double tolerance;
+    // The kept generations oldest first, the number of the oldest one, the
+    // memory they and their keyframes take, the number of keyframes, and the
+    // generations since the newest keyframe
+    std::deque<Entry> entries;
+    int first_generation;
+    size_t total_bytes;
+    int keyframes;
+    int since_keyframe;
+};
+
+#endif
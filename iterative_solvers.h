@@ -0,0 +1,353 @@
+/* This header file contains the iterative solvers used for the implicit
+ * fairing system when it is too large to factorize.
+ *
+ * Everything here works on blocks of right-hand sides at once (one column per
+ * coordinate, so an (n x 3) Eigen matrix for our meshes) and only needs the
+ * system matrix through an Operator, which is any type with
+ *
+ *     void apply(const Block &X, Block &Y) const;    // Y = A X
+ *
+ * so the matrix never has to be assembled. The preconditioners have the
+ * same shape:
+ *
+ *     void apply(const Block &R, Block &Z) const;    // Z ~= A^-1 R
+ *
+ * The main function of interest is pcg_solve, a preconditioned conjugate
+ * gradient that uses the initial contents of X as its warm start. Its state
+ * between iterations is a PCG_State, so a solve can also be run a few
+ * iterations at a time, as anytime smoothing does.
+ * lanczos_bounds estimates the extreme eigenvalues of a Jacobi-scaled
+ * operator, which Chebyshev iteration needs in place of CG's dot products.
+ */
+
+#ifndef ITERATIVE_SOLVERS_H
+#define ITERATIVE_SOLVERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+/* Convergence information of the last solve */
+struct Solve_Stats
+{
+    int iterations;
+    // Largest relative residual ||b - Ax|| / ||b|| over the columns
+    double residual;
+};
+
+/* Preconditioners */
+
+struct Identity_Preconditioner
+{
+    template <typename Block>
+    void apply(const Block &R, Block &Z) const
+    {
+        Z = R;
+    }
+};
+
+/* Scales every row by the inverse of the matrix diagonal. */
+template <typename Scalar>
+struct Jacobi_Preconditioner
+{
+    Eigen::Matrix<Scalar, Eigen::Dynamic, 1> inv_diagonal;
+
+    void compute(const Eigen::Matrix<Scalar, Eigen::Dynamic, 1> &diagonal)
+    {
+        inv_diagonal = diagonal.cwiseInverse();
+    }
+
+    template <typename Block>
+    void apply(const Block &R, Block &Z) const
+    {
+        Z = inv_diagonal.asDiagonal() * R;
+    }
+};
+
+/* Zero fill-in incomplete Cholesky factorization A ~= L L^T, where L has
+ * exactly the pattern of the lower triangle of A. The factor is kept in the
+ * preconditioner's own Scalar, which may be lower than the solver's.
+ *
+ * IC(0) can break down on matrices that are not diagonally dominant (the
+ * cotangent Laplacian of a mesh with obtuse triangles is not). When it does,
+ * the factorization is retried on A + shift * |diag(A)| with a growing
+ * shift. If even that fails, the matrix is too far from positive definite
+ * for an incomplete factorization and only sqrt(|diag(A)|) is kept, which
+ * makes the preconditioner a Jacobi one.
+ */
+template <typename Scalar>
+class IC0_Preconditioner
+{
+public:
+    // Factorizes the lower triangle (diagonal included) of a symmetric matrix
+    template <typename MatrixScalar>
+    bool compute(const Eigen::SparseMatrix<MatrixScalar, Eigen::RowMajor> &lower)
+    {
+        n = lower.rows();
+        row_start.assign(lower.outerIndexPtr(), lower.outerIndexPtr() + n + 1);
+        cols.assign(lower.innerIndexPtr(), lower.innerIndexPtr() + lower.nonZeros());
+        std::vector<Scalar> values(lower.valuePtr(), lower.valuePtr() + lower.nonZeros());
+
+        for (shift = 0; shift <= 1; shift = (shift == 0) ? 1e-3 : shift * 10) {
+            if (factorize(values)) {
+                return true;
+            }
+        }
+
+        for (int i = 0; i < n; i++) {
+            for (int p = row_start[i]; p < row_start[i + 1] - 1; p++) {
+                factor[p] = 0;
+            }
+            int diag = row_start[i + 1] - 1;
+            factor[diag] = std::sqrt(std::max(std::abs(values[diag]), Scalar(1e-30)));
+        }
+        return false;
+    }
+
+    template <typename Block>
+    void apply(const Block &R, Block &Z) const
+    {
+        typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> FactorBlock;
+        FactorBlock y = R.template cast<Scalar>();
+        int num_cols = y.cols();
+
+        // Forward substitution L y = r
+        for (int i = 0; i < n; i++) {
+            int diag = row_start[i + 1] - 1;
+            for (int p = row_start[i]; p < diag; p++) {
+                for (int c = 0; c < num_cols; c++) {
+                    y(i, c) -= factor[p] * y(cols[p], c);
+                }
+            }
+            for (int c = 0; c < num_cols; c++) {
+                y(i, c) /= factor[diag];
+            }
+        }
+
+        // Backward substitution L^T z = y, scattering along the rows of L
+        for (int i = n - 1; i >= 0; i--) {
+            int diag = row_start[i + 1] - 1;
+            for (int c = 0; c < num_cols; c++) {
+                y(i, c) /= factor[diag];
+            }
+            for (int p = row_start[i]; p < diag; p++) {
+                for (int c = 0; c < num_cols; c++) {
+                    y(cols[p], c) -= factor[p] * y(i, c);
+                }
+            }
+        }
+
+        Z = y.template cast<typename Block::Scalar>();
+    }
+
+    long nonzeros() const { return factor.size(); }
+
+    // Diagonal shift the last successful factorization needed
+    double shift;
+
+private:
+    bool factorize(const std::vector<Scalar> &values)
+    {
+        factor.resize(values.size());
+        for (int i = 0; i < n; i++) {
+            for (int p = row_start[i]; p < row_start[i + 1]; p++) {
+                int k = cols[p];
+
+                // Sparse dot product of rows i and k of L over columns < k
+                Scalar s = values[p];
+                int a = row_start[i], b = row_start[k];
+                int a_end = p, b_end = row_start[k + 1] - 1;
+                while (a < a_end && b < b_end) {
+                    if (cols[a] < cols[b])
+                        a++;
+                    else if (cols[a] > cols[b])
+                        b++;
+                    else
+                        s -= factor[a++] * factor[b++];
+                }
+
+                if (k < i) {
+                    factor[p] = s / factor[row_start[k + 1] - 1];
+                    continue;
+                }
+
+                s += shift * std::abs(values[p]);
+                if (!(s > 0)) {
+                    return false;
+                }
+                factor[p] = std::sqrt(s);
+            }
+        }
+        return true;
+    }
+
+    int n;
+    std::vector<int> row_start, cols;
+    std::vector<Scalar> factor;
+};
+
+/* Solvers */
+
+/* The state of a preconditioned conjugate gradient solve between
+ * iterations: start sets it up for the system A X = B from the initial guess
+ * in X, and every iterate call moves X one iteration closer, so a solve can
+ * be stopped after any iteration and resumed later with the same A, P and B.
+ */
+template <typename Block>
+struct PCG_State
+{
+    typedef typename Block::Scalar Scalar;
+    typedef Eigen::Array<Scalar, 1, Eigen::Dynamic> Row;
+
+    Block R, Z, D, Q;
+    Row rz, b_norm, residual;
+    int iterations;
+
+    template <typename Operator, typename Preconditioner>
+    void start(const Operator &A, const Preconditioner &P, const Block &B, const Block &X)
+    {
+        A.apply(X, Q);
+        R = B - Q;
+        P.apply(R, Z);
+        D = Z;
+
+        rz = (R.array() * Z.array()).colwise().sum();
+        b_norm = B.colwise().norm().array().max(Scalar(1e-30));
+        residual = R.colwise().norm().array() / b_norm;
+        iterations = 0;
+    }
+
+    // Whether every column's relative residual is below tol
+    bool converged(double tol) const
+    {
+        return (residual <= Scalar(tol)).all();
+    }
+
+    // One iteration; a column stops changing once its residual is below tol
+    template <typename Operator, typename Preconditioner>
+    void iterate(const Operator &A, const Preconditioner &P, Block &X, double tol)
+    {
+        A.apply(D, Q);
+        Row dq = (D.array() * Q.array()).colwise().sum();
+        Row alpha = (residual > Scalar(tol)).select(rz / dq, Scalar(0));
+        X += D * alpha.matrix().asDiagonal();
+        R -= Q * alpha.matrix().asDiagonal();
+
+        P.apply(R, Z);
+        Row rz_next = (R.array() * Z.array()).colwise().sum();
+        Row beta = (residual > Scalar(tol)).select(rz_next / rz, Scalar(0));
+        D = Z + D * beta.matrix().asDiagonal();
+        rz = rz_next;
+        residual = R.colwise().norm().array() / b_norm;
+        iterations++;
+    }
+
+    Solve_Stats stats() const
+    {
+        Solve_Stats current;
+        current.iterations = iterations;
+        current.residual = residual.maxCoeff();
+        return current;
+    }
+};
+
+/* Preconditioned conjugate gradient for a symmetric positive definite A,
+ * run on all columns of B in lockstep. X holds the initial guess on entry
+ * and the solution on exit. A column stops changing once its relative
+ * residual drops below tol.
+ */
+template <typename Operator, typename Preconditioner, typename Block>
+static Solve_Stats pcg_solve(const Operator &A,
+                             const Preconditioner &P,
+                             const Block &B,
+                             Block &X,
+                             double tol,
+                             int max_iterations)
+{
+    PCG_State<Block> state;
+    state.start(A, P, B, X);
+    while (state.iterations < max_iterations && !state.converged(tol)) {
+        state.iterate(A, P, X, tol);
+    }
+    return state.stats();
+}
+
+/* Estimates the smallest and largest eigenvalues of D^-1 A, for a symmetric
+ * positive definite A and its positive diagonal D, with a few steps of the
+ * Lanczos iteration on the similar matrix D^-1/2 A D^-1/2. The iteration
+ * runs on a Block (the type A applies to), every column of which starts from
+ * its own fixed pseudo-random vector; the returned bounds cover the Ritz
+ * values of all columns.
+ *
+ * Ritz values lie inside the spectrum. The largest one is raised by the
+ * last off-diagonal of the Lanczos matrix, which bounds how far it can be
+ * from an eigenvalue, so the upper bound is safe; the lower one may still
+ * be too high. Without reorthogonalization only the extreme values can be
+ * trusted, which is all this is used for.
+ */
+template <typename Block, typename Operator>
+static void lanczos_bounds(const Operator &A,
+                           const Eigen::Matrix<typename Block::Scalar, Eigen::Dynamic, 1> &diagonal,
+                           int steps,
+                           double &lower,
+                           double &upper)
+{
+    typedef typename Block::Scalar Scalar;
+    typedef Eigen::Array<Scalar, 1, Eigen::Dynamic> Row;
+    int n = diagonal.size();
+    int num_cols = (Block::ColsAtCompileTime == Eigen::Dynamic) ? 1 : Block::ColsAtCompileTime;
+    Block V(n, num_cols);
+    steps = std::max(std::min(steps, n), 1);
+    Eigen::Matrix<Scalar, Eigen::Dynamic, 1> inv_sqrt = diagonal.cwiseSqrt().cwiseInverse();
+
+    // Deterministic start vectors from a linear congruential generator
+    unsigned int seed = 12345;
+    for (int c = 0; c < num_cols; c++) {
+        for (int i = 0; i < n; i++) {
+            seed = seed * 1103515245u + 12345u;
+            V(i, c) = Scalar((seed >> 16) & 0x7fff) / 0x7fff - Scalar(0.5);
+        }
+    }
+    Row norm = V.colwise().norm().array().max(Scalar(1e-30));
+    V = V * norm.inverse().matrix().asDiagonal();
+
+    Eigen::MatrixXd alpha(steps, num_cols), beta = Eigen::MatrixXd::Zero(steps, num_cols);
+    Block V_prev = Block::Zero(n, num_cols), W, AW;
+    for (int j = 0; j < steps; j++) {
+        W = inv_sqrt.asDiagonal() * V;
+        A.apply(W, AW);
+        W = inv_sqrt.asDiagonal() * AW;
+
+        Row a = (V.array() * W.array()).colwise().sum();
+        W -= V * a.matrix().asDiagonal();
+        if (j > 0) {
+            W -= V_prev * beta.row(j - 1).template cast<Scalar>().asDiagonal();
+        }
+        Row b = W.colwise().norm().array();
+        alpha.row(j) = a.template cast<double>();
+        beta.row(j) = b.template cast<double>();
+
+        V_prev = V;
+        V = W * (b.max(Scalar(1e-30)).inverse()).matrix().asDiagonal();
+    }
+
+    lower = HUGE_VAL;
+    upper = 0;
+    for (int c = 0; c < num_cols; c++) {
+        Eigen::MatrixXd T = Eigen::MatrixXd::Zero(steps, steps);
+        for (int j = 0; j < steps; j++) {
+            T(j, j) = alpha(j, c);
+            if (j + 1 < steps) {
+                T(j, j + 1) = T(j + 1, j) = beta(j, c);
+            }
+        }
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> ritz(T, Eigen::EigenvaluesOnly);
+        lower = std::min(lower, ritz.eigenvalues().minCoeff());
+        upper = std::max(upper, ritz.eigenvalues().maxCoeff() + beta(steps - 1, c));
+    }
+}
+
+#endif
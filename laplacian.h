@@ -0,0 +1,507 @@
+/* This header file contains the discrete cotangent Laplacian that the
+ * implicit fairing is built on, together with the flat mesh data it needs.
+ * It only depends on Eigen and the halfedge.
+ *
+ * The pieces are:
+ *
+ *     Mesh_Topology is a flat, 0-indexed copy of the halfedge connectivity.
+ *      Every vertex i owns the slots [out_start[i], out_start[i + 1]) which
+ *      are its outgoing halfedges in the same order the halfedge loop
+ *      he = he->flip->next visits them. It is built once per mesh.
+ *
+ *     Positions<Scalar> is an (n x 3) Eigen matrix of vertex positions. The
+ *      whole pipeline (positions, cotangent weights, system and solver) is
+ *      templated on its Scalar type.
+ *
+ *     Smoothing_System<Scalar> is the system every generation solves,
+ *
+ *         (M - hL) x_h = M x_0,    M = diag(2A_i),  L_ij = cot α_j + cot β_j,
+ *
+ *      which is F = (I - hΔ) from the notes with every row multiplied by its
+ *      2A, so that the matrix is symmetric. It only stores the per-halfedge
+ *      cotangent weights and the lumped mass; it can be applied matrix-free
+ *      or assembled for the factorizing solvers.
+ *
+ * The weights, the rows of the system and the assembled columns are all
+ * computed vertex by vertex on the shared pool of parallel.h, every vertex
+ * only writing its own slots.
+ */
+
+#ifndef LAPLACIAN_H
+#define LAPLACIAN_H
+
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "structs.h"
+#include "halfedge.h"
+#include "parallel.h"
+
+/* Mesh data shared by all smoothers */
+
+struct Mesh_Topology
+{
+    int num_vertices;
+    // Slot range of the outgoing halfedges of every vertex (size n + 1)
+    std::vector<int> out_start;
+    // Per slot: the vertex the halfedge points to, the vertex across from it
+    // in its own face (angle alpha) and across in the flip face (angle beta)
+    std::vector<int> he_to, he_across, he_flip_across;
+    // Connected component of every vertex, numbered from 0 in the order of
+    // their lowest vertex, and the number of components
+    std::vector<int> component;
+    int num_components;
+};
+
+template <typename Scalar>
+using Positions = Eigen::Matrix<Scalar, Eigen::Dynamic, 3>;
+
+/* Function prototypes */
+
+static void build_topology(std::vector<HEV*> *hevs, Mesh_Topology &topo);
+static void append_topology(const Mesh_Topology &part, Mesh_Topology &topo);
+
+template <typename Scalar>
+static void gather_positions(std::vector<HEV*> *hevs, Positions<Scalar> &pos);
+template <typename Scalar>
+static void scatter_positions(const Positions<Scalar> &pos, std::vector<HEV*> *hevs);
+
+template <typename Scalar>
+static void compute_cot_weights(const Mesh_Topology &topo,
+                                const Positions<Scalar> &pos,
+                                std::vector<Scalar> &weights,
+                                std::vector<Scalar> &areas);
+template <typename Scalar>
+static Scalar compute_cot_row(const Mesh_Topology &topo,
+                              const Positions<Scalar> &pos,
+                              int i,
+                              Scalar *row_weights);
+
+/* Function implementations */
+
+/* Flattens the halfedge connectivity into a Mesh_Topology and finds its
+ * connected components.
+ * Note: Assumes the vertices are already indexed (hevs->at(i)->index == i).
+ */
+static void build_topology(std::vector<HEV*> *hevs, Mesh_Topology &topo)
+{
+    int num_vertices = hevs->size() - 1;
+    topo.num_vertices = num_vertices;
+    topo.out_start.assign(1, 0);
+    topo.he_to.clear();
+    topo.he_across.clear();
+    topo.he_flip_across.clear();
+
+    for (int i = 1; i <= num_vertices; i++) {
+        HE *curr_he = hevs->at(i)->out;
+        HE *he = curr_he;
+        do {
+            topo.he_to.push_back(he->next->vertex->index - 1);
+            topo.he_across.push_back(he->next->next->vertex->index - 1);
+            topo.he_flip_across.push_back(he->flip->next->next->vertex->index - 1);
+            he = he->flip->next;
+        }
+        while (he != curr_he);
+
+        topo.out_start.push_back(topo.he_to.size());
+    }
+
+    // Labels the components by flooding from every vertex not reached yet
+    topo.component.assign(num_vertices, -1);
+    topo.num_components = 0;
+    std::vector<int> pending;
+    for (int v = 0; v < num_vertices; v++) {
+        if (topo.component[v] >= 0) {
+            continue;
+        }
+        topo.component[v] = topo.num_components;
+        pending.push_back(v);
+        while (!pending.empty()) {
+            int i = pending.back();
+            pending.pop_back();
+            for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+                if (topo.component[topo.he_to[k]] < 0) {
+                    topo.component[topo.he_to[k]] = topo.num_components;
+                    pending.push_back(topo.he_to[k]);
+                }
+            }
+        }
+        topo.num_components++;
+    }
+}
+
+/* Appends the vertices of another mesh after the ones of topo, as more
+ * connected components, so the two meshes are smoothed as one system whose
+ * matrix is block-diagonal. An empty topo starts with no vertices or
+ * components and out_start = {0}.
+ */
+static void append_topology(const Mesh_Topology &part, Mesh_Topology &topo)
+{
+    int offset = topo.num_vertices, slot_offset = topo.he_to.size();
+    for (int i = 1; i <= part.num_vertices; i++) {
+        topo.out_start.push_back(slot_offset + part.out_start[i]);
+    }
+    for (int k = 0; k < part.he_to.size(); k++) {
+        topo.he_to.push_back(offset + part.he_to[k]);
+        topo.he_across.push_back(offset + part.he_across[k]);
+        topo.he_flip_across.push_back(offset + part.he_flip_across[k]);
+    }
+    for (int i = 0; i < part.num_vertices; i++) {
+        topo.component.push_back(topo.num_components + part.component[i]);
+    }
+    topo.num_vertices += part.num_vertices;
+    topo.num_components += part.num_components;
+}
+
+template <typename Scalar>
+static void gather_positions(std::vector<HEV*> *hevs, Positions<Scalar> &pos)
+{
+    int num_vertices = hevs->size() - 1;
+    pos.resize(num_vertices, 3);
+    for (int i = 1; i <= num_vertices; i++) {
+        HEV *v_i = hevs->at(i);
+        pos(i - 1, 0) = v_i->x;
+        pos(i - 1, 1) = v_i->y;
+        pos(i - 1, 2) = v_i->z;
+    }
+}
+
+template <typename Scalar>
+static void scatter_positions(const Positions<Scalar> &pos, std::vector<HEV*> *hevs)
+{
+    for (int i = 1; i < hevs->size(); i++) {
+        HEV *v_i = hevs->at(i);
+        v_i->x = pos(i - 1, 0);
+        v_i->y = pos(i - 1, 1);
+        v_i->z = pos(i - 1, 2);
+    }
+}
+
+// Computes the cotangent of the angle vB vAngle vC
+template <typename Scalar>
+static Scalar cotan(const Eigen::Matrix<Scalar, 3, 1> &vAngle,
+                    const Eigen::Matrix<Scalar, 3, 1> &vB,
+                    const Eigen::Matrix<Scalar, 3, 1> &vC)
+{
+    Eigen::Matrix<Scalar, 3, 1> rayAngleB = vB - vAngle;
+    Eigen::Matrix<Scalar, 3, 1> rayAngleC = vC - vAngle;
+    return rayAngleB.dot(rayAngleC) / rayAngleB.cross(rayAngleC).norm();
+}
+
+/* Computes the cotangent weight (cot alpha + cot beta) of every halfedge slot
+ * and the incident face area of every vertex.
+ */
+template <typename Scalar>
+static void compute_cot_weights(const Mesh_Topology &topo,
+                                const Positions<Scalar> &pos,
+                                std::vector<Scalar> &weights,
+                                std::vector<Scalar> &areas)
+{
+    const int GRAIN = 1024;
+    weights.resize(topo.he_to.size());
+    areas.resize(topo.num_vertices);
+    thread_pool().parallel_for(0, topo.num_vertices, GRAIN, [&](int i) {
+        areas[i] = compute_cot_row(topo, pos, i, weights.data() + topo.out_start[i]);
+    });
+}
+
+/* The same for the slots of vertex i only, written to row_weights in slot
+ * order. Returns its incident face area. They only depend on the positions of
+ * i and its neighbors.
+ */
+template <typename Scalar>
+static Scalar compute_cot_row(const Mesh_Topology &topo,
+                              const Positions<Scalar> &pos,
+                              int i,
+                              Scalar *row_weights)
+{
+    typedef Eigen::Matrix<Scalar, 3, 1> Vec3;
+
+    Scalar area = 0;
+    Vec3 v_i_pos = pos.row(i).transpose();
+
+    for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+        Vec3 v_j_pos = pos.row(topo.he_to[k]).transpose();
+        Vec3 v_across_same_pos = pos.row(topo.he_across[k]).transpose();
+        Vec3 v_across_flip_pos = pos.row(topo.he_flip_across[k]).transpose();
+
+        Scalar cot_alpha = cotan(v_across_same_pos, v_i_pos, v_j_pos);
+        Scalar cot_beta = cotan(v_across_flip_pos, v_i_pos, v_j_pos);
+        row_weights[k - topo.out_start[i]] = cot_alpha + cot_beta;
+
+        // Accumulates the area of the face on the left of the halfedge
+        Vec3 face_normal = (v_j_pos - v_i_pos).cross(v_across_same_pos - v_i_pos);
+        area += 0.5 * face_normal.norm();
+    }
+    return area;
+}
+
+// Returns true if an incident area is too small to divide by
+template <typename Scalar>
+static bool degenerate_area(Scalar area)
+{
+    return std::abs(area) < Scalar(0.0001);
+}
+
+/* The symmetric system (M - hL) x_h = M x_0 built from the cached cotangent
+ * weights. Row i of M - hL is
+ *
+ *     (M_i + h ∑_i~j op_j) x_i - h ∑_i~j (op_j * x_j)
+ *
+ * Vertices of degenerate regions are held in place like the identity rows
+ * of F. To keep the matrix symmetric they are eliminated instead: their row
+ * and column become the identity, and what their neighbors' rows coupled to
+ * them moves to the neighbors' right-hand side.
+ */
+template <typename Scalar>
+struct Smoothing_System
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+    const Mesh_Topology *topo;
+    // Cotangent weight of every halfedge slot
+    std::vector<Scalar> weights;
+    // Lumped mass 2A_i, and whether the vertex is held in place
+    Vector mass;
+    std::vector<char> fixed;
+    // Diagonal of the matrix and h * op_j of every slot between free vertices
+    Vector diag;
+    std::vector<Scalar> coupling;
+    Scalar h;
+
+    // Positions the weights of every row were last computed from (update)
+    Positions<Scalar> weighted;
+
+    Smoothing_System() : topo(NULL), h(0) {}
+
+    // Recomputes the weights and masses for the given positions
+    void assign(const Mesh_Topology &topology, const Positions<Scalar> &pos, Scalar time_step)
+    {
+        topo = &topology;
+        h = time_step;
+        weighted = pos;
+
+        std::vector<Scalar> areas;
+        compute_cot_weights(topology, pos, weights, areas);
+
+        // A row needs the masses of its neighbors, so all of them are set first
+        const int GRAIN = 1024;
+        int num_vertices = topology.num_vertices;
+        mass.resize(num_vertices);
+        fixed.resize(num_vertices);
+        thread_pool().parallel_for(0, num_vertices, GRAIN, [&](int i) {
+            set_mass(i, areas[i]);
+        });
+
+        diag.resize(num_vertices);
+        coupling.resize(weights.size());
+        thread_pool().parallel_for(0, num_vertices, GRAIN, [&](int i) {
+            set_row(i);
+        });
+    }
+
+    /* Like assign, but only for the vertices that moved by more than epsilon
+     * since their weights were last computed. Those, and so the faces around
+     * them, change the weights and areas of their own rows and of their
+     * neighbors' rows, so only those rows are recomputed; a vertex that
+     * becomes held or free also changes its neighbors' couplings to it. A
+     * vertex that moves less keeps its old position in the weights until its
+     * moves add up to epsilon. A different mesh or h recomputes everything.
+     * Returns the number of rows recomputed.
+     */
+    int update(const Mesh_Topology &topology, const Positions<Scalar> &pos, Scalar time_step,
+               Scalar epsilon)
+    {
+        if (weighted.rows() != pos.rows() || topo != &topology || h != time_step) {
+            assign(topology, pos, time_step);
+            return topology.num_vertices;
+        }
+
+        // The moved vertices and their rings, and the rows whose couplings change
+        std::vector<int> rows, coupled;
+        std::vector<char> marked(topology.num_vertices, 0);
+        for (int i = 0; i < topology.num_vertices; i++) {
+            if ((pos.row(i) - weighted.row(i)).norm() <= epsilon) {
+                continue;
+            }
+            weighted.row(i) = pos.row(i);
+            mark(i, marked, rows);
+            for (int k = topology.out_start[i]; k < topology.out_start[i + 1]; k++) {
+                mark(topology.he_to[k], marked, rows);
+            }
+        }
+
+        for (int r = 0; r < rows.size(); r++) {
+            int i = rows[r];
+            char was_fixed = fixed[i];
+            set_mass(i, compute_cot_row(topology, weighted, i,
+                                        weights.data() + topology.out_start[i]));
+            if (fixed[i] != was_fixed) {
+                for (int k = topology.out_start[i]; k < topology.out_start[i + 1]; k++) {
+                    coupled.push_back(topology.he_to[k]);
+                }
+            }
+        }
+        for (int c = 0; c < coupled.size(); c++) {
+            mark(coupled[c], marked, rows);
+        }
+        for (int r = 0; r < rows.size(); r++) {
+            set_row(rows[r]);
+        }
+        return rows.size();
+    }
+
+    // Y = (M - hL) X without forming the matrix
+    void apply(const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        Y.resize(X.rows(), 3);
+        for (int i = 0; i < topo->num_vertices; i++) {
+            apply_row(i, X, Y);
+        }
+    }
+
+    // Row i of Y = (M - hL) X
+    void apply_row(int i, const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        Scalar y[3] = {diag(i) * X(i, 0), diag(i) * X(i, 1), diag(i) * X(i, 2)};
+        for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+            int j = topo->he_to[k];
+            y[0] -= coupling[k] * X(j, 0);
+            y[1] -= coupling[k] * X(j, 1);
+            y[2] -= coupling[k] * X(j, 2);
+        }
+        Y(i, 0) = y[0];
+        Y(i, 1) = y[1];
+        Y(i, 2) = y[2];
+    }
+
+    // Gauss-Seidel update of vertex i: solves row i of (M - hL) X = B for
+    // X(i) with the current positions of its neighbors
+    void relax(int i, const Positions<Scalar> &B, Positions<Scalar> &X) const
+    {
+        Scalar y[3] = {B(i, 0), B(i, 1), B(i, 2)};
+        for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+            int j = topo->he_to[k];
+            y[0] += coupling[k] * X(j, 0);
+            y[1] += coupling[k] * X(j, 1);
+            y[2] += coupling[k] * X(j, 2);
+        }
+        X(i, 0) = y[0] / diag(i);
+        X(i, 1) = y[1] / diag(i);
+        X(i, 2) = y[2] / diag(i);
+    }
+
+    // Right-hand side M X plus the terms moved over from held vertices
+    void rhs(const Positions<Scalar> &X, Positions<Scalar> &B) const
+    {
+        B = mass.asDiagonal() * X;
+        for (int i = 0; i < topo->num_vertices; i++) {
+            if (fixed[i]) {
+                continue;
+            }
+            for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+                int j = topo->he_to[k];
+                if (fixed[j]) {
+                    B.row(i) += h * weights[k] * X.row(j);
+                }
+            }
+        }
+    }
+
+    Vector diagonal() const
+    {
+        return diag;
+    }
+
+    /* Assembles M - hL. Every halfedge slot gets an entry, even where the
+     * coupling is currently zero, so the pattern never changes and the
+     * symbolic analysis of a factorization stays valid between generations.
+     */
+    Eigen::SparseMatrix<Scalar> assemble() const
+    {
+        const int GRAIN = 1024;
+        int num_vertices = topo->num_vertices;
+        Eigen::SparseMatrix<Scalar> A(num_vertices, num_vertices);
+
+        // The pattern is symmetric, so column i has as many entries as row i,
+        // and the compressed columns can be written directly and in parallel
+        A.resizeNonZeros(topo->he_to.size() + num_vertices);
+        int *column_start = A.outerIndexPtr();
+        for (int i = 0; i < num_vertices; i++) {
+            column_start[i + 1] = topo->out_start[i + 1] + i + 1;
+        }
+
+        thread_pool().parallel_for(0, num_vertices, GRAIN, [&](int i) {
+            int *rows = A.innerIndexPtr() + column_start[i];
+            Scalar *values = A.valuePtr() + column_start[i];
+            int count = 0;
+            for (int k = topo->out_start[i]; k <= topo->out_start[i + 1]; k++) {
+                bool is_diag = k == topo->out_start[i + 1];
+                int row = is_diag ? i : topo->he_to[k];
+                Scalar value = is_diag ? diag(i) : -coupling[k];
+
+                // Insertion into the rows so far keeps the column sorted
+                int c = count++;
+                for (; c > 0 && rows[c - 1] > row; c--) {
+                    rows[c] = rows[c - 1];
+                    values[c] = values[c - 1];
+                }
+                rows[c] = row;
+                values[c] = value;
+            }
+        });
+        return A;
+    }
+
+    // Lower triangle of M - hL with sorted rows, as needed by IC0_Preconditioner
+    Eigen::SparseMatrix<Scalar, Eigen::RowMajor> lower() const
+    {
+        std::vector< Eigen::Triplet<Scalar> > entries;
+        entries.reserve(topo->he_to.size() / 2 + topo->num_vertices);
+        for (int i = 0; i < topo->num_vertices; i++) {
+            for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+                if (topo->he_to[k] < i && coupling[k] != 0) {
+                    entries.push_back(Eigen::Triplet<Scalar>(i, topo->he_to[k], -coupling[k]));
+                }
+            }
+            entries.push_back(Eigen::Triplet<Scalar>(i, i, diag(i)));
+        }
+
+        Eigen::SparseMatrix<Scalar, Eigen::RowMajor> L(topo->num_vertices, topo->num_vertices);
+        L.setFromTriplets(entries.begin(), entries.end());
+        return L;
+    }
+
+private:
+    void set_mass(int i, Scalar area)
+    {
+        fixed[i] = degenerate_area(area);
+        mass(i) = fixed[i] ? Scalar(1) : 2 * area;
+    }
+
+    // Diagonal and couplings of row i from the weights, masses and held vertices
+    void set_row(int i)
+    {
+        diag(i) = mass(i);
+        for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+            bool free_edge = !fixed[i] && !fixed[topo->he_to[k]];
+            coupling[k] = free_edge ? h * weights[k] : Scalar(0);
+            if (!fixed[i]) {
+                diag(i) += h * weights[k];
+            }
+        }
+    }
+
+    static void mark(int i, std::vector<char> &marked, std::vector<int> &rows)
+    {
+        if (!marked[i]) {
+            marked[i] = 1;
+            rows.push_back(i);
+        }
+    }
+};
+
+#endif
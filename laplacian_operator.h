@@ -0,0 +1,195 @@
+/* This header file contains the Laplacian as an operator that is applied
+ * directly to the positions, for the explicit smoothing modes that step
+ *
+ *     x <- x + hΔx
+ *
+ * instead of solving a system. It only depends on Eigen, the halfedge and
+ * the rest of the smoothing code.
+ *
+ * Laplacian_Operator<Scalar> stores Δ = M^-1 L in compressed rows, or the
+ * uniform Laplacian with Δx_i the mean of x_j - x_i over the neighbors. The
+ * Taubin filter wants the rows normalized so that their diagonal is -1 and
+ * the eigenvalues lie in [0, 2], which normalize does for either. The row
+ * structure is the one Mesh_Topology already has (out_start, he_to), so the
+ * operator itself only holds one value per halfedge slot and one per vertex
+ * for the diagonal. apply computes ΔX for all three coordinates in one pass
+ * over the rows, split over the threads of the shared pool; a row only
+ * writes its own output, so the result does not depend on the number of
+ * threads.
+ *
+ * Forward Euler is only stable while h ρ <= 2, where ρ is the spectral
+ * radius of Δ, and it only damps every frequency without flipping its sign
+ * while h ρ <= 1. spectral_radius estimates ρ with a few Lanczos steps on
+ * the symmetric form M^-1/2 (-L) M^-1/2, which has the same eigenvalues;
+ * lanczos_bounds pads its estimate so that it bounds ρ from above.
+ */
+
+#ifndef LAPLACIAN_OPERATOR_H
+#define LAPLACIAN_OPERATOR_H
+
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "laplacian.h"
+#include "iterative_solvers.h"
+#include "parallel.h"
+
+template <typename Scalar>
+struct Laplacian_Operator
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+    const Mesh_Topology *topo;
+    // Weight of every halfedge slot and the lumped mass 2A_i, or all ones
+    // for the uniform Laplacian
+    std::vector<Scalar> weights;
+    Vector mass;
+    // Row i of Δ: center(i) on the diagonal and values[k] at column he_to[k].
+    // Both are zero for vertices of degenerate regions, which stay in place.
+    std::vector<Scalar> values;
+    Vector center;
+    std::vector<char> fixed;
+
+    // Recomputes the weights and masses for the given positions
+    void assign(const Mesh_Topology &topology, const Positions<Scalar> &pos)
+    {
+        topo = &topology;
+        std::vector<Scalar> areas;
+        compute_cot_weights(topology, pos, weights, areas);
+
+        int num_vertices = topology.num_vertices;
+        mass.resize(num_vertices);
+        center.resize(num_vertices);
+        fixed.resize(num_vertices);
+        values.resize(weights.size());
+        for (int i = 0; i < num_vertices; i++) {
+            fixed[i] = degenerate_area(areas[i]);
+            mass(i) = fixed[i] ? Scalar(1) : 2 * areas[i];
+            center(i) = 0;
+            for (int k = topology.out_start[i]; k < topology.out_start[i + 1]; k++) {
+                values[k] = fixed[i] ? Scalar(0) : weights[k] / mass(i);
+                center(i) -= values[k];
+            }
+        }
+    }
+
+    // Replaces Δ by the uniform Laplacian, with unit weights and unit masses
+    void assign_uniform(const Mesh_Topology &topology)
+    {
+        topo = &topology;
+        int num_vertices = topology.num_vertices;
+        weights.assign(topology.he_to.size(), Scalar(1));
+        mass.setOnes(num_vertices);
+        center.resize(num_vertices);
+        fixed.assign(num_vertices, 0);
+        values.resize(weights.size());
+        for (int i = 0; i < num_vertices; i++) {
+            int degree = topology.out_start[i + 1] - topology.out_start[i];
+            for (int k = topology.out_start[i]; k < topology.out_start[i + 1]; k++) {
+                values[k] = Scalar(1) / degree;
+            }
+            center(i) = -1;
+        }
+    }
+
+    /* Scales every row so that its diagonal is -1. Rows whose weights do
+     * not add up to a positive number (a vertex surrounded by obtuse
+     * triangles) are held in place instead.
+     */
+    void normalize()
+    {
+        for (int i = 0; i < topo->num_vertices; i++) {
+            if (!(center(i) < 0)) {
+                fixed[i] = 1;
+            }
+            Scalar scale = fixed[i] ? Scalar(0) : -1 / center(i);
+            for (int k = topo->out_start[i]; k < topo->out_start[i + 1]; k++) {
+                values[k] *= scale;
+            }
+            center(i) = fixed[i] ? Scalar(0) : Scalar(-1);
+        }
+    }
+
+    // Y = ΔX
+    void apply(const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        Y.resize(X.rows(), 3);
+        step(0, X, Y);
+    }
+
+    // Y = X + hΔX, fused into the same pass
+    void euler_step(Scalar h, const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        Y.resize(X.rows(), 3);
+        step(h, X, Y);
+    }
+
+    /* Estimates the spectral radius of Δ from above with the given number of
+     * Lanczos steps.
+     */
+    double spectral_radius(int steps) const
+    {
+        double lower, upper;
+        lanczos_bounds< Positions<Scalar> >(Stiffness(*this), mass, steps, lower, upper);
+        return upper;
+    }
+
+private:
+    // With h == 0, Y = ΔX; otherwise Y = X + hΔX
+    void step(Scalar h, const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        const int GRAIN = 1024;
+        const int *out_start = topo->out_start.data();
+        const int *he_to = topo->he_to.data();
+        thread_pool().parallel_for(0, topo->num_vertices, GRAIN, [&](int i) {
+            Scalar y[3] = {center(i) * X(i, 0), center(i) * X(i, 1), center(i) * X(i, 2)};
+            for (int k = out_start[i]; k < out_start[i + 1]; k++) {
+                int j = he_to[k];
+                y[0] += values[k] * X(j, 0);
+                y[1] += values[k] * X(j, 1);
+                y[2] += values[k] * X(j, 2);
+            }
+            if (h == 0) {
+                Y(i, 0) = y[0];
+                Y(i, 1) = y[1];
+                Y(i, 2) = y[2];
+            } else {
+                Y(i, 0) = X(i, 0) + h * y[0];
+                Y(i, 1) = X(i, 1) + h * y[1];
+                Y(i, 2) = X(i, 2) + h * y[2];
+            }
+        });
+    }
+
+    /* -L = -MΔ restricted to the free vertices, which is symmetric; the
+     * operator lanczos_bounds scales by M^-1/2 on both sides
+     */
+    struct Stiffness
+    {
+        const Laplacian_Operator &op;
+
+        explicit Stiffness(const Laplacian_Operator &op) : op(op) {}
+
+        void apply(const Positions<Scalar> &X, Positions<Scalar> &Y) const
+        {
+            Y.resize(X.rows(), 3);
+            const Mesh_Topology &topo = *op.topo;
+            for (int i = 0; i < topo.num_vertices; i++) {
+                Y.row(i).setZero();
+                if (op.fixed[i]) {
+                    continue;
+                }
+                for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+                    int j = topo.he_to[k];
+                    Y.row(i) += op.weights[k] * X.row(i);
+                    if (!op.fixed[j]) {
+                        Y.row(i) -= op.weights[k] * X.row(j);
+                    }
+                }
+            }
+        }
+    };
+};
+
+#endif
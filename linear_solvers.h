@@ -0,0 +1,596 @@
+/* This header file contains the linear solver backends for the smoothing
+ * system of laplacian.h. Every backend implements the Linear_Solver
+ * interface, which splits a generation into the three phases that the
+ * factorizing solvers have:
+ *
+ *     analyze    - symbolic work that only depends on the sparsity pattern,
+ *                  done once per mesh
+ *     factorize  - numeric work that depends on the current weights,
+ *                  done once per generation
+ *     solve      - solves for all three coordinates; X holds the previous
+ *                  positions on entry so iterative backends can warm start
+ *
+ * The backends are:
+ *
+ *     Direct_Solver          - Eigen's SparseLU or SimplicialLDLT, or our
+ *                              parallel Supernodal_Cholesky, on the
+ *                              assembled matrix, permuted by one of the
+ *                              fill-reducing orderings of orderings.h and
+ *                              factorized in FactorScalar with iterative
+ *                              refinement in Scalar
+ *     Eigen_Iterative_Solver - Eigen's ConjugateGradient or BiCGSTAB with a
+ *                              diagonal preconditioner on the assembled matrix
+ *     PCG_Solver             - our own matrix-free preconditioned conjugate
+ *                              gradient from iterative_solvers.h
+ *     Multigrid_Solver       - V-cycles of the multigrid in multigrid.h
+ *     Gauss_Seidel_Solver    - matrix-free symmetric Gauss-Seidel sweeps, run
+ *                              color by color on the shared thread pool
+ *     Chebyshev_Solver       - matrix-free Jacobi-preconditioned Chebyshev
+ *                              iteration, which needs no dot products
+ */
+
+#ifndef LINEAR_SOLVERS_H
+#define LINEAR_SOLVERS_H
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#if defined(__SSE2__)
+#include <pmmintrin.h>
+#endif
+
+#include "laplacian.h"
+#include "iterative_solvers.h"
+#include "orderings.h"
+#include "multigrid.h"
+#include "multicolor.h"
+#include "parallel.h"
+#include "supernodal.h"
+
+/* Flushes denormal floats to zero for as long as it is in scope. The fill-in
+ * entries of a sparse factorization decay quickly, and once they become
+ * denormal every float operation on them runs through the slow microcode
+ * path; on the bunny this made a float SparseLU slower than a double one.
+ */
+struct Flush_Denormals
+{
+#if defined(__SSE2__)
+    unsigned int saved_csr;
+    Flush_Denormals() : saved_csr(_mm_getcsr())
+    {
+        _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+        _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    }
+    ~Flush_Denormals() { _mm_setcsr(saved_csr); }
+#endif
+};
+
+/* Solver interface */
+
+template <typename Scalar>
+class Linear_Solver
+{
+public:
+    virtual ~Linear_Solver() {}
+
+    virtual void analyze(const Smoothing_System<Scalar> &) {}
+    virtual void factorize(const Smoothing_System<Scalar> &system) = 0;
+    virtual void solve(const Smoothing_System<Scalar> &system,
+                       const Positions<Scalar> &B,
+                       Positions<Scalar> &X) = 0;
+
+    // Nonzeros stored by the factorization or the preconditioner
+    virtual long factor_nonzeros() const { return 0; }
+
+    // Iterations and residual of the last solve
+    Solve_Stats stats;
+};
+
+/* SparseLU that also reports the size of its factors */
+template <typename MatrixType, typename Ordering>
+class Counted_SparseLU : public Eigen::SparseLU<MatrixType, Ordering>
+{
+public:
+    long nonzeros() const { return this->m_nnzL + this->m_nnzU; }
+};
+
+template <typename MatrixType, typename Ordering>
+static long count_factor_nonzeros(const Counted_SparseLU<MatrixType, Ordering> &lu)
+{
+    return lu.nonzeros();
+}
+
+template <typename MatrixType, int UpLo, typename Ordering>
+static long count_factor_nonzeros(const Eigen::SimplicialLDLT<MatrixType, UpLo, Ordering> &ldlt)
+{
+    return ldlt.matrixL().nestedExpression().nonZeros();
+}
+
+template <typename MatrixType>
+static long count_factor_nonzeros(const Supernodal_Cholesky<MatrixType> &cholesky)
+{
+    return cholesky.nonzeros();
+}
+
+/* Factorizes the assembled system in FactorScalar. The system is permuted
+ * with the ordering computed in analyze, so the Factorization itself must use
+ * Eigen's NaturalOrdering. When FactorScalar is
+ * lower than Scalar, every solve is followed by iterative refinement: the
+ * residual B - AX is computed matrix-free in Scalar and the correction is
+ * solved with the low precision factors. The refinement only converges while
+ * the matrix is well conditioned relative to FactorScalar, so a column stops
+ * being refined as soon as a correction does not reduce its residual.
+ */
+template <typename Scalar, typename FactorScalar, typename Factorization>
+class Direct_Solver : public Linear_Solver<Scalar>
+{
+public:
+    typedef Eigen::Matrix<FactorScalar, Eigen::Dynamic, 3> FactorBlock;
+    typedef Eigen::Array<Scalar, 1, 3> Row;
+
+    Direct_Solver(Ordering_Type ordering, int refine_steps, double refine_tol)
+        : ordering(ordering), refine_steps(refine_steps), refine_tol(refine_tol) {}
+
+    void analyze(const Smoothing_System<Scalar> &system)
+    {
+        analyze_system(system);
+    }
+
+    void factorize(const Smoothing_System<Scalar> &system)
+    {
+        factorize_system(system);
+    }
+
+    void solve(const Smoothing_System<Scalar> &system,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X)
+    {
+        solve_system(system, B, X);
+    }
+
+    /* The same for any other system with assemble and apply, like the
+     * bi-Laplacian one of bilaplacian.h
+     */
+    template <typename System>
+    void analyze_system(const System &system)
+    {
+        Eigen::SparseMatrix<Scalar> A = system.assemble();
+        ordering = compute_ordering(ordering, A, inverse_perm);
+        perm = inverse_perm.inverse();
+
+        permute(A);
+        factorization.analyzePattern(matrix);
+    }
+
+    template <typename System>
+    void factorize_system(const System &system)
+    {
+        Flush_Denormals flush;
+        permute(system.assemble());
+        factorization.factorize(matrix);
+    }
+
+    template <typename System>
+    void solve_system(const System &system,
+                      const Positions<Scalar> &B,
+                      Positions<Scalar> &X)
+    {
+        Flush_Denormals flush;
+        X = factor_solve(B);
+
+        Row b_norm = B.colwise().norm().array().max(Scalar(1e-30));
+        Positions<Scalar> AX;
+        system.apply(X, AX);
+        Positions<Scalar> R = B - AX;
+        Row residual = R.colwise().norm().array() / b_norm;
+
+        this->stats.iterations = 0;
+        bool refine = sizeof(FactorScalar) < sizeof(Scalar);
+        while (refine && this->stats.iterations < refine_steps
+                      && (residual > Scalar(refine_tol)).any()) {
+            this->stats.iterations++;
+
+            Positions<Scalar> corrected = X + factor_solve(R);
+            system.apply(corrected, AX);
+            Positions<Scalar> corrected_R = B - AX;
+            Row corrected_residual = corrected_R.colwise().norm().array() / b_norm;
+
+            refine = false;
+            for (int c = 0; c < 3; c++) {
+                if (residual(c) > refine_tol && corrected_residual(c) < residual(c)) {
+                    X.col(c) = corrected.col(c);
+                    R.col(c) = corrected_R.col(c);
+                    residual(c) = corrected_residual(c);
+                    refine = true;
+                }
+            }
+        }
+        this->stats.residual = residual.maxCoeff();
+    }
+
+    long factor_nonzeros() const
+    {
+        return count_factor_nonzeros(factorization);
+    }
+
+    // The ordering in use, which is never ORDERING_AUTO after analyze
+    Ordering_Type ordering;
+
+private:
+    // matrix = P A P^T in FactorScalar
+    void permute(const Eigen::SparseMatrix<Scalar> &A)
+    {
+        Eigen::SparseMatrix<Scalar> permuted;
+        permuted = A.twistedBy(perm);
+        matrix = permuted.template cast<FactorScalar>();
+    }
+
+    // Solves A X = B with the factors of P A P^T
+    Positions<Scalar> factor_solve(const Positions<Scalar> &B)
+    {
+        FactorBlock B_f = (perm * B).template cast<FactorScalar>();
+        FactorBlock X_f = factorization.solve(B_f);
+        return inverse_perm * X_f.template cast<Scalar>();
+    }
+
+    int refine_steps;
+    double refine_tol;
+    Ordering_Permutation perm, inverse_perm;
+    Eigen::SparseMatrix<FactorScalar> matrix;
+    Factorization factorization;
+};
+
+// The assembled system in row-major storage and the given scalar type
+template <typename MatrixScalar, typename Scalar>
+static Eigen::SparseMatrix<MatrixScalar, Eigen::RowMajor> assemble_rows(const Smoothing_System<Scalar> &system)
+{
+    return Eigen::SparseMatrix<MatrixScalar, Eigen::RowMajor>(system.assemble().template cast<MatrixScalar>());
+}
+
+/* One of Eigen's iterative solvers on the assembled system */
+template <typename Scalar, typename Iterative>
+class Eigen_Iterative_Solver : public Linear_Solver<Scalar>
+{
+public:
+    Eigen_Iterative_Solver(double tol, int max_iterations)
+    {
+        solver.setTolerance(tol);
+        solver.setMaxIterations(max_iterations);
+    }
+
+    void factorize(const Smoothing_System<Scalar> &system)
+    {
+        matrix = system.assemble();
+        solver.compute(matrix);
+    }
+
+    void solve(const Smoothing_System<Scalar> &,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X)
+    {
+        X = solver.solveWithGuess(B, X);
+        this->stats.iterations = solver.iterations();
+        this->stats.residual = solver.error();
+    }
+
+private:
+    Eigen::SparseMatrix<Scalar> matrix;
+    Iterative solver;
+};
+
+/* Our matrix-free preconditioned conjugate gradient. The system is never
+ * assembled, except for what the preconditioner is computed from: the lower
+ * triangle for incomplete Cholesky or the whole matrix for a multigrid
+ * V-cycle. Both of those are kept in FactorScalar.
+ */
+template <typename Scalar, typename FactorScalar>
+class PCG_Solver : public Linear_Solver<Scalar>
+{
+public:
+    enum Preconditioner { NONE, JACOBI, IC, MG };
+
+    PCG_Solver(Preconditioner preconditioner, double tol, int max_iterations,
+               bool multicolor = false)
+        : preconditioner(preconditioner), tol(tol), max_iterations(max_iterations)
+    {
+        multigrid.multicolor = multicolor;
+    }
+
+    void factorize(const Smoothing_System<Scalar> &system)
+    {
+        if (preconditioner == MG) {
+            multigrid.compute(assemble_rows<FactorScalar>(system));
+        } else if (preconditioner == IC) {
+            Flush_Denormals flush;
+            ic.compute(system.lower());
+        } else if (preconditioner == JACOBI) {
+            jacobi.compute(system.diagonal());
+        }
+    }
+
+    void solve(const Smoothing_System<Scalar> &system,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X)
+    {
+        if (preconditioner == MG) {
+            Flush_Denormals flush;
+            this->stats = pcg_solve(system, multigrid, B, X, tol, max_iterations);
+        } else if (preconditioner == IC) {
+            Flush_Denormals flush;
+            this->stats = pcg_solve(system, ic, B, X, tol, max_iterations);
+        } else if (preconditioner == JACOBI) {
+            this->stats = pcg_solve(system, jacobi, B, X, tol, max_iterations);
+        } else {
+            this->stats = pcg_solve(system, Identity_Preconditioner(), B, X, tol, max_iterations);
+        }
+    }
+
+    long factor_nonzeros() const
+    {
+        if (preconditioner == MG) {
+            return multigrid.nonzeros();
+        }
+        return (preconditioner == IC) ? ic.nonzeros() : 0;
+    }
+
+    /* The same solve a few iterations at a time: start sets it up from the
+     * warm start in X, and every resume runs up to the given number of
+     * iterations on X and returns whether the solve is done, because the
+     * residual is below tol or it ran out of iterations.
+     */
+    void start(const Smoothing_System<Scalar> &system, const Positions<Scalar> &B,
+               const Positions<Scalar> &X)
+    {
+        Flush_Denormals flush;
+        if (preconditioner == MG) {
+            state.start(system, multigrid, B, X);
+        } else if (preconditioner == IC) {
+            state.start(system, ic, B, X);
+        } else if (preconditioner == JACOBI) {
+            state.start(system, jacobi, B, X);
+        } else {
+            state.start(system, Identity_Preconditioner(), B, X);
+        }
+        this->stats = state.stats();
+    }
+
+    bool resume(const Smoothing_System<Scalar> &system, Positions<Scalar> &X, int iterations)
+    {
+        Flush_Denormals flush;
+        for (int k = 0; k < iterations && !done(); k++) {
+            if (preconditioner == MG) {
+                state.iterate(system, multigrid, X, tol);
+            } else if (preconditioner == IC) {
+                state.iterate(system, ic, X, tol);
+            } else if (preconditioner == JACOBI) {
+                state.iterate(system, jacobi, X, tol);
+            } else {
+                state.iterate(system, Identity_Preconditioner(), X, tol);
+            }
+        }
+        this->stats = state.stats();
+        return done();
+    }
+
+private:
+    bool done() const
+    {
+        return state.iterations >= max_iterations || state.converged(tol);
+    }
+
+    Preconditioner preconditioner;
+    double tol;
+    int max_iterations;
+    PCG_State< Positions<Scalar> > state;
+    Jacobi_Preconditioner<Scalar> jacobi;
+    IC0_Preconditioner<FactorScalar> ic;
+    Multigrid<FactorScalar> multigrid;
+};
+
+/* Multigrid V-cycles on their own, warm-started from X, until the relative
+ * residual drops below tol. The hierarchy is built on the first factorize.
+ */
+template <typename Scalar>
+class Multigrid_Solver : public Linear_Solver<Scalar>
+{
+public:
+    Multigrid_Solver(double tol, int max_cycles, bool multicolor = false)
+        : tol(tol), max_cycles(max_cycles)
+    {
+        multigrid.multicolor = multicolor;
+    }
+
+    void factorize(const Smoothing_System<Scalar> &system)
+    {
+        multigrid.compute(assemble_rows<Scalar>(system));
+    }
+
+    void solve(const Smoothing_System<Scalar> &system,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X)
+    {
+        Eigen::Array<Scalar, 1, 3> b_norm = B.colwise().norm().array().max(Scalar(1e-30));
+        Positions<Scalar> AX;
+        for (this->stats.iterations = 0; ; this->stats.iterations++) {
+            system.apply(X, AX);
+            this->stats.residual = ((B - AX).colwise().norm().array() / b_norm).maxCoeff();
+            if (this->stats.residual <= tol || this->stats.iterations >= max_cycles) {
+                break;
+            }
+            multigrid.cycle(B, X);
+        }
+    }
+
+    long factor_nonzeros() const
+    {
+        return multigrid.nonzeros();
+    }
+
+    Multigrid<Scalar> multigrid;
+
+private:
+    double tol;
+    int max_cycles;
+};
+
+/* Symmetric Gauss-Seidel on the matrix-free system, warm-started from X,
+ * until the relative residual drops below tol. Every iteration is a forward
+ * and a backward multicolor sweep; the vertex coloring is computed once per
+ * mesh in analyze.
+ */
+template <typename Scalar>
+class Gauss_Seidel_Solver : public Linear_Solver<Scalar>
+{
+public:
+    Gauss_Seidel_Solver(double tol, int max_sweeps)
+        : tol(tol), max_sweeps(max_sweeps) {}
+
+    void analyze(const Smoothing_System<Scalar> &system)
+    {
+        const Mesh_Topology &topo = *system.topo;
+        greedy_coloring(topo.num_vertices, topo.out_start.data(), topo.he_to.data(), coloring);
+    }
+
+    void factorize(const Smoothing_System<Scalar> &) {}
+
+    void solve(const Smoothing_System<Scalar> &system,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X)
+    {
+        const int GRAIN = 1024;
+        Eigen::Array<Scalar, 1, 3> b_norm = B.colwise().norm().array().max(Scalar(1e-30));
+        Positions<Scalar> AX(X.rows(), 3);
+        for (this->stats.iterations = 0; ; this->stats.iterations++) {
+            thread_pool().parallel_for(0, X.rows(), GRAIN,
+                                       [&](int i) { system.apply_row(i, X, AX); });
+            this->stats.residual = ((B - AX).colwise().norm().array() / b_norm).maxCoeff();
+            if (this->stats.residual <= tol || this->stats.iterations >= max_sweeps) {
+                break;
+            }
+            sweep(system, B, X);
+        }
+    }
+
+    // One symmetric sweep: all colors forward, then backward
+    void sweep(const Smoothing_System<Scalar> &system,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X) const
+    {
+        auto relax = [&](int i) { system.relax(i, B, X); };
+        multicolor_sweep(coloring, true, relax);
+        multicolor_sweep(coloring, false, relax);
+    }
+
+    Vertex_Coloring coloring;
+
+private:
+    double tol;
+    int max_sweeps;
+};
+
+/* Chebyshev iteration on the matrix-free system, preconditioned by its
+ * diagonal D and warm-started from X.
+ *
+ * CG needs two dot products per iteration, and every dot product is a point
+ * where all threads have to meet. Chebyshev iteration replaces them with
+ * bounds [lower, upper] on the eigenvalues of D^-1 A, which factorize
+ * estimates with a few Lanczos steps. After that an iteration is a single
+ * parallel loop over the vertices that applies A, updates X and the residual
+ * and computes the next direction row by row; the direction is double
+ * buffered so that rows can read their neighbors' old directions while new
+ * ones are written.
+ *
+ * The number of iterations needed to reduce the residual by tol is known in
+ * advance from the condition number upper / lower, so solve runs that many,
+ * computes the residual once, and only starts another round if the estimate
+ * fell short. Lanczos finds the small end of the spectrum last, so when a
+ * round falls far short of its prediction, lower is halved for the next
+ * one; if the residual grew instead, upper is raised. Every iteration costs
+ * the same, which makes the time of a generation predictable.
+ */
+template <typename Scalar>
+class Chebyshev_Solver : public Linear_Solver<Scalar>
+{
+public:
+    Chebyshev_Solver(double tol, int max_iterations, int lanczos_steps)
+        : tol(tol), max_iterations(max_iterations), lanczos_steps(lanczos_steps) {}
+
+    void factorize(const Smoothing_System<Scalar> &system)
+    {
+        lanczos_bounds< Positions<Scalar> >(system, system.diagonal(), lanczos_steps, lower, upper);
+    }
+
+    void solve(const Smoothing_System<Scalar> &system,
+               const Positions<Scalar> &B,
+               Positions<Scalar> &X)
+    {
+        const int GRAIN = 1024;
+        int n = X.rows();
+        Thread_Pool &pool = thread_pool();
+        Eigen::Matrix<Scalar, Eigen::Dynamic, 1> inv_diag = system.diagonal().cwiseInverse();
+        Eigen::Array<Scalar, 1, 3> b_norm = B.colwise().norm().array().max(Scalar(1e-30));
+
+        Positions<Scalar> R(n, 3), D(n, 3), D_next(n, 3), AD(n, 3);
+        double expected = HUGE_VAL;
+        this->stats.iterations = 0;
+        while (true) {
+            pool.parallel_for(0, n, GRAIN, [&](int i) { system.apply_row(i, X, R); });
+            R = B - R;
+            double residual = (R.colwise().norm().array() / b_norm).maxCoeff();
+            if (this->stats.iterations > 0) {
+                // A growing residual means upper was too low; one that fell
+                // far short of the prediction means lower was too high
+                if (residual > this->stats.residual) {
+                    upper *= 1.5;
+                } else if (residual > 10 * expected) {
+                    lower /= 2;
+                }
+            }
+            this->stats.residual = residual;
+            if (residual <= tol || this->stats.iterations >= max_iterations) {
+                break;
+            }
+
+            // Convergence factor per iteration for the condition number
+            // upper / lower, and the iterations until 2 q^k reaches the
+            // reduction still needed
+            double sqrt_kappa = std::sqrt(upper / lower);
+            double q = (sqrt_kappa - 1) / (sqrt_kappa + 1);
+            int round = (q > 0) ? (int) std::ceil(std::log(tol / residual / 2) / std::log(q)) : 1;
+            round = std::max(1, std::min(round, max_iterations - this->stats.iterations));
+            expected = residual * 2 * std::pow(q, round);
+
+            double theta = (upper + lower) / 2, delta = (upper - lower) / 2;
+            double sigma = theta / delta, rho = 1 / sigma;
+            D = inv_diag.asDiagonal() * R / Scalar(theta);
+            for (int k = 0; k < round; k++) {
+                double rho_next = 1 / (2 * sigma - rho);
+                Scalar keep = Scalar(rho_next * rho), step = Scalar(2 * rho_next / delta);
+                pool.parallel_for(0, n, GRAIN, [&](int i) {
+                    system.apply_row(i, D, AD);
+                    for (int c = 0; c < 3; c++) {
+                        X(i, c) += D(i, c);
+                        R(i, c) -= AD(i, c);
+                        D_next(i, c) = keep * D(i, c) + step * inv_diag(i) * R(i, c);
+                    }
+                });
+                D.swap(D_next);
+                rho = rho_next;
+            }
+            this->stats.iterations += round;
+        }
+    }
+
+    // Eigenvalue bounds of D^-1 A, as adjusted by the last solve
+    double lower, upper;
+
+private:
+    double tol;
+    int max_iterations;
+    int lanczos_steps;
+};
+
+#endif
@@ -0,0 +1,106 @@
+/* This header file contains the greedy vertex coloring and the multicolor
+ * Gauss-Seidel sweep built on it.
+ *
+ * A Gauss-Seidel sweep relaxes one vertex after the other, each with the
+ * newest values of its neighbors, so in index order it is inherently serial.
+ * Vertices that share no edge do not read each other's values though. After
+ * coloring the vertex graph so that no two neighbors share a color, all
+ * vertices of one color can be relaxed at the same time, and a sweep becomes
+ * one parallel loop per color. The result is Gauss-Seidel in a different
+ * vertex order: it converges at the same rate, give or take, and does not
+ * depend on the number of threads.
+ *
+ * The graph is given in compressed rows (row_start, cols), which both the
+ * Mesh_Topology of laplacian.h (out_start, he_to) and a row-major Eigen
+ * matrix provide. Diagonal entries are ignored.
+ */
+
+#ifndef MULTICOLOR_H
+#define MULTICOLOR_H
+
+#include <vector>
+
+#include "parallel.h"
+
+/* The vertices grouped by color */
+struct Vertex_Coloring
+{
+    int num_colors;
+    // Range of every color in vertices (size num_colors + 1)
+    std::vector<int> color_start;
+    // The vertices of every color in increasing order
+    std::vector<int> vertices;
+};
+
+/* Function prototypes */
+
+static void greedy_coloring(int n, const int *row_start, const int *cols,
+                            Vertex_Coloring &coloring);
+
+template <typename Relax>
+static void multicolor_sweep(const Vertex_Coloring &coloring, bool forward, const Relax &relax);
+
+/* Function implementations */
+
+/* Gives every vertex, in index order, the smallest color none of its
+ * already colored neighbors has. A vertex of degree d gets a color below
+ * d + 1, so on meshes this rarely takes more than 7 or 8 colors.
+ */
+static void greedy_coloring(int n, const int *row_start, const int *cols,
+                            Vertex_Coloring &coloring)
+{
+    std::vector<int> color(n, -1);
+    // taken[c] == v while color c is used by a neighbor of v
+    std::vector<int> taken;
+    coloring.num_colors = 0;
+    for (int v = 0; v < n; v++) {
+        for (int p = row_start[v]; p < row_start[v + 1]; p++) {
+            int c = (cols[p] != v) ? color[cols[p]] : -1;
+            if (c >= 0) {
+                taken[c] = v;
+            }
+        }
+        int c = 0;
+        while (c < coloring.num_colors && taken[c] == v) {
+            c++;
+        }
+        if (c == coloring.num_colors) {
+            coloring.num_colors++;
+            taken.push_back(-1);
+        }
+        color[v] = c;
+    }
+
+    coloring.color_start.assign(coloring.num_colors + 1, 0);
+    for (int v = 0; v < n; v++) {
+        coloring.color_start[color[v] + 1]++;
+    }
+    for (int c = 0; c < coloring.num_colors; c++) {
+        coloring.color_start[c + 1] += coloring.color_start[c];
+    }
+    coloring.vertices.resize(n);
+    std::vector<int> fill(coloring.color_start.begin(), coloring.color_start.end() - 1);
+    for (int v = 0; v < n; v++) {
+        coloring.vertices[fill[color[v]]++] = v;
+    }
+}
+
+/* Calls relax(v) for every vertex, one color after the other in increasing
+ * (forward) or decreasing order, with the vertices of a color split over the
+ * threads of the shared pool. relax(v) may read the values of v's neighbors
+ * but only write those of v.
+ */
+template <typename Relax>
+static void multicolor_sweep(const Vertex_Coloring &coloring, bool forward, const Relax &relax)
+{
+    const int GRAIN = 256;
+    Thread_Pool &pool = thread_pool();
+    for (int k = 0; k < coloring.num_colors; k++) {
+        int c = forward ? k : coloring.num_colors - 1 - k;
+        const int *vertices = coloring.vertices.data();
+        pool.parallel_for(coloring.color_start[c], coloring.color_start[c + 1], GRAIN,
+                          [&](int i) { relax(vertices[i]); });
+    }
+}
+
+#endif
@@ -0,0 +1,302 @@
+/* This header file contains a multigrid V-cycle for the assembled smoothing
+ * system of laplacian.h. It only depends on Eigen.
+ *
+ * The coarse levels come from decimating the mesh by edge collapses. On
+ * every level a maximal independent set of the vertex graph survives, and
+ * every other vertex is collapsed along an edge into a surviving neighbor.
+ * Only strong edges, whose negative coupling is at least STRENGTH times the
+ * largest one of the collapsed vertex, are collapsed; on stretched triangles this
+ * keeps the weakly coupled direction from being coarsened, which a point
+ * smoother could not make up for. The collapse records (which vertices
+ * survive and where they end up on the coarse level) are computed once, in
+ * analyze, from the first weights. The graph of the next level is the graph
+ * of the collapsed mesh, in which two survivors are neighbors if a collapsed
+ * vertex touched both.
+ *
+ * The prolongation P from a coarse level to the finer one keeps the value
+ * of a survivor and gives a collapsed vertex the average of its surviving
+ * neighbors, weighted by its negative couplings to them (positive couplings,
+ * which obtuse triangles produce, are ignored). The coarse
+ * operators are the Galerkin products A_c = P^T A P, recomputed in compute
+ * whenever the weights change. The coarsest level is factorized with LDLT.
+ *
+ * The smoother is symmetric Gauss-Seidel, either in index order or, with
+ * multicolor set, color by color in parallel (see multicolor.h). The colors
+ * are recomputed with the operators, since the pattern of a Galerkin
+ * product can change with the weights.
+ *
+ * Multigrid has the shape of the preconditioners of iterative_solvers.h, so
+ * it can be used inside pcg_solve, or on its own by calling cycle until the
+ * residual is small enough.
+ */
+
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <cmath>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "multicolor.h"
+
+template <typename Scalar>
+class Multigrid
+{
+public:
+    typedef Eigen::SparseMatrix<Scalar, Eigen::RowMajor> Matrix;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Block;
+
+    // Fraction of a vertex's largest negative coupling that counts as strong
+    static constexpr double STRENGTH = 0.25;
+
+    Multigrid() : pre_sweeps(1), post_sweeps(1), coarsest_size(500), multicolor(false) {}
+
+    // Computes the collapse records of every level and sets up the levels
+    void analyze(const Matrix &A)
+    {
+        levels.clear();
+        setup(A, true);
+    }
+
+    // Sets up the levels for new values of A with the existing collapse
+    // records, or analyzes A first if there are none yet
+    void compute(const Matrix &A)
+    {
+        setup(A, levels.empty());
+    }
+
+    // Improves X in place with one V-cycle on A X = B
+    template <typename BlockType>
+    void cycle(const BlockType &B, BlockType &X) const
+    {
+        Block X_s = X.template cast<Scalar>();
+        v_cycle(0, B.template cast<Scalar>(), X_s);
+        X = X_s.template cast<typename BlockType::Scalar>();
+    }
+
+    // Preconditioner interface: one V-cycle from a zero guess
+    template <typename BlockType>
+    void apply(const BlockType &R, BlockType &Z) const
+    {
+        Block Z_s = Block::Zero(R.rows(), R.cols());
+        v_cycle(0, R.template cast<Scalar>(), Z_s);
+        Z = Z_s.template cast<typename BlockType::Scalar>();
+    }
+
+    int num_levels() const { return levels.size(); }
+
+    // Nonzeros of the operators and prolongations of all levels
+    long nonzeros() const
+    {
+        long total = 0;
+        for (int l = 0; l < levels.size(); l++) {
+            total += levels[l].A.nonZeros() + levels[l].P.nonZeros();
+        }
+        return total;
+    }
+
+    // Gauss-Seidel sweeps before and after the coarse correction
+    int pre_sweeps, post_sweeps;
+    // Levels with at most this many vertices are not coarsened further
+    int coarsest_size;
+    // Whether Gauss-Seidel sweeps run color by color on the shared thread pool
+    bool multicolor;
+
+private:
+    struct Level
+    {
+        Matrix A;
+        // Prolongation from the next level
+        Matrix P;
+        // Index of every survivor on the next level, -1 if collapsed, and
+        // empty on the coarsest level
+        std::vector<int> coarse_index;
+        // Colors of the graph of A for multicolor sweeps
+        Vertex_Coloring coloring;
+    };
+
+    void setup(const Matrix &A, bool collapse)
+    {
+        if (collapse) {
+            levels.clear();
+        }
+        int l = 0;
+        Matrix current = A;
+        while (true) {
+            if (collapse) {
+                levels.push_back(Level());
+            }
+            Level &level = levels[l];
+            level.A = current;
+            level.A.makeCompressed();
+
+            if (collapse) {
+                int coarse_size = collapse_edges(level);
+                if (level.A.rows() <= coarsest_size || 5 * coarse_size > 4 * level.A.rows()) {
+                    level.coarse_index.clear();
+                }
+            }
+            if (level.coarse_index.empty()) {
+                level.P.resize(0, 0);
+                break;
+            }
+            if (multicolor) {
+                greedy_coloring(level.A.rows(), level.A.outerIndexPtr(), level.A.innerIndexPtr(),
+                                level.coloring);
+            }
+
+            build_prolongation(level);
+            Matrix AP = level.A * level.P;
+            current = Matrix(level.P.transpose()) * AP;
+            l++;
+        }
+
+        Eigen::SparseMatrix<Scalar> coarsest = levels[l].A;
+        coarse_solver.compute(coarsest);
+    }
+
+    /* Picks a maximal independent set of the strong connections of the
+     * level's graph in index order and collapses every other vertex into it.
+     * Returns the number of survivors.
+     */
+    int collapse_edges(Level &level)
+    {
+        const Matrix &A = level.A;
+        int n = A.rows();
+        const int UNDECIDED = -2, COLLAPSED = -1;
+
+        // u depends strongly on v if -a_uv >= STRENGTH * max_k -a_uk
+        std::vector<Scalar> strongest(n, 0);
+        for (int u = 0; u < n; u++) {
+            for (typename Matrix::InnerIterator it(A, u); it; ++it) {
+                if (it.col() != u) {
+                    strongest[u] = std::max(strongest[u], -it.value());
+                }
+            }
+        }
+
+        level.coarse_index.assign(n, UNDECIDED);
+        int coarse_size = 0;
+        for (int v = 0; v < n; v++) {
+            if (level.coarse_index[v] != UNDECIDED) {
+                continue;
+            }
+            level.coarse_index[v] = coarse_size++;
+            for (typename Matrix::InnerIterator it(A, v); it; ++it) {
+                int u = it.col();
+                if (level.coarse_index[u] == UNDECIDED &&
+                        -it.value() >= STRENGTH * strongest[u] && strongest[u] > 0) {
+                    level.coarse_index[u] = COLLAPSED;
+                }
+            }
+        }
+        return coarse_size;
+    }
+
+    void build_prolongation(Level &level)
+    {
+        const Matrix &A = level.A;
+        int n = A.rows(), coarse_size = 0;
+        std::vector< Eigen::Triplet<Scalar> > entries;
+        for (int v = 0; v < n; v++) {
+            int c = level.coarse_index[v];
+            if (c >= 0) {
+                entries.push_back(Eigen::Triplet<Scalar>(v, c, 1));
+                coarse_size = std::max(coarse_size, c + 1);
+                continue;
+            }
+
+            Scalar total = 0;
+            int count = 0;
+            for (typename Matrix::InnerIterator it(A, v); it; ++it) {
+                if (it.col() != v && level.coarse_index[it.col()] >= 0) {
+                    total += std::max(-it.value(), Scalar(0));
+                    count++;
+                }
+            }
+            for (typename Matrix::InnerIterator it(A, v); it; ++it) {
+                if (it.col() != v && level.coarse_index[it.col()] >= 0) {
+                    Scalar weight = (total > 0) ? std::max(-it.value(), Scalar(0)) / total
+                                                : Scalar(1) / count;
+                    if (weight > 0) {
+                        entries.push_back(Eigen::Triplet<Scalar>(v, level.coarse_index[it.col()], weight));
+                    }
+                }
+            }
+        }
+
+        level.P.resize(n, coarse_size);
+        level.P.setFromTriplets(entries.begin(), entries.end());
+    }
+
+    void v_cycle(int l, const Block &B, Block &X) const
+    {
+        const Level &level = levels[l];
+        if (level.coarse_index.empty()) {
+            X = coarse_solver.solve(B);
+            return;
+        }
+
+        for (int s = 0; s < pre_sweeps; s++) {
+            gauss_seidel(level, B, X, true);
+        }
+
+        Block R = B - level.A * X;
+        Block B_c = level.P.transpose() * R;
+        Block X_c = Block::Zero(B_c.rows(), B_c.cols());
+        v_cycle(l + 1, B_c, X_c);
+        X += level.P * X_c;
+
+        for (int s = 0; s < post_sweeps; s++) {
+            gauss_seidel(level, B, X, false);
+        }
+    }
+
+    // One Gauss-Seidel sweep over the rows (or colors) in forward or backward
+    // order, so that a forward pre-sweep and backward post-sweep keep the
+    // cycle symmetric
+    void gauss_seidel(const Level &level, const Block &B, Block &X, bool forward) const
+    {
+        const Matrix &A = level.A;
+        int n = A.rows(), num_cols = B.cols();
+        const int *row_start = A.outerIndexPtr();
+        const int *cols = A.innerIndexPtr();
+        const Scalar *values = A.valuePtr();
+
+        // All columns of a row are relaxed together, so the row is read once
+        auto relax = [&](int i) {
+            Scalar diag = 0;
+            for (int p = row_start[i]; p < row_start[i + 1]; p++) {
+                if (cols[p] == i) {
+                    diag = values[p];
+                    break;
+                }
+            }
+            for (int c = 0; c < num_cols; c++) {
+                const Scalar *x = X.col(c).data();
+                Scalar sum = B(i, c);
+                for (int p = row_start[i]; p < row_start[i + 1]; p++) {
+                    if (cols[p] != i) {
+                        sum -= values[p] * x[cols[p]];
+                    }
+                }
+                X(i, c) = sum / diag;
+            }
+        };
+
+        if (multicolor) {
+            multicolor_sweep(level.coloring, forward, relax);
+            return;
+        }
+        for (int k = 0; k < n; k++) {
+            relax(forward ? k : n - 1 - k);
+        }
+    }
+
+    std::vector<Level> levels;
+    Eigen::SimplicialLDLT< Eigen::SparseMatrix<Scalar> > coarse_solver;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/* This header file contains the plain .obj reading that the viewer and the
+ * benchmark program share. It only knows about the Mesh_Data struct from
+ * structs.h, so it does not depend on OpenGL.
+ *
+ * The main function of interest is:
+ *
+ *     parse_OBJ(Mesh_Data *mesh, std::string filename);
+ *
+ * which fills in a freshly allocated Mesh_Data with the vertices and faces
+ * of the file. As build_HE expects, the first vertex pushed is a NULL filler
+ * so that the vertices are 1-indexed like the face indices in the file.
+ *
+ * The file is read at once and its lines are parsed in chunks on the shared
+ * pool of parallel.h, each chunk into its own lists, which are then appended
+ * in file order. Only "v" and "f" lines are read; the first three indices of
+ * a face are its triangle, and anything after an index up to the next space
+ * (like "/2/3") is skipped.
+ */
+
+#ifndef OBJ_IO_H
+#define OBJ_IO_H
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "structs.h"
+#include "parallel.h"
+
+/* Function prototypes */
+
+static void parse_OBJ(Mesh_Data *mesh, std::string filename);
+
+/* Function implementations */
+
+// Parses one line, terminated by a 0, as a vertex or face if it is one
+static void parse_OBJ_line(char *line, std::vector<Vertex *> &vertices, std::vector<Face *> &faces)
+{
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    bool vertex = line[0] == 'v', face = line[0] == 'f';
+    if (!(vertex || face) || !(line[1] == ' ' || line[1] == '\t')) {
+        return;
+    }
+    char *end = line + 1;
+
+    // Parses the line as a vertex
+    if (vertex) {
+        Vertex *vert = new Vertex;
+        vert->x = std::strtof(end, &end);
+        vert->y = std::strtof(end, &end);
+        vert->z = std::strtof(end, &end);
+        vertices.push_back(vert);
+        return;
+    }
+
+    // Parses the line as a face
+    int idx[3];
+    for (int c = 0; c < 3; c++) {
+        idx[c] = std::strtol(end, &end, 10);
+        while (*end && *end != ' ' && *end != '\t') {
+            end++;
+        }
+    }
+    Face *f = new Face;
+    f->idx1 = idx[0];
+    f->idx2 = idx[1];
+    f->idx3 = idx[2];
+    faces.push_back(f);
+}
+
+static void parse_OBJ(Mesh_Data *mesh, std::string filename)
+{
+    // Opens the obj file and prepares to parse
+    if (filename.find(".obj") == std::string::npos) {
+        throw std::invalid_argument("File " + filename + " needs to be a .obj file.");
+    }
+    std::ifstream file(filename.c_str(), std::ifstream::in);
+    if (file.fail()) {
+        throw std::invalid_argument("Could not read obj file '" + filename + "'.");
+    }
+
+    // Reads the whole file and ends every line with a 0 instead of its newline
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<int> line_start(1, 0);
+    for (int c = 0; c < text.size(); c++) {
+        if (text[c] == '\n') {
+            text[c] = 0;
+            line_start.push_back(c + 1);
+        }
+    }
+    int num_lines = line_start.size();
+
+    // Parses chunks of lines into their own vertex and face lists
+    const int LINES = 4096;
+    int num_chunks = (num_lines + LINES - 1) / LINES;
+    std::vector< std::vector<Vertex *> > chunk_vertices(num_chunks);
+    std::vector< std::vector<Face *> > chunk_faces(num_chunks);
+    thread_pool().parallel_for(0, num_chunks, 1, [&](int c) {
+        int stop = std::min((c + 1) * LINES, num_lines);
+        for (int l = c * LINES; l < stop; l++) {
+            parse_OBJ_line(&text[line_start[l]], chunk_vertices[c], chunk_faces[c]);
+        }
+    });
+
+    // Initializes the mesh, 1-indexes its vertices and appends the chunks in order
+    mesh->vertices = new std::vector<Vertex *>();
+    mesh->faces = new std::vector<Face *>();
+    mesh->vertices->push_back(NULL);
+    for (int c = 0; c < num_chunks; c++) {
+        mesh->vertices->insert(mesh->vertices->end(), chunk_vertices[c].begin(),
+                               chunk_vertices[c].end());
+        mesh->faces->insert(mesh->faces->end(), chunk_faces[c].begin(), chunk_faces[c].end());
+    }
+}
+
+#endif
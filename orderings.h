@@ -0,0 +1,387 @@
+/* This header file contains the fill-reducing orderings of the direct
+ * solvers in linear_solvers.h. An ordering is a permutation of the vertices
+ * that the matrix is symmetrically permuted with before it is factorized;
+ * the fill-in of the factor depends heavily on it.
+ *
+ * Besides Eigen's natural, AMD and COLAMD orderings there is our own
+ * Nested_Dissection_Ordering. It splits the mesh graph into two halves with
+ * a vertex separator taken from a BFS level structure, orders both halves
+ * recursively and the separator last, so that the fill of the two halves
+ * never mixes. Small subgraphs are finished with AMD.
+ *
+ * All orderings follow Eigen's convention for AMDOrdering: perm.indices()(k)
+ * is the vertex eliminated k-th. compute_ordering picks one at run time and,
+ * for ORDERING_AUTO, the one with the smallest predicted Cholesky fill as
+ * counted by predict_fill.
+ */
+
+#ifndef ORDERINGS_H
+#define ORDERINGS_H
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Sparse>
+#include <Eigen/OrderingMethods>
+
+enum Ordering_Type { ORDERING_AUTO, ORDERING_NATURAL, ORDERING_AMD, ORDERING_COLAMD, ORDERING_ND };
+
+typedef Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> Ordering_Permutation;
+
+/* Nested dissection on the graph of a structurally symmetric matrix. Works
+ * as an Eigen ordering functor, so it can also be given to Eigen's solvers
+ * as their OrderingType.
+ */
+template <typename Index>
+class Nested_Dissection_Ordering
+{
+public:
+    typedef Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, Index> PermutationType;
+
+    // Subgraphs with at most this many vertices are ordered by AMD
+    static const int LEAF_SIZE = 200;
+
+    template <typename MatrixType>
+    void operator()(const MatrixType &mat, PermutationType &perm)
+    {
+        // Adjacency lists of the graph, without the diagonal
+        int n = mat.cols();
+        adj_start.assign(n + 1, 0);
+        adj.clear();
+        for (int j = 0; j < n; j++) {
+            for (typename MatrixType::InnerIterator it(mat, j); it; ++it) {
+                if (it.index() != j) {
+                    adj.push_back(it.index());
+                }
+            }
+            adj_start[j + 1] = adj.size();
+        }
+
+        region.assign(n, 0);
+        level.assign(n, -1);
+        next_region = 1;
+        order.clear();
+        order.reserve(n);
+
+        std::vector<int> all(n);
+        for (int i = 0; i < n; i++) {
+            all[i] = i;
+        }
+        dissect(all, 0);
+
+        perm.resize(n);
+        for (int k = 0; k < n; k++) {
+            perm.indices()(k) = order[k];
+        }
+    }
+
+private:
+    // Orders every connected component of the vertices in region id
+    void dissect(const std::vector<int> &vertices, int id)
+    {
+        std::vector<int> component;
+        for (int s = 0; s < vertices.size(); s++) {
+            if (region[vertices[s]] != id) {
+                continue;
+            }
+            int component_id = next_region++;
+            component.clear();
+            component.push_back(vertices[s]);
+            region[vertices[s]] = component_id;
+            for (int q = 0; q < component.size(); q++) {
+                int v = component[q];
+                for (int p = adj_start[v]; p < adj_start[v + 1]; p++) {
+                    if (region[adj[p]] == id) {
+                        region[adj[p]] = component_id;
+                        component.push_back(adj[p]);
+                    }
+                }
+            }
+            dissect_component(component, component_id);
+        }
+    }
+
+    // Splits a connected subgraph at a level of its BFS level structure
+    void dissect_component(const std::vector<int> &vertices, int id)
+    {
+        int size = vertices.size();
+        if (size <= LEAF_SIZE) {
+            order_leaf(vertices, id);
+            return;
+        }
+
+        // Finds a pseudo-peripheral root: the deepest level structure is
+        // rooted at a vertex of minimum degree in the last level of the
+        // previous one, until the depth stops growing
+        std::vector<int> bfs, level_start;
+        int root = vertices[0];
+        int depth = build_levels(root, id, bfs, level_start);
+        for (int pass = 0; pass < 8; pass++) {
+            int candidate = bfs[level_start[depth - 1]];
+            for (int q = level_start[depth - 1]; q < size; q++) {
+                if (degree(bfs[q]) < degree(candidate)) {
+                    candidate = bfs[q];
+                }
+            }
+            std::vector<int> next_bfs, next_level_start;
+            int next_depth = build_levels(candidate, id, next_bfs, next_level_start);
+            if (next_depth <= depth) {
+                break;
+            }
+            bfs.swap(next_bfs);
+            level_start.swap(next_level_start);
+            depth = next_depth;
+        }
+        if (depth < 3) {
+            order_leaf(vertices, id);
+            return;
+        }
+
+        // Picks the smallest level that leaves at least a quarter of the
+        // vertices on both sides, or the median level if none does
+        int separator = -1, median = -1;
+        for (int l = 1; l < depth - 1; l++) {
+            int below = level_start[l], above = size - level_start[l + 1];
+            int width = level_start[l + 1] - level_start[l];
+            if (median < 0 && level_start[l + 1] >= size / 2) {
+                median = l;
+            }
+            if (4 * below >= size && 4 * above >= size &&
+                    (separator < 0 || width < level_start[separator + 1] - level_start[separator])) {
+                separator = l;
+            }
+        }
+        if (separator < 0) {
+            separator = (median < 0) ? depth / 2 : median;
+        }
+
+        int id_a = next_region++, id_b = next_region++, id_s = next_region++;
+        for (int q = 0; q < size; q++) {
+            bool below = q < level_start[separator], above = q >= level_start[separator + 1];
+            region[bfs[q]] = below ? id_a : above ? id_b : id_s;
+        }
+
+        // Separator vertices that do not touch the far side are not needed
+        std::vector<int> part_a(bfs.begin(), bfs.begin() + level_start[separator]);
+        std::vector<int> part_b(bfs.begin() + level_start[separator + 1], bfs.end());
+        std::vector<int> separator_vertices;
+        for (int q = level_start[separator]; q < level_start[separator + 1]; q++) {
+            int v = bfs[q];
+            bool touches_b = false;
+            for (int p = adj_start[v]; p < adj_start[v + 1] && !touches_b; p++) {
+                touches_b = (region[adj[p]] == id_b);
+            }
+            if (touches_b) {
+                separator_vertices.push_back(v);
+            } else {
+                region[v] = id_a;
+                part_a.push_back(v);
+            }
+        }
+
+        dissect(part_a, id_a);
+        dissect(part_b, id_b);
+        order_leaf(separator_vertices, id_s);
+    }
+
+    /* Builds the BFS level structure of region id from root. bfs holds the
+     * vertices level by level, level l being [level_start[l], level_start[l + 1]).
+     * Returns the number of levels.
+     */
+    int build_levels(int root, int id, std::vector<int> &bfs, std::vector<int> &level_start)
+    {
+        bfs.clear();
+        level_start.assign(1, 0);
+        bfs.push_back(root);
+        level[root] = 0;
+        int depth = 0;
+        for (int q = 0; q < bfs.size(); q++) {
+            int v = bfs[q];
+            if (level[v] > depth) {
+                level_start.push_back(q);
+                depth = level[v];
+            }
+            for (int p = adj_start[v]; p < adj_start[v + 1]; p++) {
+                int u = adj[p];
+                if (region[u] == id && level[u] < 0) {
+                    level[u] = level[v] + 1;
+                    bfs.push_back(u);
+                }
+            }
+        }
+        level_start.push_back(bfs.size());
+
+        // Clears the levels so the region can be searched again
+        for (int q = 0; q < bfs.size(); q++) {
+            level[bfs[q]] = -1;
+        }
+        return depth + 1;
+    }
+
+    int degree(int v) const
+    {
+        return adj_start[v + 1] - adj_start[v];
+    }
+
+    // Appends the vertices of region id in the order AMD gives their subgraph
+    void order_leaf(const std::vector<int> &vertices, int id)
+    {
+        int size = vertices.size();
+        if (size == 0) {
+            return;
+        }
+        for (int q = 0; q < size; q++) {
+            level[vertices[q]] = q;
+        }
+
+        std::vector< Eigen::Triplet<double> > entries;
+        for (int q = 0; q < size; q++) {
+            int v = vertices[q];
+            entries.push_back(Eigen::Triplet<double>(q, q, 1));
+            for (int p = adj_start[v]; p < adj_start[v + 1]; p++) {
+                if (region[adj[p]] == id) {
+                    entries.push_back(Eigen::Triplet<double>(level[adj[p]], q, 1));
+                }
+            }
+        }
+        Eigen::SparseMatrix<double> sub(size, size);
+        sub.setFromTriplets(entries.begin(), entries.end());
+
+        Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> sub_perm;
+        Eigen::AMDOrdering<int> amd;
+        amd(sub, sub_perm);
+        for (int k = 0; k < size; k++) {
+            order.push_back(vertices[sub_perm.indices()(k)]);
+        }
+        for (int q = 0; q < size; q++) {
+            level[vertices[q]] = -1;
+        }
+    }
+
+    std::vector<int> adj_start, adj;
+    // Subgraph every vertex currently belongs to, and scratch space for
+    // BFS levels and local indices (-1 when unused)
+    std::vector<int> region, level;
+    int next_region;
+    std::vector<int> order;
+};
+
+/* Function prototypes */
+
+static const char *ordering_name(Ordering_Type ordering);
+
+template <typename Scalar>
+static long predict_fill(const Eigen::SparseMatrix<Scalar> &A, const Ordering_Permutation &perm);
+template <typename Scalar>
+static Ordering_Type compute_ordering(Ordering_Type ordering,
+                                      const Eigen::SparseMatrix<Scalar> &A,
+                                      Ordering_Permutation &perm);
+
+/* Function implementations */
+
+static const char *ordering_name(Ordering_Type ordering)
+{
+    switch (ordering) {
+        case ORDERING_AUTO:     return "auto";
+        case ORDERING_NATURAL:  return "natural";
+        case ORDERING_AMD:      return "amd";
+        case ORDERING_COLAMD:   return "colamd";
+        default:                return "nd";
+    }
+}
+
+/* Counts the nonzeros of the Cholesky factor L (diagonal included) of the
+ * symmetrically permuted A without computing it: builds the elimination tree
+ * and walks the row subtree of every row, which visits exactly the nonzeros
+ * of that row of L.
+ */
+template <typename Scalar>
+static long predict_fill(const Eigen::SparseMatrix<Scalar> &A, const Ordering_Permutation &perm)
+{
+    int n = A.cols();
+    Eigen::SparseMatrix<Scalar> C;
+    C = A.twistedBy(perm.inverse());
+
+    std::vector<int> parent(n, -1), ancestor(n, -1);
+    for (int k = 0; k < n; k++) {
+        for (typename Eigen::SparseMatrix<Scalar>::InnerIterator it(C, k); it; ++it) {
+            int i = it.index();
+            while (i != -1 && i < k) {
+                int next = ancestor[i];
+                ancestor[i] = k;
+                if (next == -1) {
+                    parent[i] = k;
+                }
+                i = next;
+            }
+        }
+    }
+
+    long fill = 0;
+    std::vector<int> mark(n, -1);
+    for (int k = 0; k < n; k++) {
+        mark[k] = k;
+        fill++;
+        for (typename Eigen::SparseMatrix<Scalar>::InnerIterator it(C, k); it; ++it) {
+            for (int i = it.index(); i < k && mark[i] != k; i = parent[i]) {
+                mark[i] = k;
+                fill++;
+            }
+        }
+    }
+    return fill;
+}
+
+/* Computes the given ordering of the structurally symmetric A. ORDERING_AUTO
+ * tries AMD, COLAMD and nested dissection and keeps the one with the least
+ * predicted fill. Returns the ordering that was used.
+ */
+template <typename Scalar>
+static Ordering_Type compute_ordering(Ordering_Type ordering,
+                                      const Eigen::SparseMatrix<Scalar> &A,
+                                      Ordering_Permutation &perm)
+{
+    switch (ordering) {
+        case ORDERING_NATURAL:
+            perm.setIdentity(A.cols());
+            break;
+        case ORDERING_AMD: {
+            Eigen::AMDOrdering<int> amd;
+            amd(A, perm);
+            break;
+        }
+        case ORDERING_COLAMD: {
+            // Eigen's COLAMD returns the new position of every vertex instead
+            Eigen::COLAMDOrdering<int> colamd;
+            Eigen::SparseMatrix<Scalar> compressed = A;
+            compressed.makeCompressed();
+            Ordering_Permutation positions;
+            colamd(compressed, positions);
+            perm = positions.inverse();
+            break;
+        }
+        case ORDERING_ND: {
+            Nested_Dissection_Ordering<int> nd;
+            nd(A, perm);
+            break;
+        }
+        default: {
+            Ordering_Type candidates[] = {ORDERING_AMD, ORDERING_COLAMD, ORDERING_ND};
+            long best_fill = -1;
+            for (int c = 0; c < 3; c++) {
+                Ordering_Permutation candidate;
+                compute_ordering(candidates[c], A, candidate);
+                long fill = predict_fill(A, candidate);
+                if (best_fill < 0 || fill < best_fill) {
+                    best_fill = fill;
+                    ordering = candidates[c];
+                    perm = candidate;
+                }
+            }
+            break;
+        }
+    }
+    return ordering;
+}
+
+#endif
@@ -0,0 +1,463 @@
+/* This header file contains the thread pool that the parallel parts of the
+ * smoothing code share. It only depends on the standard library (and on
+ * pthreads for pinning threads on Linux, and on the SSE control word).
+ *
+ * The pool keeps its worker threads alive between calls, because the loops
+ * it runs are short: one color class of a Gauss-Seidel sweep on a mesh of a
+ * few ten thousand vertices takes tens of microseconds, far less than
+ * starting a thread. The calling thread works on every loop too, so a pool
+ * of n threads has n - 1 workers, and a pool of one thread runs everything
+ * inline.
+ *
+ * parallel_for(begin, end, grain, body) calls body(i) for every i in
+ * [begin, end). Every thread starts on its own contiguous share of the range
+ * and works through it in chunks of grain indices from the front. A thread
+ * that runs out steals the back half of what is left of another thread's
+ * share, so uneven work, like the rows of vertices of very different
+ * valence or objects of different sizes, still keeps every thread busy,
+ * while each thread mostly touches consecutive indices.
+ *
+ * parallel_reduce(begin, end, grain, identity, body, combine) folds body(i,
+ * partial) over the range: every chunk of grain indices accumulates into its
+ * own partial, starting from identity, and the partials are combined in
+ * order afterwards, so the result is the same whatever the number of threads
+ * and whichever thread ran which chunk.
+ *
+ * parallel_tree(parent, body) calls body(v, thread) for every node v of a
+ * forest given by its parent array (-1 at the roots), always after the calls
+ * for all children of v, so independent subtrees run at the same time. Every
+ * thread keeps its ready nodes in its own deque: it pushes a parent that
+ * became ready and pops the newest node, which keeps it working up through
+ * the subtree it is in, while idle threads steal the oldest node of another
+ * thread's deque, which is the root of a subtree it will not get to soon.
+ * thread is the index of the calling thread in [0, size()), for per-thread
+ * scratch space.
+ *
+ * Calls from inside a loop body run serially on the calling thread.
+ *
+ * The workers run every loop with the floating-point control word of the
+ * calling thread, so a caller that flushes denormals to zero (see
+ * Flush_Denormals in linear_solvers.h) has them flushed on every thread.
+ *
+ * The pool counts the chunks and tree nodes its threads ran and how many of
+ * them were stolen (see stats), for the scheduler benchmark.
+ *
+ * The pool that everything uses is thread_pool(). Its size is set with
+ * set_num_threads, where 0 means one thread per hardware thread, and with
+ * pinning on worker t only runs on hardware thread t (modulo their number),
+ * so it keeps its caches; the calling thread is never pinned.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Work the threads of a pool did since its stats were last reset
+struct Scheduler_Stats
+{
+    // Chunks of parallel_for and parallel_reduce and nodes of parallel_tree
+    long tasks;
+    // Of those, the ones a thread took from another thread's share or deque
+    long steals;
+    // Loops that ran on the whole pool instead of inline
+    long loops;
+};
+
+class Thread_Pool
+{
+public:
+    explicit Thread_Pool(int num_threads, bool pin = false)
+        : generation(0), active(0), stopping(false), pin(pin)
+    {
+        for (int t = 1; t < std::max(num_threads, 1); t++) {
+            workers.push_back(std::thread(&Thread_Pool::work, this, t));
+            if (pin) {
+                pin_thread(workers.back(), t);
+            }
+        }
+        reset_stats();
+    }
+
+    ~Thread_Pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            generation++;
+        }
+        wake.notify_all();
+        for (int t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+    }
+
+    // Number of threads working on a loop, the calling one included
+    int size() const { return workers.size() + 1; }
+    // Whether the workers are pinned to hardware threads
+    bool pinned() const { return pin; }
+
+    Scheduler_Stats stats() const
+    {
+        Scheduler_Stats counted;
+        counted.tasks = tasks;
+        counted.steals = steals;
+        counted.loops = loops;
+        return counted;
+    }
+
+    void reset_stats()
+    {
+        tasks = 0;
+        steals = 0;
+        loops = 0;
+    }
+
+    template <typename Body>
+    void parallel_for(int begin, int end, int grain, const Body &body)
+    {
+        if (end - begin <= grain || workers.empty() || inside_loop()) {
+            for (int i = begin; i < end; i++) {
+                body(i);
+            }
+            return;
+        }
+
+        grain = std::max(grain, 1);
+        int num_shares = size();
+        std::vector<Range_Queue> shares(num_shares);
+        for (int t = 0; t < num_shares; t++) {
+            shares[t].begin = begin + (long) (end - begin) * t / num_shares;
+            shares[t].end = begin + (long) (end - begin) * (t + 1) / num_shares;
+        }
+
+        run_on_all([&](int thread) {
+            long chunks = 0, stolen = 0;
+            int start, stop;
+            while (true) {
+                if (!shares[thread].pop_front(grain, start, stop)) {
+                    if (!steal(shares, thread, grain)) {
+                        break;
+                    }
+                    stolen++;
+                    continue;
+                }
+                for (int i = start; i < stop; i++) {
+                    body(i);
+                }
+                chunks++;
+            }
+            tasks += chunks;
+            steals += stolen;
+        });
+    }
+
+    template <typename T, typename Body, typename Combine>
+    T parallel_reduce(int begin, int end, int grain, const T &identity, const Body &body,
+                      const Combine &combine)
+    {
+        grain = std::max(grain, 1);
+        int num_chunks = (std::max(end - begin, 0) + grain - 1) / grain;
+        std::vector<T> partials(num_chunks, identity);
+        parallel_for(0, num_chunks, 1, [&](int c) {
+            int stop = std::min(begin + (c + 1) * grain, end);
+            for (int i = begin + c * grain; i < stop; i++) {
+                body(i, partials[c]);
+            }
+        });
+
+        T result = identity;
+        for (int c = 0; c < num_chunks; c++) {
+            result = combine(result, partials[c]);
+        }
+        return result;
+    }
+
+    template <typename Body>
+    void parallel_tree(const std::vector<int> &parent, const Body &body)
+    {
+        int n = parent.size();
+        std::vector< std::atomic<int> > pending(n);
+        for (int v = 0; v < n; v++) {
+            pending[v] = 0;
+        }
+        for (int v = 0; v < n; v++) {
+            if (parent[v] >= 0) {
+                pending[parent[v]]++;
+            }
+        }
+
+        int num_queues = inside_loop() ? 1 : size();
+        std::vector<Task_Queue> queues(num_queues);
+        for (int v = 0, q = 0; v < n; v++) {
+            if (pending[v] == 0) {
+                queues[q].tasks.push_back(v);
+                q = (q + 1) % num_queues;
+            }
+        }
+
+        std::atomic<int> remaining(n);
+        auto schedule = [&](int thread) {
+            long nodes = 0, stolen = 0;
+            while (remaining > 0) {
+                int v = queues[thread].pop_newest();
+                for (int k = 1; v < 0 && k < num_queues; k++) {
+                    v = queues[(thread + k) % num_queues].pop_oldest();
+                    stolen += v >= 0;
+                }
+                if (v < 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                body(v, thread);
+                int p = parent[v];
+                if (p >= 0 && --pending[p] == 0) {
+                    queues[thread].push(p);
+                }
+                remaining--;
+                nodes++;
+            }
+            tasks += nodes;
+            steals += stolen;
+        };
+
+        if (num_queues == 1) {
+            schedule(0);
+        } else {
+            run_on_all(schedule);
+        }
+    }
+
+private:
+    // What is left of one thread's share of a parallel_for, on its own cache
+    // line so the owner taking chunks does not slow down the others
+    struct alignas(64) Range_Queue
+    {
+        std::mutex mutex;
+        int begin, end;
+
+        // Takes the next chunk of at most grain indices from the front
+        bool pop_front(int grain, int &start, int &stop)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (begin >= end) {
+                return false;
+            }
+            start = begin;
+            stop = std::min(begin + grain, end);
+            begin = stop;
+            return true;
+        }
+
+        // Gives up the back half of what is left, all of it if that is at
+        // most one chunk
+        bool split_back(int grain, int &start, int &stop)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (begin >= end) {
+                return false;
+            }
+            stop = end;
+            start = (end - begin <= grain) ? begin : begin + (end - begin) / 2;
+            end = start;
+            return true;
+        }
+    };
+
+    // Moves half of the share of the first other thread that has work left to
+    // thread's own, which is empty; returns false if there was none
+    static bool steal(std::vector<Range_Queue> &shares, int thread, int grain)
+    {
+        int num_shares = shares.size();
+        for (int k = 1; k < num_shares; k++) {
+            int start, stop;
+            if (shares[(thread + k) % num_shares].split_back(grain, start, stop)) {
+                std::lock_guard<std::mutex> lock(shares[thread].mutex);
+                shares[thread].begin = start;
+                shares[thread].end = stop;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void pin_thread(std::thread &thread, int index)
+    {
+#ifdef __linux__
+        int hardware = std::max((int) std::thread::hardware_concurrency(), 1);
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(index % hardware, &cpus);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+#endif
+    }
+
+    struct Task_Queue
+    {
+        std::mutex mutex;
+        std::deque<int> tasks;
+
+        void push(int v)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(v);
+        }
+
+        // Both return -1 if the queue is empty
+        int pop_newest()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty()) {
+                return -1;
+            }
+            int v = tasks.back();
+            tasks.pop_back();
+            return v;
+        }
+
+        int pop_oldest()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty()) {
+                return -1;
+            }
+            int v = tasks.front();
+            tasks.pop_front();
+            return v;
+        }
+    };
+
+    static bool &inside_loop()
+    {
+        static thread_local bool inside = false;
+        return inside;
+    }
+
+    // Runs task(thread) on every thread of the pool, the caller as thread 0,
+    // and returns once all of them are done
+    void run_on_all(const std::function<void(int)> &task)
+    {
+        loops++;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &task;
+#if defined(__SSE2__)
+            job_csr = _mm_getcsr();
+#endif
+            active = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+
+        inside_loop() = true;
+        task(0);
+        inside_loop() = false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return active == 0; });
+    }
+
+    void work(int thread)
+    {
+        long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return generation != seen; });
+                seen = generation;
+                if (stopping) {
+                    return;
+                }
+            }
+
+            inside_loop() = true;
+#if defined(__SSE2__)
+            unsigned int saved_csr = _mm_getcsr();
+            _mm_setcsr(job_csr);
+            (*job)(thread);
+            _mm_setcsr(saved_csr);
+#else
+            (*job)(thread);
+#endif
+            inside_loop() = false;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+
+    // The task of the current run_on_all
+    const std::function<void(int)> *job;
+#if defined(__SSE2__)
+    // and the floating-point control word of the thread that started it
+    unsigned int job_csr;
+#endif
+    // Bumped for every run_on_all, and the number of workers still inside it
+    long generation;
+    int active;
+    bool stopping;
+    bool pin;
+    std::atomic<long> tasks, steals, loops;
+};
+
+/* Function prototypes */
+
+static Thread_Pool &thread_pool();
+static void set_num_threads(int num_threads, bool pin = false);
+
+/* Function implementations */
+
+static Thread_Pool *&shared_pool()
+{
+    static Thread_Pool *pool = NULL;
+    return pool;
+}
+
+static Thread_Pool &thread_pool()
+{
+    if (!shared_pool()) {
+        set_num_threads(0);
+    }
+    return *shared_pool();
+}
+
+/* Replaces the shared pool with one of the given size (0 for one thread per
+ * hardware thread) and pinning. Must not be called while a loop is running.
+ */
+static void set_num_threads(int num_threads, bool pin)
+{
+    if (num_threads <= 0) {
+        num_threads = std::max((int) std::thread::hardware_concurrency(), 1);
+    }
+    if (shared_pool() && shared_pool()->size() == num_threads &&
+            shared_pool()->pinned() == pin) {
+        return;
+    }
+    delete shared_pool();
+    shared_pool() = new Thread_Pool(num_threads, pin);
+}
+
+#endif
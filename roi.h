@@ -0,0 +1,321 @@
+/* This header file contains implicit fairing restricted to a region of
+ * interest, for smoothing a patch like a scan artifact without touching the
+ * rest of the mesh, and with pinned vertices, like feet or mounting points,
+ * held where they are. It only depends on Eigen and laplacian.h.
+ *
+ * grow_region collects the vertices within k rings of some seed vertices by
+ * walking the slots of Mesh_Topology. The region's vertices are the only
+ * unknowns; every other vertex keeps its position, and the ring of them
+ * around the region enters the system as Dirichlet boundary values. Row i of
+ * the region system is the row of (M - hL) x_h = M x_0 from laplacian.h,
+ *
+ *     (M_i + h ∑_i~j op_j) x_i - h ∑_i~j,j in R (op_j * x_j)
+ *         = M_i x_0i + h ∑_i~j,j not in R (op_j * x_0j)
+ *
+ * so the matrix stays symmetric, and its size, the weights it needs and the
+ * cost of factorizing it all grow with the region instead of the mesh.
+ * Degenerate vertices inside the region are held in place like boundary
+ * ones.
+ *
+ * Pinned vertices are eliminated the same way: constrained_region takes them
+ * out of the unknowns, so they only add to the right-hand side of their
+ * neighbors' rows and the factorized system shrinks by one row and column
+ * per pin, instead of keeping their rows with a large penalty on the
+ * diagonal.
+ *
+ * Parts of the region that no edge between two unknowns connects do not
+ * couple either, so split_region breaks a region into those blocks, and a
+ * mesh of several shells into its connected components, to be solved as
+ * separate, smaller systems.
+ */
+
+#ifndef ROI_H
+#define ROI_H
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "laplacian.h"
+
+/* Function prototypes */
+
+static void grow_region(const Mesh_Topology &topo, const std::vector<int> &seeds, int rings,
+                        std::vector<int> &region);
+static void constrained_region(const Mesh_Topology &topo, const std::vector<int> &seeds,
+                               int rings, const std::vector<int> &pinned,
+                               std::vector<int> &region);
+static void split_region(const Mesh_Topology &topo, const std::vector<int> &region,
+                         std::vector< std::vector<int> > &blocks);
+
+/* Function implementations */
+
+/* The seeds and every vertex at most rings edges away from one, in
+ * increasing order. Throws invalid_argument naming a seed outside the mesh,
+ * numbered from 1 like the vertices of the .obj file.
+ */
+static void grow_region(const Mesh_Topology &topo, const std::vector<int> &seeds, int rings,
+                        std::vector<int> &region)
+{
+    std::vector<char> inside(topo.num_vertices, 0);
+    region.clear();
+    for (int s = 0; s < seeds.size(); s++) {
+        if (seeds[s] < 0 || seeds[s] >= topo.num_vertices) {
+            throw std::invalid_argument("region seed " + std::to_string(seeds[s] + 1) +
+                                        " is not a vertex of the mesh of " +
+                                        std::to_string(topo.num_vertices) + " vertices");
+        }
+        if (!inside[seeds[s]]) {
+            inside[seeds[s]] = 1;
+            region.push_back(seeds[s]);
+        }
+    }
+
+    // Breadth-first, one ring at a time
+    int ring_start = 0;
+    for (int ring = 0; ring < rings; ring++) {
+        int ring_end = region.size();
+        for (int r = ring_start; r < ring_end; r++) {
+            int i = region[r];
+            for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+                int j = topo.he_to[k];
+                if (!inside[j]) {
+                    inside[j] = 1;
+                    region.push_back(j);
+                }
+            }
+        }
+        ring_start = ring_end;
+    }
+    std::sort(region.begin(), region.end());
+}
+
+/* The unknowns of constrained smoothing: the region around the seeds, or the
+ * whole mesh if there are none, without the pinned vertices. Throws
+ * invalid_argument naming a seed or pinned vertex outside the mesh.
+ */
+static void constrained_region(const Mesh_Topology &topo, const std::vector<int> &seeds,
+                               int rings, const std::vector<int> &pinned,
+                               std::vector<int> &region)
+{
+    if (seeds.empty()) {
+        region.resize(topo.num_vertices);
+        for (int i = 0; i < topo.num_vertices; i++) {
+            region[i] = i;
+        }
+    } else {
+        grow_region(topo, seeds, rings, region);
+    }
+
+    std::vector<char> is_pinned(topo.num_vertices, 0);
+    for (int p = 0; p < pinned.size(); p++) {
+        if (pinned[p] < 0 || pinned[p] >= topo.num_vertices) {
+            throw std::invalid_argument("pinned vertex " + std::to_string(pinned[p] + 1) +
+                                        " is not a vertex of the mesh of " +
+                                        std::to_string(topo.num_vertices) + " vertices");
+        }
+        is_pinned[pinned[p]] = 1;
+    }
+    int kept = 0;
+    for (int r = 0; r < region.size(); r++) {
+        if (!is_pinned[region[r]]) {
+            region[kept++] = region[r];
+        }
+    }
+    region.resize(kept);
+}
+
+/* Splits a region (in increasing order) into the sets of its vertices that
+ * are connected through the region, each in increasing order, largest first.
+ * Their systems do not couple, so they can be solved independently; a whole
+ * mesh splits into its connected components.
+ */
+static void split_region(const Mesh_Topology &topo, const std::vector<int> &region,
+                         std::vector< std::vector<int> > &blocks)
+{
+    // Block of every vertex: -2 outside the region, -1 not reached yet
+    std::vector<int> block(topo.num_vertices, -2);
+    for (int r = 0; r < region.size(); r++) {
+        block[region[r]] = -1;
+    }
+    blocks.clear();
+    std::vector<int> pending;
+    for (int r = 0; r < region.size(); r++) {
+        if (block[region[r]] != -1) {
+            continue;
+        }
+        int b = blocks.size();
+        blocks.push_back(std::vector<int>(1, region[r]));
+        block[region[r]] = b;
+        pending.push_back(region[r]);
+        while (!pending.empty()) {
+            int i = pending.back();
+            pending.pop_back();
+            for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+                int j = topo.he_to[k];
+                if (block[j] == -1) {
+                    block[j] = b;
+                    blocks[b].push_back(j);
+                    pending.push_back(j);
+                }
+            }
+        }
+        std::sort(blocks[b].begin(), blocks[b].end());
+    }
+    std::stable_sort(blocks.begin(), blocks.end(),
+                     [](const std::vector<int> &a, const std::vector<int> &b) {
+                         return a.size() > b.size();
+                     });
+}
+
+/* The system of one generation over the region. Unknown r is mesh vertex
+ * vertices[r]; apply and assemble work on (m x 3) blocks of the unknowns,
+ * like Smoothing_System does on the whole mesh, so the direct backends of
+ * linear_solvers.h take it through their analyze_system, factorize_system
+ * and solve_system. Everything it stores is per unknown or per slot of an
+ * unknown, so many systems over small regions of one mesh stay small.
+ */
+template <typename Scalar>
+struct Region_System
+{
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, 1> Vector;
+
+    const Mesh_Topology *topo;
+    // Mesh vertex of every unknown, which must be in increasing order
+    std::vector<int> vertices;
+    // Slot range of every unknown (size m + 1), and per slot the unknown it
+    // points to (-1 outside the region) and its cotangent weight
+    std::vector<int> slot_start, neighbor;
+    std::vector<Scalar> weights;
+    // Lumped mass 2A_i of every unknown, and whether it is held in place
+    Vector mass;
+    std::vector<char> fixed;
+    Scalar h;
+    // The assembled matrix over the unknowns
+    Eigen::SparseMatrix<Scalar> matrix;
+
+    Region_System() : topo(NULL), h(0) {}
+
+    /* Recomputes the rows of the region for the given positions of the whole
+     * mesh. Only the region's rows are touched, but a different region (or
+     * mesh) first rebuilds the map between unknowns and vertices.
+     */
+    void assign(const Mesh_Topology &topology, const std::vector<int> &region,
+                const Positions<Scalar> &pos, Scalar time_step)
+    {
+        if (topo != &topology || vertices != region) {
+            set_region(topology, region);
+        }
+        h = time_step;
+
+        int m = vertices.size();
+        for (int r = 0; r < m; r++) {
+            Scalar area = compute_cot_row(topology, pos, vertices[r], weights.data() + slot_start[r]);
+            fixed[r] = degenerate_area(area);
+            mass(r) = fixed[r] ? Scalar(1) : 2 * area;
+        }
+
+        // Every slot between two unknowns gets an entry, zero if one of them
+        // is held, so the pattern only depends on the region
+        std::vector< Eigen::Triplet<Scalar> > entries;
+        entries.reserve(neighbor.size() + m);
+        for (int r = 0; r < m; r++) {
+            Scalar diag = mass(r);
+            for (int s = slot_start[r]; s < slot_start[r + 1]; s++) {
+                int c = neighbor[s];
+                if (!fixed[r]) {
+                    diag += h * weights[s];
+                }
+                if (c >= 0) {
+                    bool free_edge = !fixed[r] && !fixed[c];
+                    entries.push_back(Eigen::Triplet<Scalar>(r, c, free_edge ? -h * weights[s]
+                                                                             : Scalar(0)));
+                }
+            }
+            entries.push_back(Eigen::Triplet<Scalar>(r, r, diag));
+        }
+        matrix.resize(m, m);
+        matrix.setFromTriplets(entries.begin(), entries.end());
+    }
+
+    // Y = A X over the unknowns
+    void apply(const Positions<Scalar> &X, Positions<Scalar> &Y) const
+    {
+        Y = matrix * X;
+    }
+
+    /* Right-hand side M x_0 of the unknowns, plus the couplings of free
+     * unknowns to the boundary and to held unknowns, from the positions of
+     * the whole mesh
+     */
+    void rhs(const Positions<Scalar> &pos, Positions<Scalar> &B) const
+    {
+        int m = vertices.size();
+        B.resize(m, 3);
+        for (int r = 0; r < m; r++) {
+            int i = vertices[r];
+            B.row(r) = mass(r) * pos.row(i);
+            if (fixed[r]) {
+                continue;
+            }
+            for (int s = slot_start[r]; s < slot_start[r + 1]; s++) {
+                if (neighbor[s] < 0 || fixed[neighbor[s]]) {
+                    int j = topo->he_to[topo->out_start[i] + s - slot_start[r]];
+                    B.row(r) += h * weights[s] * pos.row(j);
+                }
+            }
+        }
+    }
+
+    const Eigen::SparseMatrix<Scalar> &assemble() const
+    {
+        return matrix;
+    }
+
+    // Copies the positions of the unknowns out of and back into the whole mesh's
+    void gather(const Positions<Scalar> &pos, Positions<Scalar> &X) const
+    {
+        X.resize(vertices.size(), 3);
+        for (int r = 0; r < vertices.size(); r++) {
+            X.row(r) = pos.row(vertices[r]);
+        }
+    }
+
+    void scatter(const Positions<Scalar> &X, Positions<Scalar> &pos) const
+    {
+        for (int r = 0; r < vertices.size(); r++) {
+            pos.row(vertices[r]) = X.row(r);
+        }
+    }
+
+private:
+    // The unknown of a neighbor is found by binary search in the sorted
+    // vertices, so setting up a small region never touches the whole mesh
+    void set_region(const Mesh_Topology &topology, const std::vector<int> &region)
+    {
+        topo = &topology;
+        vertices = region;
+        int m = vertices.size();
+        slot_start.assign(1, 0);
+        neighbor.clear();
+        for (int r = 0; r < m; r++) {
+            int i = vertices[r];
+            for (int k = topology.out_start[i]; k < topology.out_start[i + 1]; k++) {
+                std::vector<int>::const_iterator found =
+                    std::lower_bound(vertices.begin(), vertices.end(), topology.he_to[k]);
+                bool inside = found != vertices.end() && *found == topology.he_to[k];
+                neighbor.push_back(inside ? int(found - vertices.begin()) : -1);
+            }
+            slot_start.push_back(neighbor.size());
+        }
+        weights.resize(neighbor.size());
+        mass.resize(m);
+        fixed.resize(m);
+    }
+};
+
+#endif
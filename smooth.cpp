@@ -72,9 +72,12 @@
 using Eigen::Vector3f;
 using Eigen::Matrix4f;
 
-/* Local libraries for half edge */
+/* Local libraries for half edge, obj parsing and smoothing */
 #include "structs.h"
 #include "halfedge.h"
+#include "obj_io.h"
+#include "smoothing.h"
+#include "history.h"
 
 using namespace std;
 
@@ -101,6 +104,13 @@ void mouse_moved(int x, int y);
 void key_pressed(unsigned char key, int x, int y);
 
 void parseFormatFile(string filename);
+void parseSmoothingOptions(ifstream &file);
+
+void smoothNextFrame(int rate);
+void resumeSmoothing();
+void publishPending();
+void scrubHistory(int steps);
+void pickRegion(int x, int y);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -241,6 +251,23 @@ struct Object
     Mesh_Data *mesh;
     vector<HEV *> *hevs; // normals stored here
     vector<HEF *> *hefs;
+
+    Smoother *smoother; // created on the first smoothing generation
+    // Connectivity and original bounding box diagonal, area and volume for the generation metrics
+    Mesh_Topology topology;
+    double diagonal, area, volume;
+    // Vertices (0-based) picked with the right mouse button that smoothing is restricted to the
+    // rings around, empty for the whole mesh or the roi option
+    vector<int> roi_seeds;
+    // The positions the buffers were last built from, and whether hevs and mesh hold a newer
+    // generation whose normals and buffers are still to be built (see smoothNextFrame)
+    Positions<double> shown;
+    bool pending;
+    // Whether hevs and mesh hold a finished generation rather than an iterate of an anytime
+    // solve, which may move little without the mesh having stopped changing
+    bool settled;
+    // The generations shown so far, oldest first, to scrub back through (see scrubHistory)
+    Generation_History history;
     
     vector<Instance> instances;
 };
@@ -253,12 +280,34 @@ struct Object
 const char start_smoothing_key = ' ';
 // The manually set time in milliseconds between each smoothing frame
 static const int FRAME_RATE = 1000;
-// The number of non-zero rows to reserve in our Sparse Operator Matrix
-static const int SPARSE_NONZERO_RESERVE = 7;
 // Tracks if the smoothing has started via the press of the key indicated by start_smoothing_key
 bool started_smoothing = false;
+// Set when every object stopped changing and the timer was not rescheduled; changing h or the
+// mesh resumes it
+bool smoothing_idle = false;
 // Time step given by the user that controls the speed of the smoothing 
 float time_step_h;
+// The keys that halve and double the amount of smoothing methods that can jump
+// straight to it (--method spectral) show, and that amount as a total time
+const char less_smoothing_key = '[', more_smoothing_key = ']';
+double smoothness = 0;
+// The keys that double and halve h
+const char larger_step_key = '+', smaller_step_key = '-';
+// The key that clears the picked regions of interest, and how close in pixels a right click has to
+// be to a vertex to pick it
+const char clear_region_key = 'c';
+static const double PICK_RADIUS = 10;
+// The keys that show the generation before and after the one shown, and that jump 10 back and
+// forth, and how many generations behind the newest one the shown ones are
+const char earlier_generation_key = ',', later_generation_key = '.';
+const char much_earlier_generation_key = '<', much_later_generation_key = '>';
+int history_offset = 0;
+// Set when the timer was not rescheduled because an older generation is shown
+bool smoothing_scrubbed = false;
+// Optional settings given by the user that control how the smoothing is computed
+Smoothing_Options smoothing_options = default_smoothing_options();
+// The settings given on the command line, which override the scene file's
+vector<pair<string, string> > command_line_options;
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -906,6 +955,34 @@ void set_lights()
     }
 }
 
+/* Multiplies the Modelview Matrix by the transformations of an object instance, in REVERSE order
+ * because OpenGL uses post matrix multiplication.
+ */
+void applyTransforms(const Instance &inst)
+{
+    int num_transforms = inst.transforms.size();
+    for (int transformIdx = num_transforms - 1; transformIdx >= 0; --transformIdx)
+    {
+        switch(inst.transforms[transformIdx].type) {
+            case translation :
+                glTranslatef(inst.transforms[transformIdx].data[0],
+                        inst.transforms[transformIdx].data[1],
+                        inst.transforms[transformIdx].data[2]);
+                break;
+            case rotation :
+                glRotatef(inst.transforms[transformIdx].data[3],
+                        inst.transforms[transformIdx].data[0],
+                        inst.transforms[transformIdx].data[1],
+                        inst.transforms[transformIdx].data[2]);
+                break;
+            case scaling :
+                glScalef(inst.transforms[transformIdx].data[0],
+                        inst.transforms[transformIdx].data[1],
+                        inst.transforms[transformIdx].data[2]);
+        }
+    }
+}
+
 /* 'draw_objects' function:
  *
  * This function has OpenGL render our objects to the display screen.
@@ -972,30 +1049,7 @@ void draw_objects()
             for (int instanceIdx = 0; instanceIdx < num_instances; ++instanceIdx)
             {
                 Instance &inst = obj.instances[instanceIdx];
-                int num_transforms = inst.transforms.size();
-
-                /* Applies the transformations in REVERSE order because OpenGL uses
-                 * post matrix multiplication. */
-                for (int transformIdx = num_transforms - 1; transformIdx >= 0; --transformIdx)
-                {
-                    switch(inst.transforms[transformIdx].type) {
-                        case translation :
-                            glTranslatef(inst.transforms[transformIdx].data[0],
-                                    inst.transforms[transformIdx].data[1],
-                                    inst.transforms[transformIdx].data[2]);
-                            break;
-                        case rotation :
-                            glRotatef(inst.transforms[transformIdx].data[3],
-                                    inst.transforms[transformIdx].data[0],
-                                    inst.transforms[transformIdx].data[1],
-                                    inst.transforms[transformIdx].data[2]);
-                            break;
-                        case scaling :
-                            glScalef(inst.transforms[transformIdx].data[0],
-                                    inst.transforms[transformIdx].data[1],
-                                    inst.transforms[transformIdx].data[2]);
-                    }
-                }
+                applyTransforms(inst);
             
                 /* The 'glMaterialfv' and 'glMaterialf' functions tell OpenGL
                 * the material properties of the surface we want to render.
@@ -1169,6 +1223,12 @@ void mouse_pressed(int button, int state, int x, int y)
          */
         is_pressed = false;
     }
+
+    // A right click picks the vertex under the mouse as the center of a region of interest
+    else if(button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN)
+    {
+        pickRegion(x, y);
+    }
 }
 
 /* 'mouse_moved' function:
@@ -1200,6 +1260,78 @@ void mouse_moved(int x, int y)
 }
 
 
+/* Picks the vertex closest to the camera among those drawn within PICK_RADIUS pixels of the
+ * screen coordinates (x, y), and restricts the smoothing of its object to the rings around it and
+ * the vertices picked before. The vertices are projected with the same transformations display
+ * and draw_objects render them with.
+ */
+void pickRegion(int x, int y)
+{
+    if (smoothing_options.method != METHOD_IMPLICIT) {
+        cout << "only --method implicit smooths a picked region" << endl;
+        return;
+    }
+    if (smoothing_options.frame_budget > 0) {
+        cout << "--frame_budget always smooths the whole mesh" << endl;
+        return;
+    }
+    GLdouble projection[16], modelview[16];
+    GLint viewport[4];
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glPushMatrix();
+    glLoadIdentity();
+    glRotatef(y_view_angle, 1, 0, 0);
+    glRotatef(x_view_angle, 0, 1, 0);
+    glRotatef(-cam_orientation_angle,
+              cam_orientation_axis[0], cam_orientation_axis[1], cam_orientation_axis[2]);
+    glTranslatef(-cam_position[0], -cam_position[1], -cam_position[2]);
+    applyArcBallRotation();
+
+    Object *picked = NULL;
+    int picked_vertex = -1;
+    double picked_depth = 1;
+    for (map<string, Object>::iterator obj_iter = objects.begin(); 
+                                    obj_iter != objects.end(); obj_iter++) {
+        Object &obj = obj_iter->second;
+        glPushMatrix();
+        for (int instanceIdx = 0; instanceIdx < obj.instances.size(); ++instanceIdx) {
+            applyTransforms(obj.instances[instanceIdx]);
+            glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+            for (int i = 1; i < obj.hevs->size(); i++) {
+                HEV *v = obj.hevs->at(i);
+                GLdouble win_x, win_y, win_z;
+                gluProject(v->x, v->y, v->z, modelview, projection, viewport,
+                           &win_x, &win_y, &win_z);
+                // Window y grows upwards, mouse y downwards
+                double dx = win_x - x, dy = (viewport[3] - win_y) - y;
+                if (dx * dx + dy * dy <= PICK_RADIUS * PICK_RADIUS && win_z < picked_depth) {
+                    picked = &obj;
+                    picked_vertex = i - 1;
+                    picked_depth = win_z;
+                }
+            }
+        }
+        glPopMatrix();
+    }
+    glPopMatrix();
+
+    if (picked == NULL) {
+        cout << "no vertex under the mouse" << endl;
+        return;
+    }
+    // The smoother is rebuilt with the new region on the next generation
+    picked->roi_seeds.push_back(picked_vertex);
+    delete picked->smoother;
+    picked->smoother = NULL;
+    cout << "picked vertex " << picked_vertex + 1 << ", smoothing the "
+         << smoothing_options.roi_rings << " rings around " << picked->roi_seeds.size()
+         << " picked vertices" << endl;
+    resumeSmoothing();
+}
+
+
 /* 'deg2rad' function:
  * 
  * Converts given angle in degrees to radians.
@@ -1282,45 +1414,37 @@ Vec3f *calculateVertexNormal(HEV *vertex)
  * Note: Assumes vertex positions in obj.mesh->vertices are updated prior.
  */
 void computeNormalsUpdateBuffers(Object &obj) {
-    // Computes and stores all the area-weighted vertex normals
-    for (int vIdx = 1; vIdx < obj.hevs->size(); vIdx++) {
+    // Vertices and faces per task of the shared pool
+    const int GRAIN = 1024;
+
+    // Computes and stores all the area-weighted vertex normals, each vertex
+    // only reading the positions around it
+    thread_pool().parallel_for(1, obj.hevs->size(), GRAIN, [&](int vIdx) {
         HEV *hev = obj.hevs->at(vIdx);
         Vec3f *normal = calculateVertexNormal(hev);
         hev->normal = *normal;
-    }
+        delete normal;
+    });
 
-    // Clears the vertex and normal buffers 
-    obj.vertex_buffer.clear();
-    obj.normal_buffer.clear();
+    // Sizes the vertex and normal buffers for three entries per face
+    int num_faces = obj.mesh->faces->size();
+    obj.vertex_buffer.resize(3 * num_faces);
+    obj.normal_buffer.resize(3 * num_faces);
     
     // Populates normal and vertex buffers using our mesh data and computed normals
-    for (int fIdx = 0; fIdx < obj.mesh->faces->size(); fIdx++) {
+    thread_pool().parallel_for(0, num_faces, GRAIN, [&](int fIdx) {
         Face *f = obj.mesh->faces->at(fIdx);
 
-        // First Vertex of the Face 
-        Vertex *v1 = obj.mesh->vertices->at(f->idx1);
-        obj.vertex_buffer.push_back(*v1);
+        // The three Vertices of the Face 
+        obj.vertex_buffer[3 * fIdx] = *obj.mesh->vertices->at(f->idx1);
+        obj.vertex_buffer[3 * fIdx + 1] = *obj.mesh->vertices->at(f->idx2);
+        obj.vertex_buffer[3 * fIdx + 2] = *obj.mesh->vertices->at(f->idx3);
 
-        // Second Vertex of the Face 
-        Vertex *v2 = obj.mesh->vertices->at(f->idx2);
-        obj.vertex_buffer.push_back(*v2);
-
-        // Third Vertex of the Face 
-        Vertex *v3 = obj.mesh->vertices->at(f->idx3);
-        obj.vertex_buffer.push_back(*v3);
-
-        // First Normal of the Face 
-        Vec3f n1 = obj.hevs->at(f->idx1)->normal;
-        obj.normal_buffer.push_back(n1);
-
-        // Second Normal of the Face 
-        Vec3f n2 = obj.hevs->at(f->idx2)->normal;
-        obj.normal_buffer.push_back(n2);
-
-        // Third Normal of the Face 
-        Vec3f n3 = obj.hevs->at(f->idx3)->normal;
-        obj.normal_buffer.push_back(n3);
-    }
+        // The three Normals of the Face 
+        obj.normal_buffer[3 * fIdx] = obj.hevs->at(f->idx1)->normal;
+        obj.normal_buffer[3 * fIdx + 1] = obj.hevs->at(f->idx2)->normal;
+        obj.normal_buffer[3 * fIdx + 2] = obj.hevs->at(f->idx3)->normal;
+    });
 }
 
 
@@ -1337,45 +1461,9 @@ void splitBySpace(string s, vector<string> &split)
 
 void parseObjFile(string filename, Object &obj)
 {
-    // Opens the obj file and prepares to parse
-    if (filename.find(".obj") == -1) {
-        throw invalid_argument("File " + filename + " needs to be a .obj file.");
-    }
-    string buffer;
-    ifstream file;
-    file.open(filename.c_str(), ifstream::in);
-    if (file.fail()) {
-        string msg = "Could not read obj file '" + filename + "'.";
-        throw invalid_argument(msg);
-    }
-
-    // Initializes the mesh and 1-indexes its vertices
-    obj.mesh = new Mesh_Data;
-    obj.mesh->vertices = new vector<Vertex *>();
-    obj.mesh->faces = new vector<Face *>();
-    obj.mesh->vertices->push_back(NULL);
-
     // Reads in the vertices and faces into the object's mesh
-    int count = 1;
-    vector<string> element;
-    while (getline(file, buffer)) {
-        element.clear();
-        splitBySpace(buffer, element);
-
-        // Parses the line as a vertex
-        if (element[0] == "v") {
-            Vertex *vert = new Vertex;
-            *vert = {stof(element[1]), stof(element[2]), stof(element[3])};
-            obj.mesh->vertices->push_back(vert);
-
-            continue;
-        } 
-
-        /* If not a vertex, parses the line as a face */
-        Face *f = new Face;
-        *f = {stoi(element[1]), stoi(element[2]), stoi(element[3])};
-        obj.mesh->faces->push_back(f);
-    }
+    obj.mesh = new Mesh_Data;
+    parse_OBJ(obj.mesh, filename);
 
     // Builds the halfedge structures
     obj.hevs = new vector<HEV *>();
@@ -1387,11 +1475,13 @@ void parseObjFile(string filename, Object &obj)
         obj.hevs->at(vIdx)->index = vIdx;
     }
 
+    // The smoother is built lazily once all smoothing options are known
+    obj.smoother = NULL;
+    obj.pending = false;
+    obj.settled = true;
+
     // Computes vertex normals and populate vertex and normal buffers
     computeNormalsUpdateBuffers(obj);
-
-    // Closes the file once done
-    file.close();
 }
 
 /** 
@@ -1514,6 +1604,10 @@ void parseFormatFile(string filename)
          * We make a instance and set a new instanceIndex to prepare 
          * for processing.
          */
+        if (currObj == NULL && line.size() > 0 && line[0] == "smoothing:") {
+            parseSmoothingOptions(file);
+            continue;
+        }
         if (currObj == NULL) {
             currObj = &objects[line[0]];
             instanceIdx = currObj->instances.size();
@@ -1572,13 +1666,30 @@ void parseFormatFile(string filename)
 }
 
 
-// Computes the cotangent of the angle vB vAngle vC using Eigen.
-float cotan(Vector3f &vAngle, Vector3f &vB, Vector3f &vC) {
-    Vector3f rayAngleB = vB - vAngle;
-    Vector3f rayAngleC = vC - vAngle;
-    return (rayAngleB).dot(rayAngleC) / (rayAngleB).cross(rayAngleC).norm();
-}
+/* Reads the optional smoothing block of the format file, which may appear
+ * between object instances:
+ *      smoothing:
+ *      [option] [value]
+ *      ...
+ * with the same options as the command line (without the leading "--").
+ * The block ends at the next empty line.
+ */
+void parseSmoothingOptions(ifstream &file)
+{
+    string buffer;
+    vector<string> line;
+    while (getline(file, buffer)) {
+        line.clear();
+        splitBySpace(buffer, line);
 
+        if (line.size() == 0) {
+            break;
+        }
+        if (line.size() != 2 || !set_smoothing_option(smoothing_options, line[0], line[1])) {
+            throw invalid_argument("Invalid smoothing option '" + buffer + "'.");
+        }
+    }
+}
 
 
 bool is_decimal(float num) {
@@ -1586,172 +1697,277 @@ bool is_decimal(float num) {
 }
 
 
+// Copies the positions in obj.hevs into the float copies used for rendering
+void updateMeshVertices(Object &obj) {
+    for (int i = 1; i < obj.hevs->size(); i++) {
+        HEV *v_i = obj.hevs->at(i);
+        *obj.mesh->vertices->at(i) = {(float) v_i->x, (float) v_i->y, (float) v_i->z};
+    }
+}
 
-/* Constructs the matrix operator F = (I − hΔ) to smooth the object.
- * Note: Assumes HE structures are already built and the vertices are already indexed.
- */
-Eigen::SparseMatrix<float> build_F_operator(Object &obj) {
-    // Saves the number of vertices, accounting for our 1-indexing of the vertices
-    int num_vertices = obj.hevs->size() - 1;
 
-    // Initializes a sparse matrix to represent the operator matrix Δ
-    Eigen::SparseMatrix<float> op_matrix(num_vertices, num_vertices);
+// Copies the smoother's positions into obj.hevs and the float copies used for rendering
+void storeSmoothing(Object &obj) {
+    obj.smoother->store(obj.hevs);
+    obj.settled = obj.smoother->settled();
+    updateMeshVertices(obj);
+}
 
-    // Reserves room for non-zeros entries in each row of our Sparse Matrix
-    op_matrix.reserve( Eigen::VectorXi::Constant(num_vertices, SPARSE_NONZERO_RESERVE) );
 
-    // Loops over all vertices where obj.hevs->at(i) is our vertex v_i
-    for (int i = 1; i < obj.hevs->size(); i++) {
-        HEV *v_i = obj.hevs->at(i);
-        Vector3f v_i_pos(v_i->x, v_i->y, v_i->z);
-
-        // Accumulates the area of all the adjacent triangle faces to our current vertex
-        float incident_area = 0;
-
-        // Accumulates the total cotangent sum for all adjacent vertices to be the coefficient of v_i
-        float total_cot_total = 0;
-
-        // Iterates over all vertices v_j adjacent to v_i
-        HE *curr_he = obj.hevs->at(i)->out;
-        HE *he = curr_he;
-        do {
-            // Gets the current v_j vertex, its index j, and its position
-            HEV *v_j = he->next->vertex;
-            int j = v_j->index;
-            Vector3f v_j_pos(v_j->x, v_j->y, v_j->z);
-
-            // Gets the vertices corresponding to alpha and beta and their positions
-            HEV *v_across_same_face = he->next->next->vertex;
-            HEV *v_across_flip_face = he->flip->next->next->vertex;
-            Vector3f v_across_same_pos (v_across_same_face->x, 
-                                        v_across_same_face->y, 
-                                        v_across_same_face->z);
-            Vector3f v_across_flip_pos (v_across_flip_face->x, 
-                                        v_across_flip_face->y, 
-                                        v_across_flip_face->z);
-
-            // Computes the cotangent of the angle vB vAngle vC using Eigen
-            float cot_alpha = cotan(v_across_same_pos, v_i_pos, v_j_pos);
-            float cot_beta = cotan(v_across_flip_pos, v_i_pos, v_j_pos);
-            float total_cot = cot_alpha + cot_beta;
-
-            // Fills the j-th slot of row i with the coefficient for v_j
-            op_matrix.insert(i - 1, j - 1) = total_cot;
-
-            // Accumulates total_cot to be the (i, i) coefficient for v_i once accumulated
-            total_cot_total += total_cot;
-            
-            // Computes and accumulates the area of the face 
-            {
-                // Computes the normal of the plane of the face
-                Vector3f face_normal = (v_j_pos - v_i_pos).cross(v_across_same_pos - v_i_pos);
-                
-                // Computes the area of the triangular face
-                float face_area = 0.5 * face_normal.norm();
+// Adds the generation in obj.shown to the object's history, unless it keeps none
+void recordHistory(Object &obj) {
+    if (smoothing_options.history_memory > 0) {
+        obj.history.push(obj.shown);
+    }
+}
 
-                // Accumulates the area of the face
-                incident_area += face_area;
-            }
 
-            // Traverses to the he of the next adjacent vertex
-            he = he->flip->next;
+/* Builds the smoother of an object before its first generation (or after its region changed),
+ * and the original measures the generation metrics are relative to. Must not run on the task
+ * pool, because making a smoother may resize it.
+ */
+void prepareSmoothing(Object &obj) {
+    if (obj.smoother == NULL) {
+        // Picked vertices take the place of the roi option
+        Smoothing_Options options = smoothing_options;
+        if (!obj.roi_seeds.empty()) {
+            options.roi_seeds = obj.roi_seeds;
         }
-        while (he != curr_he);
+        obj.smoother = make_smoother(obj.hevs, options);
+    }
+    if (obj.topology.out_start.empty()) {
+        Positions<double> original;
+        gather_positions(obj.hevs, original);
+        build_topology(obj.hevs, obj.topology);
+        obj.diagonal = (original.colwise().maxCoeff() - original.colwise().minCoeff()).norm();
+        measure_surface(obj.topology, original, obj.area, obj.volume);
+        obj.shown = original;
+
+        // Quantization errors stay below a millionth of the diagonal
+        obj.history = Generation_History((size_t) (smoothing_options.history_memory * (1 << 20)),
+                                         smoothing_options.history_keyframes, 1e-6 * obj.diagonal);
+        recordHistory(obj);
+    }
+}
 
-        // Sets all coefficients for v_i and all v_j to 0 if we have a degenerate region
-        if (close_to_zero(incident_area)) {
-            op_matrix.row(i - 1) *= 0;
-            continue;
-        }
 
-        // Fills the i-th slot of row i with the accumulated coefficient for v_i
-        op_matrix.insert(i - 1, i - 1) = -1.0 * total_cot_total;
+/* Smoothes a given prepared object by one generation inside its smoother and logs the time
+ * step adaptive time stepping picked to log. Only touches the smoother, so it can run while the
+ * buffers of the generation before are built from obj.hevs and obj.mesh.
+ * Note: The new vertex positions still need storing with storeSmoothing.
+ */
+void computeSmoothing(Object &obj, ostream &log) {
+    obj.smoother->step(time_step_h);
+
+    Adaptive_Stepper *adaptive = dynamic_cast<Adaptive_Stepper *>(obj.smoother);
+    if (adaptive != NULL) {
+        log << "generation " << adaptive->steps.size() << ": h " << adaptive->steps.back()
+            << ", total time " << adaptive->elapsed << ", " << adaptive->rejections
+            << " steps retried" << endl;
+    }
 
-        // Updates all coefficients now that incident area has been accumulated
-        op_matrix.row(i - 1) /= (2.0 * incident_area);
+    // Logs how the frame budget of anytime smoothing went
+    Anytime_Stepper *anytime = dynamic_cast<Anytime_Stepper *>(obj.smoother);
+    if (anytime != NULL) {
+        log << "frame " << anytime->frame_ms.back() << " ms of " << smoothing_options.frame_budget
+            << ": " << anytime->last_iterations << " iterations, " << anytime->generations
+            << " generations done, residual " << anytime->last_stats.residual << endl;
     }
+}
 
-    // Tells Eigen to more efficiently store our Sparse Matrix
-    op_matrix.makeCompressed();
-    
 
-    // Initializes a sparse matrix to represent the matrix operator F = (I − hΔ)
-    Eigen::SparseMatrix<float> opF(num_vertices, num_vertices);
+/* Builds the normals and buffers of the generation stored in obj.hevs and obj.mesh, logs how
+ * much it changed the mesh since the buffers were last built to log and returns whether it has
+ * stopped changing. Does not touch the smoother.
+ */
+bool publishSmoothing(Object &obj, ostream &log) {
+    Positions<double> after;
+    gather_positions(obj.hevs, after);
+    Generation_Metrics metrics = measure_generation(obj.topology, obj.shown, after,
+                                                    obj.diagonal, obj.area, obj.volume);
+    log << "moved max " << metrics.max_displacement << ", rms " << metrics.rms_displacement
+        << "; area change " << metrics.area_change << ", volume change "
+        << metrics.volume_change << endl;
+    obj.shown.swap(after);
+    obj.pending = false;
+    recordHistory(obj);
 
-    // Reserves room for non-zeros entries in each row of our Sparse Matrix
-    opF.reserve( Eigen::VectorXi::Constant(num_vertices, SPARSE_NONZERO_RESERVE) );
+    computeNormalsUpdateBuffers(obj);
+    return obj.settled && converged(metrics, smoothing_options.idle_tol);
+}
 
-    // Uses operator matrix Δ to calculate matrix operator F = (I − hΔ)
-    opF = Eigen::MatrixXf::Identity(num_vertices, num_vertices).sparseView() - (time_step_h * op_matrix);
 
-    // Tells Eigen to more efficiently store our Sparsssssssssssssssse Matrix
-    opF.makeCompressed();
-    
-    return opF;
+/* Shows every object smoothed by the given total time, if the smoothing method can jump there
+ * directly. Returns false if it cannot.
+ */
+bool jumpSmoothing(double amount) {
+    if (history_offset > 0) {
+        scrubHistory(history_offset);
+    }
+    for (map<string, Object>::iterator obj_iter = objects.begin(); 
+                                    obj_iter != objects.end(); obj_iter++) {
+        Object &obj = objects[obj_iter->first];
+        prepareSmoothing(obj);
+        if (!obj.smoother->jump_to(amount)) {
+            return false;
+        }
+        storeSmoothing(obj);
+        computeNormalsUpdateBuffers(obj);
+        gather_positions(obj.hevs, obj.shown);
+        obj.pending = false;
+        recordHistory(obj);
+    }
+    glutPostRedisplay();
+    resumeSmoothing();
+    return true;
 }
 
 
-/* Smoothes a given object by one generation.
- * Note: Only updates vertex positions within obj.hevs, normals and buffers still need updating.
+/* Smoothes and displays the next frame at a set regular rate. Every object's generation, normals
+ * and buffers are independent tasks on the shared pool; the logs are printed and the new
+ * buffers drawn once all of them are done.
+ *
+ * With the pipeline option the positions are double-buffered: the smoother solves the next
+ * generation into its own positions while the normals and buffers of the generation before are
+ * built from obj.hevs and obj.mesh, as two tasks per object, and the new positions are only
+ * stored into obj.hevs and obj.mesh once both are done, for the next frame to build. What is
+ * drawn is then one generation behind what is solved, and the solvers run serially inside their
+ * tasks, so it only pipelines while the pool has more threads than there are objects to solve,
+ * leaving threads for the builds. Otherwise every object solves, stores and builds in one task,
+ * and a single object runs alone, so its solver gets the whole pool instead.
  */
-void computeSmoothing(Object &obj) {
-    // Gets matrix operator F = (I − hΔ)
-    Eigen::SparseMatrix<float> opF = build_F_operator(obj);
+void smoothNextFrame(int rate) {
+    // Waits for the newest generation to be shown again (see scrubHistory)
+    if (history_offset > 0) {
+        smoothing_scrubbed = true;
+        return;
+    }
 
-    // Initializes Eigen's Sparse solver
-    Eigen::SparseLU< Eigen::SparseMatrix<float>, Eigen::COLAMDOrdering<int> > solver;
+    vector<Object *> frame_objects;
+    for (map<string, Object>::iterator obj_iter = objects.begin(); 
+                                    obj_iter != objects.end(); obj_iter++) {
+        prepareSmoothing(obj_iter->second);
+        frame_objects.push_back(&obj_iter->second);
+    }
 
-    // Tailors our solver to our matrix operator
-    solver.analyzePattern(opF);
-    solver.factorize(opF);
+    // Smoothes and updates every Object
+    bool pipeline = smoothing_options.pipeline && thread_pool().size() > frame_objects.size();
+    int stages = pipeline ? 2 : 1;
+    vector<char> stopped(frame_objects.size(), 0);
+    vector<string> logs(stages * frame_objects.size());
+    thread_pool().parallel_for(0, logs.size(), 1, [&](int task) {
+        Object &obj = *frame_objects[task / stages];
+        ostringstream log;
+        if (!pipeline) {
+            computeSmoothing(obj, log);
+            storeSmoothing(obj);
+            stopped[task] = publishSmoothing(obj, log);
+        } else if (task % 2 == 0) {
+            computeSmoothing(obj, log);
+        } else if (obj.pending) {
+            stopped[task / 2] = publishSmoothing(obj, log);
+        }
+        logs[task] = log.str();
+    });
+    bool idle = true;
+    for (int o = 0; o < frame_objects.size(); o++) {
+        if (pipeline) {
+            storeSmoothing(*frame_objects[o]);
+            frame_objects[o]->pending = true;
+        }
+        idle = stopped[o] && idle;
+    }
+    for (int task = 0; task < logs.size(); task++) {
+        cout << logs[task];
+    }
 
-    // Saves the number of vertices, accounting for our 1-indexing of the vertices
-    int num_vertices = obj.hevs->size() - 1;
+    // Redisplays the scene with new smoothed objects
+    glutPostRedisplay();
 
-    // Initializes our rho vectors with our vertex positions at this current generation
-    Eigen::VectorXf x_rho (num_vertices);
-    Eigen::VectorXf y_rho (num_vertices);
-    Eigen::VectorXf z_rho (num_vertices);
-    for (int i = 1; i < obj.hevs->size(); i++) {
-        HEV *v_i = obj.hevs->at(i);
-        x_rho(i - 1) = v_i->x;
-        y_rho(i - 1) = v_i->y;
-        z_rho(i - 1) = v_i->z;
+    // Stops smoothing once nothing changes anymore instead of solving every frame for nothing
+    if (idle) {
+        // Shows the last generation solved too, which the pipeline has not built yet
+        publishPending();
+        smoothing_idle = true;
+        cout << "the meshes stopped changing, smoothing paused until h or a mesh changes" << endl;
+        return;
     }
 
-    // Solves for the next generation of our vertex positions phi using Eigen's Sparse solver
-    Eigen::VectorXf x_phi (num_vertices);
-    Eigen::VectorXf y_phi (num_vertices);
-    Eigen::VectorXf z_phi (num_vertices);
-    x_phi = solver.solve(x_rho);
-    y_phi = solver.solve(y_rho);
-    z_phi = solver.solve(z_rho);
+    // Sets the next smoothing to occur at the given regular rate
+    glutTimerFunc(rate, smoothNextFrame, rate);
+}
 
-    // Updates our vertex positions with the next generation
-    for (int i = 1; i < obj.hevs->size(); i++) {
-        HEV *v_i = obj.hevs->at(i);
-        v_i->x = x_phi(i - 1);
-        v_i->y = y_phi(i - 1);
-        v_i->z = z_phi(i - 1);
+
+// Restarts the smoothing timer if it was paused because the meshes stopped changing
+void resumeSmoothing() {
+    if (started_smoothing && smoothing_idle) {
+        smoothing_idle = false;
+        cout << "smoothing resumed" << endl;
+        glutTimerFunc(FRAME_RATE, smoothNextFrame, FRAME_RATE);
     }
 }
 
 
-// Smoothes and displays the next frame at a set regular rate
-void smoothNextFrame(int rate) {
-    // Smoothes and updates every Object
+// Builds the normals and buffers of the generations the pipeline stored but has not built yet
+void publishPending() {
     for (map<string, Object>::iterator obj_iter = objects.begin(); 
                                     obj_iter != objects.end(); obj_iter++) {
-        Object &obj = objects[obj_iter->first];
-        computeSmoothing(obj);
-        computeNormalsUpdateBuffers(obj);
+        if (obj_iter->second.pending) {
+            ostringstream log;
+            publishSmoothing(obj_iter->second, log);
+        }
     }
+}
 
-    // Redisplays the scene with new smoothed objects
+
+/* Shows every object the given number of generations later (earlier if negative) in its
+ * history, between the oldest one it kept and the newest one solved. Each is decoded from the
+ * history into obj.hevs and obj.mesh; the smoother keeps its own positions, so smoothing pauses
+ * while an older generation is shown and goes on from the newest one once that is shown again.
+ */
+void scrubHistory(int steps) {
+    if (history_offset == 0) {
+        publishPending();
+    }
+    int oldest = 0;
+    for (map<string, Object>::iterator obj_iter = objects.begin(); 
+                                    obj_iter != objects.end(); obj_iter++) {
+        Generation_History &history = obj_iter->second.history;
+        if (!history.empty()) {
+            oldest = max(oldest, history.last() - history.first());
+        }
+    }
+    history_offset = min(max(history_offset - steps, 0), oldest);
+    if (smoothing_options.history_memory <= 0) {
+        cout << "no generations are kept to scrub through with --history_memory 0" << endl;
+    }
+
+    Positions<double> pos;
+    for (map<string, Object>::iterator obj_iter = objects.begin(); 
+                                    obj_iter != objects.end(); obj_iter++) {
+        Object &obj = obj_iter->second;
+        if (obj.history.empty()) {
+            continue;
+        }
+        int generation = max(obj.history.last() - history_offset, obj.history.first());
+        if (history_offset == 0) {
+            pos = obj.shown;
+        } else {
+            obj.history.get(generation, pos);
+        }
+        scatter_positions(pos, obj.hevs);
+        updateMeshVertices(obj);
+        computeNormalsUpdateBuffers(obj);
+        cout << obj_iter->first << ": generation " << generation << " of "
+             << obj.history.first() << " to " << obj.history.last() << " ("
+             << obj.history.memory() / double(1 << 20) << " MB)" << endl;
+    }
     glutPostRedisplay();
 
-    // Sets the next smoothing to occur at the given regular rate
-    glutTimerFunc(rate, smoothNextFrame, rate);
+    if (history_offset == 0 && smoothing_scrubbed) {
+        smoothing_scrubbed = false;
+        glutTimerFunc(FRAME_RATE, smoothNextFrame, FRAME_RATE);
+    }
 }
 
 
@@ -1808,12 +2024,59 @@ void key_pressed(unsigned char key, int x, int y)
         if (key == start_smoothing_key)
         {  
             if (!started_smoothing) {
-                smoothNextFrame(FRAME_RATE);
                 started_smoothing = true;
+                smoothNextFrame(FRAME_RATE);
             }
             
         }
 
+        // The smoothness keys work like a slider over the amount of smoothing, stepping from h
+        else if (key == less_smoothing_key || key == more_smoothing_key)
+        {
+            if (smoothness == 0) {
+                smoothness = time_step_h;
+            }
+            smoothness *= (key == more_smoothing_key) ? 2 : 0.5;
+            if (jumpSmoothing(smoothness)) {
+                cout << "smoothness " << smoothness << endl;
+            } else {
+                cout << "only --method spectral can jump to an amount of smoothing" << endl;
+            }
+        }
+
+        // The step keys double and halve h, which restarts smoothing that stopped
+        else if (key == larger_step_key || key == smaller_step_key)
+        {
+            time_step_h *= (key == larger_step_key) ? 2 : 0.5;
+            cout << "h " << time_step_h << endl;
+            resumeSmoothing();
+        }
+
+        // The history keys show earlier and later generations without solving them again
+        else if (key == earlier_generation_key || key == later_generation_key ||
+                 key == much_earlier_generation_key || key == much_later_generation_key)
+        {
+            int steps = (key == earlier_generation_key || key == later_generation_key) ? 1 : 10;
+            bool earlier = (key == earlier_generation_key || key == much_earlier_generation_key);
+            scrubHistory(earlier ? -steps : steps);
+        }
+
+        // The clear key smooths the whole meshes again instead of the picked regions
+        else if (key == clear_region_key)
+        {
+            for (map<string, Object>::iterator obj_iter = objects.begin(); 
+                                            obj_iter != objects.end(); obj_iter++) {
+                Object &obj = obj_iter->second;
+                if (!obj.roi_seeds.empty()) {
+                    obj.roi_seeds.clear();
+                    delete obj.smoother;
+                    obj.smoother = NULL;
+                }
+            }
+            cout << "cleared the picked regions" << endl;
+            resumeSmoothing();
+        }
+
         /* 'w' for step forward
          */
         else if(key == 'w')
@@ -1869,14 +2132,57 @@ void destroy_objects() {
         delete obj.mesh;
 
         delete_HE(obj.hevs, obj.hefs);
+
+        delete obj.smoother;
     }
 }
 
 
 void usage(void) {
-    cerr << "usage: scene_description_file.txt xres yres h\n\t"
+    cerr << "usage: scene_description_file.txt xres yres h [--option value ...]\n\t"
             "xres, yres (screen resolution) must be positive integers\n\t"
-            "h (smoothing time step) must be a positive float\n";
+            "h (smoothing time step) must be a positive float\n"
+            "options:\n\t"
+            "--method implicit|explicit|taubin|spectral|bilaplacian (default implicit)\n\t"
+            "--explicit_cfl c (explicit substep h times spectral radius, default 1)\n\t"
+            "--taubin_lambda l, --taubin_kpb k, --taubin_iterations n (taubin filter, "
+            "defaults 0.33, 0.1, 10)\n\t"
+            "--taubin_weights uniform|cotangent (taubin Laplacian, default cotangent)\n\t"
+            "--spectral_modes k (spectral eigenpairs, default 100)\n\t"
+            "--spectral_cache dir|none (where spectral bases are cached, default none)\n\t"
+            "--time_step fixed|adaptive (adaptive h by step doubling, default fixed)\n\t"
+            "--adaptive_target d, --adaptive_tol e (displacement per generation and local "
+            "error, relative to the bounding box, defaults 0.005, 0.003)\n\t"
+            "--freeze_generations k, --freeze_drift d (reuse a factorization for up to k "
+            "generations while the weights drift less than d, defaults 1, 0.05)\n\t"
+            "--dirty_epsilon e (recompute only the rows around vertices that moved more, "
+            "relative to the bounding box, default 0 for all rows)\n\t"
+            "--frame_budget ms (anytime cg iterations that fit every frame into ms, needs "
+            "--solver cg, default 0 off)\n\t"
+            "--roi v1,v2,...|none, --roi_rings k (implicit fairing of only the k rings around "
+            "the .obj vertices, default none, 2)\n\t"
+            "--pin v1,v2,...|none (implicit fairing holds the .obj vertices in place)\n\t"
+            "--components split|joint (one system per connected component with the direct "
+            "solvers, default split)\n\t"
+            "--precision float|double|mixed (default float)\n\t"
+            "--refine_steps n, --refine_tol t (mixed precision refinement)\n\t"
+            "--solver lu|ldlt|supernodal|eigen_cg|bicgstab|cg|mg|gs|chebyshev (default lu)\n\t"
+            "--ordering auto|natural|amd|colamd|nd (direct solvers only, default auto)\n\t"
+            "--preconditioner none|jacobi|ic|mg (cg only, default ic)\n\t"
+            "--cg_tol t, --cg_max_iterations n (iterative solver stopping criteria)\n\t"
+            "--mg_smoother gauss_seidel|multicolor (mg only, default gauss_seidel)\n\t"
+            "--lanczos_steps n (chebyshev and explicit eigenvalue estimate, default 10)\n\t"
+            "--threads n (the shared pool of parsing, normals and the solvers, default 0 for "
+            "all hardware threads)\n\t"
+            "--affinity none|compact (compact pins pool thread t to hardware thread t, "
+            "default none)\n\t"
+            "--idle_tol t (pause once a generation changes the mesh less, default 1e-5, "
+            "0 never)\n\t"
+            "--pipeline on|off (build a generation's buffers while solving the next, default "
+            "off)\n\t"
+            "--history_memory mb, --history_keyframes k (generations kept per object to scrub "
+            "back through with , and ., and generations per keyframe, defaults 64, 16)\n"
+            "options given here override the smoothing block of the scene file\n";
     exit(1);
 }
 
@@ -1890,7 +2196,7 @@ int main(int argc, char* argv[])
     /* Checks that the user inputted the right parameters into the command line
      * and stores the user's parameters to their respective fields
      */
-    if (argc != 5) {
+    if (argc < 5 || argc % 2 == 0) {
         usage();
     }
     int xres = stoi(argv[2]);
@@ -1899,6 +2205,18 @@ int main(int argc, char* argv[])
     if (xres <= 0 || yres <= 0 || time_step_h <= 0) {
         usage();
     }
+    Smoothing_Options command_line = default_smoothing_options();
+    for (int i = 5; i < argc; i += 2) {
+        string key = argv[i];
+        if (key.compare(0, 2, "--") != 0 ||
+                !set_smoothing_option(command_line, key.substr(2), argv[i + 1])) {
+            usage();
+        }
+        command_line_options.push_back(make_pair(key.substr(2), string(argv[i + 1])));
+    }
+    /* Sizes the shared pool before the scene's meshes are parsed on it
+     */
+    set_num_threads(command_line.threads, command_line.pin_threads);
 
     /* 'glutInit' intializes the GLUT (Graphics Library Utility Toolkit) library.
      * This is necessary, since a lot of the functions we used above and below
@@ -1928,6 +2246,12 @@ int main(int argc, char* argv[])
     /* Call our 'init' function...
      */
     init(argv[1]);
+    /* The command line smoothing options take precedence over the scene file's
+     */
+    for (int i = 0; i < command_line_options.size(); i++) {
+        set_smoothing_option(smoothing_options, command_line_options[i].first,
+                             command_line_options[i].second);
+    }
     /* Specify to OpenGL our display function.
      */
     glutDisplayFunc(display);
@@ -0,0 +1,1776 @@
+/* This header file contains the implicit fairing code that smooths a mesh one
+ * generation at a time by solving
+ *
+ *     F x_h = x_0,    F = (I - hΔ)
+ *
+ * with the cotangent discretization of the Laplacian Δ. It only depends on
+ * Eigen and the halfedge, so the viewer and the benchmark program share it.
+ * Each generation actually solves the symmetric form of the same system from
+ * laplacian.h, (M - hL) x_h = M x_0, with one of the backends of
+ * linear_solvers.h.
+ *
+ * Smoother is the interface the viewer talks to. make_smoother returns the
+ * one Smoothing_Options picks:
+ *
+ *     implicit    - implicit fairing as above (Implicit_Smoother)
+ *     anytime     - implicit fairing with Smoothing_Options::frame_budget,
+ *                   running as many warm-started conjugate gradient
+ *                   iterations as fit into every step (Anytime_Smoother)
+ *     explicit    - forward Euler steps x <- x + hΔx, split into as many
+ *                   substeps as stability needs (laplacian_operator.h),
+ *                   which is cheaper while h is small (Explicit_Smoother)
+ *     taubin      - Taubin's λ/μ low-pass filter, which smooths without
+ *                   shrinking the mesh (Taubin_Smoother)
+ *     spectral    - a filter in a cached basis of the lowest Laplacian
+ *                   eigenvectors (spectral.h), which can jump to any amount
+ *                   of smoothing at once (Spectral_Smoother)
+ *     bilaplacian - fourth-order implicit fairing (I + hΔ²) x_h = x_0
+ *                   (bilaplacian.h), which keeps sharper features
+ *                   (Bilaplacian_Smoother)
+ *     region      - implicit fairing of only the region of interest around
+ *                   Smoothing_Options::roi_seeds (roi.h) without the
+ *                   Smoothing_Options::pinned vertices, and of a mesh of
+ *                   several connected components, block by block with the
+ *                   blocks in parallel (Region_Smoother)
+ *     batch       - many small meshes packed into a few block-diagonal
+ *                   systems, from make_batch_smoother
+ *                   (Implicit_Batch_Smoother)
+ *     adaptive    - with Smoothing_Options::adaptive_step, implicit,
+ *                   explicit and fourth-order fairing pick their own h every
+ *                   generation by step doubling (Adaptive_Smoother)
+ *
+ * The implicit ones use the precision Smoothing_Options::precision picks:
+ *
+ *     float   - everything in float (the original behavior)
+ *     double  - everything in double
+ *     mixed   - positions and the system in double, but the factorization
+ *               (or the incomplete Cholesky preconditioner) in float; direct
+ *               solves are corrected with a few passes of iterative
+ *               refinement against the double system
+ *
+ * and Smoothing_Options::solver picks the backend:
+ *
+ *     lu         - Eigen's SparseLU
+ *     ldlt       - Eigen's SimplicialLDLT
+ *     supernodal - our supernodal Cholesky (supernodal.h), which factorizes
+ *                  with dense kernels and independent subtrees in parallel
+ *     eigen_cg   - Eigen's ConjugateGradient with a diagonal preconditioner
+ *     bicgstab   - Eigen's BiCGSTAB with a diagonal preconditioner
+ *     cg         - our matrix-free preconditioned conjugate gradient; unless
+ *                  it is preconditioned by multigrid it never assembles the
+ *                  matrix, so its memory only grows with the number of edges
+ *     mg         - multigrid V-cycles over an edge-collapse hierarchy, whose
+ *                  work per cycle grows linearly with the mesh
+ *     gs         - symmetric Gauss-Seidel sweeps, relaxing the vertices of
+ *                  each color of a greedy coloring in parallel
+ *     chebyshev  - Jacobi-preconditioned Chebyshev iteration with eigenvalue
+ *                  bounds from a few Lanczos steps, so its iterations need
+ *                  no dot products
+ *
+ * Fourth-order fairing uses the same precisions but only the direct
+ * backends; with an iterative one it falls back to supernodal.
+ *
+ * The direct backends (lu, ldlt and supernodal) permute the system with
+ * Smoothing_Options::ordering (see orderings.h); by default the one with the
+ * least predicted fill. The iterative backends are warm-started from the
+ * current positions. The parallel parts run on the shared pool of parallel.h
+ * with Smoothing_Options::threads threads.
+ */
+
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "structs.h"
+#include "halfedge.h"
+#include "laplacian.h"
+#include "linear_solvers.h"
+#include "laplacian_operator.h"
+#include "spectral.h"
+#include "bilaplacian.h"
+#include "roi.h"
+
+/* Options */
+
+enum Smoothing_Method { METHOD_IMPLICIT, METHOD_EXPLICIT, METHOD_TAUBIN, METHOD_SPECTRAL,
+                        METHOD_BILAPLACIAN };
+enum Precision_Mode { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_MIXED };
+enum Solver_Type { SOLVER_LU, SOLVER_LDLT, SOLVER_SUPERNODAL, SOLVER_EIGEN_CG, SOLVER_BICGSTAB,
+                   SOLVER_CG, SOLVER_MG, SOLVER_GS, SOLVER_CHEBYSHEV, NUM_SOLVER_TYPES };
+enum Preconditioner_Type { PRECONDITIONER_NONE, PRECONDITIONER_JACOBI, PRECONDITIONER_IC,
+                           PRECONDITIONER_MG };
+
+struct Smoothing_Options
+{
+    // Implicit fairing, explicit forward Euler substeps, the Taubin filter, a
+    // filter in the low-frequency eigenbasis or fourth-order fairing
+    // (implicit, explicit, taubin, spectral or bilaplacian). Anytime and
+    // region smoothing are implicit fairing with frame_budget, or roi_seeds
+    // and pinned; adaptive_step makes implicit, explicit and fourth-order
+    // fairing adaptive
+    Smoothing_Method method;
+    // Largest h ρ of an explicit substep, with ρ the spectral radius of Δ
+    double explicit_cfl;
+    // Taubin filter: the positive factor λ, the pass-band frequency k_PB,
+    // the λ/μ pass pairs per generation and whether Δ is uniform or cotangent
+    double taubin_lambda;
+    double taubin_kpb;
+    int taubin_iterations;
+    bool taubin_uniform;
+    // Eigenpairs of the spectral basis, and the directory it is cached in
+    // (empty, the default, for no cache). The file is named after a hash of
+    // the positions, so every edited mesh adds another one
+    int spectral_modes;
+    std::string spectral_cache;
+    // Whether h adapts every generation by step doubling, the displacement
+    // per generation it aims for and the local error it allows, both relative
+    // to the bounding box diagonal
+    bool adaptive_step;
+    double adaptive_target;
+    double adaptive_tol;
+    // Implicit fairing keeps a factorization for up to this many generations
+    // as long as the cotangent weights drift by less than freeze_drift
+    // (relative RMS) from the ones it was computed from; 1 refactorizes every
+    // generation
+    int freeze_generations;
+    double freeze_drift;
+    // Implicit fairing only recomputes the weights around vertices that moved
+    // by more than this (relative to the bounding box diagonal) since their
+    // weights were last computed; 0 recomputes all of them
+    double dirty_epsilon;
+    // Implicit fairing of the whole mesh runs each step as an anytime solve
+    // of at most this many milliseconds (see Anytime_Smoother); 0 solves
+    // every generation to the end. It runs solver cg with preconditioner, and
+    // make_smoother throws rather than drop another solver, another method,
+    // roi_seeds, pinned, adaptive_step, freeze_generations or dirty_epsilon
+    double frame_budget;
+    // Vertices (0-based) implicit fairing is restricted to, grown by
+    // roi_rings rings, with the ring around them held in place; empty for the
+    // whole mesh
+    std::vector<int> roi_seeds;
+    int roi_rings;
+    // Vertices (0-based) implicit fairing holds in place by taking them out
+    // of the unknowns
+    std::vector<int> pinned;
+    // Whether implicit fairing with a direct solver solves every connected
+    // component of a mesh of several shells as its own system
+    bool split_components;
+    // Scalar type used for positions, assembly and factorization
+    Precision_Mode precision;
+    // Maximum number of iterative refinement passes in mixed precision
+    int refine_steps;
+    // Relative residual at which iterative refinement stops early
+    double refine_tol;
+    // Linear solver backend
+    Solver_Type solver;
+    // Fill-reducing ordering of the direct solvers
+    Ordering_Type ordering;
+    // Preconditioner of our conjugate gradient
+    Preconditioner_Type preconditioner;
+    // Relative residual at which the iterative solvers stop
+    double cg_tol;
+    // Maximum number of iterations per generation of the iterative solvers
+    int cg_max_iterations;
+    // Lanczos steps of the Chebyshev solver's eigenvalue estimate
+    int lanczos_steps;
+    // Whether multigrid smooths with multicolor instead of serial Gauss-Seidel
+    bool mg_multicolor;
+    // Threads of the shared pool, 0 for one per hardware thread, and whether
+    // its workers are pinned to hardware threads
+    int threads;
+    bool pin_threads;
+    // The viewer stops smoothing once a generation changes the mesh by less
+    // than this (see converged), 0 to never stop
+    double idle_tol;
+    // Whether the viewer builds the normals and buffers of one generation
+    // while it solves the next, when the pool has a thread to spare for it
+    // (see smoothNextFrame)
+    bool pipeline;
+    // Megabytes of generations the viewer keeps per object to scrub back
+    // through, 0 for none, and the generations per keyframe (see history.h)
+    double history_memory;
+    int history_keyframes;
+};
+
+/* How much one generation changed the mesh: the displacements of the
+ * vertices and the changes of the surface area and enclosed volume, relative
+ * to a length, area and volume given by the caller, like those of the
+ * original mesh. Relative to the mesh before the generation they would not
+ * fall as it shrinks towards a point.
+ */
+struct Generation_Metrics
+{
+    double max_displacement;
+    double rms_displacement;
+    double area_change;
+    double volume_change;
+};
+
+/* Function prototypes */
+
+static Smoothing_Options default_smoothing_options();
+static bool set_smoothing_option(Smoothing_Options &opts,
+                                 const std::string &key,
+                                 const std::string &value);
+static const char *solver_name(Solver_Type solver);
+
+template <typename Scalar, typename FactorScalar>
+static Linear_Solver<Scalar> *make_linear_solver(const Smoothing_Options &opts);
+
+template <typename Scalar>
+static void measure_surface(const Mesh_Topology &topo, const Positions<Scalar> &pos,
+                            double &area, double &volume);
+template <typename Scalar>
+static Generation_Metrics measure_generation(const Mesh_Topology &topo,
+                                             const Positions<Scalar> &before,
+                                             const Positions<Scalar> &after,
+                                             double length, double area, double volume);
+static bool converged(const Generation_Metrics &metrics, double tol);
+
+class Smoother;
+static Smoother *make_smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts);
+class Batch_Smoother;
+static Batch_Smoother *make_batch_smoother(const std::vector< std::vector<HEV*> * > &meshes,
+                                           const Smoothing_Options &opts, int batches);
+
+/* Function implementations */
+
+static Smoothing_Options default_smoothing_options()
+{
+    Smoothing_Options opts;
+    opts.method = METHOD_IMPLICIT;
+    opts.explicit_cfl = 1;
+    opts.taubin_lambda = 0.33;
+    opts.taubin_kpb = 0.1;
+    opts.taubin_iterations = 10;
+    opts.taubin_uniform = false;
+    opts.spectral_modes = 100;
+    opts.spectral_cache = "";
+    opts.adaptive_step = false;
+    opts.adaptive_target = 0.005;
+    opts.adaptive_tol = 0.003;
+    opts.freeze_generations = 1;
+    opts.freeze_drift = 0.05;
+    opts.dirty_epsilon = 0;
+    opts.frame_budget = 0;
+    opts.roi_rings = 2;
+    opts.split_components = true;
+    opts.precision = PRECISION_FLOAT;
+    opts.refine_steps = 3;
+    opts.refine_tol = 1e-10;
+    opts.solver = SOLVER_LU;
+    opts.ordering = ORDERING_AUTO;
+    opts.preconditioner = PRECONDITIONER_IC;
+    opts.cg_tol = 1e-8;
+    opts.cg_max_iterations = 1000;
+    opts.lanczos_steps = 10;
+    opts.mg_multicolor = false;
+    opts.threads = 0;
+    opts.pin_threads = false;
+    opts.idle_tol = 1e-5;
+    opts.pipeline = false;
+    opts.history_memory = 64;
+    opts.history_keyframes = 16;
+    return opts;
+}
+
+/* Reads a list of 1-based .obj vertex indices separated by commas, or none,
+ * into 0-based vertices
+ */
+static void parse_vertex_list(const std::string &key, const std::string &value,
+                              std::vector<int> &vertices)
+{
+    vertices.clear();
+    size_t start = 0;
+    while (value != "none" && start <= value.size()) {
+        size_t end = std::min(value.find(',', start), value.size());
+        int vertex = std::stoi(value.substr(start, end - start));
+        if (vertex < 1) {
+            throw std::invalid_argument(key + " vertices must be positive");
+        }
+        vertices.push_back(vertex - 1);
+        start = end + 1;
+    }
+}
+
+/* Throws invalid_argument naming the first of some 0-based vertices, as read
+ * by parse_vertex_list for the option key, that the mesh does not have
+ */
+static void check_vertex_list(const std::string &key, const std::vector<int> &vertices,
+                              int num_vertices)
+{
+    for (int v = 0; v < vertices.size(); v++) {
+        if (vertices[v] < 0 || vertices[v] >= num_vertices) {
+            throw std::invalid_argument(key + " vertex " + std::to_string(vertices[v] + 1) +
+                                        " is not in the mesh of " +
+                                        std::to_string(num_vertices) + " vertices");
+        }
+    }
+}
+
+/* Sets one option from its textual key and value, as given on the command
+ * line or in the scene file. Returns false if the key is unknown and throws
+ * invalid_argument if the value is not valid for the key.
+ */
+static bool set_smoothing_option(Smoothing_Options &opts,
+                                 const std::string &key,
+                                 const std::string &value)
+{
+    if (key == "method") {
+        if (value == "implicit")
+            opts.method = METHOD_IMPLICIT;
+        else if (value == "explicit")
+            opts.method = METHOD_EXPLICIT;
+        else if (value == "taubin")
+            opts.method = METHOD_TAUBIN;
+        else if (value == "spectral")
+            opts.method = METHOD_SPECTRAL;
+        else if (value == "bilaplacian")
+            opts.method = METHOD_BILAPLACIAN;
+        else
+            throw std::invalid_argument(
+                "method must be implicit, explicit, taubin, spectral or bilaplacian");
+    } else if (key == "explicit_cfl") {
+        opts.explicit_cfl = std::stod(value);
+        if (!(opts.explicit_cfl > 0 && opts.explicit_cfl < 2)) {
+            throw std::invalid_argument("explicit_cfl must be between 0 and 2");
+        }
+    } else if (key == "taubin_lambda") {
+        opts.taubin_lambda = std::stod(value);
+        if (!(opts.taubin_lambda > 0 && opts.taubin_lambda <= 1)) {
+            throw std::invalid_argument("taubin_lambda must be in (0, 1]");
+        }
+    } else if (key == "taubin_kpb") {
+        opts.taubin_kpb = std::stod(value);
+        if (!(opts.taubin_kpb > 0 && opts.taubin_kpb < 1)) {
+            throw std::invalid_argument("taubin_kpb must be between 0 and 1");
+        }
+    } else if (key == "taubin_iterations") {
+        opts.taubin_iterations = std::stoi(value);
+        if (opts.taubin_iterations < 1) {
+            throw std::invalid_argument("taubin_iterations must be positive");
+        }
+    } else if (key == "taubin_weights") {
+        if (value == "uniform")
+            opts.taubin_uniform = true;
+        else if (value == "cotangent")
+            opts.taubin_uniform = false;
+        else
+            throw std::invalid_argument("taubin_weights must be uniform or cotangent");
+    } else if (key == "spectral_modes") {
+        opts.spectral_modes = std::stoi(value);
+        if (opts.spectral_modes < 1) {
+            throw std::invalid_argument("spectral_modes must be positive");
+        }
+    } else if (key == "spectral_cache") {
+        opts.spectral_cache = (value == "none") ? "" : value;
+    } else if (key == "time_step") {
+        if (value == "fixed")
+            opts.adaptive_step = false;
+        else if (value == "adaptive")
+            opts.adaptive_step = true;
+        else
+            throw std::invalid_argument("time_step must be fixed or adaptive");
+    } else if (key == "adaptive_target") {
+        opts.adaptive_target = std::stod(value);
+        if (!(opts.adaptive_target > 0)) {
+            throw std::invalid_argument("adaptive_target must be positive");
+        }
+    } else if (key == "adaptive_tol") {
+        opts.adaptive_tol = std::stod(value);
+        if (!(opts.adaptive_tol > 0)) {
+            throw std::invalid_argument("adaptive_tol must be positive");
+        }
+    } else if (key == "freeze_generations") {
+        opts.freeze_generations = std::stoi(value);
+        if (opts.freeze_generations < 1) {
+            throw std::invalid_argument("freeze_generations must be positive");
+        }
+    } else if (key == "freeze_drift") {
+        opts.freeze_drift = std::stod(value);
+        if (!(opts.freeze_drift >= 0)) {
+            throw std::invalid_argument("freeze_drift must not be negative");
+        }
+    } else if (key == "dirty_epsilon") {
+        opts.dirty_epsilon = std::stod(value);
+        if (!(opts.dirty_epsilon >= 0)) {
+            throw std::invalid_argument("dirty_epsilon must not be negative");
+        }
+    } else if (key == "frame_budget") {
+        opts.frame_budget = std::stod(value);
+        if (!(opts.frame_budget >= 0)) {
+            throw std::invalid_argument("frame_budget must not be negative");
+        }
+    } else if (key == "roi") {
+        parse_vertex_list(key, value, opts.roi_seeds);
+    } else if (key == "pin") {
+        parse_vertex_list(key, value, opts.pinned);
+    } else if (key == "components") {
+        if (value == "split")
+            opts.split_components = true;
+        else if (value == "joint")
+            opts.split_components = false;
+        else
+            throw std::invalid_argument("components must be split or joint");
+    } else if (key == "roi_rings") {
+        opts.roi_rings = std::stoi(value);
+        if (opts.roi_rings < 0) {
+            throw std::invalid_argument("roi_rings must not be negative");
+        }
+    } else if (key == "precision") {
+        if (value == "float")
+            opts.precision = PRECISION_FLOAT;
+        else if (value == "double")
+            opts.precision = PRECISION_DOUBLE;
+        else if (value == "mixed")
+            opts.precision = PRECISION_MIXED;
+        else
+            throw std::invalid_argument("precision must be float, double or mixed");
+    } else if (key == "refine_steps") {
+        opts.refine_steps = std::stoi(value);
+        if (opts.refine_steps < 0) {
+            throw std::invalid_argument("refine_steps must not be negative");
+        }
+    } else if (key == "refine_tol") {
+        opts.refine_tol = std::stod(value);
+        if (!(opts.refine_tol > 0)) {
+            throw std::invalid_argument("refine_tol must be positive");
+        }
+    } else if (key == "solver") {
+        for (int s = 0; s < NUM_SOLVER_TYPES; s++) {
+            if (value == solver_name((Solver_Type) s)) {
+                opts.solver = (Solver_Type) s;
+                return true;
+            }
+        }
+        throw std::invalid_argument("solver must be lu, ldlt, supernodal, eigen_cg, bicgstab, cg, "
+                                    "mg, gs or chebyshev");
+    } else if (key == "ordering") {
+        for (int o = ORDERING_AUTO; o <= ORDERING_ND; o++) {
+            if (value == ordering_name((Ordering_Type) o)) {
+                opts.ordering = (Ordering_Type) o;
+                return true;
+            }
+        }
+        throw std::invalid_argument("ordering must be auto, natural, amd, colamd or nd");
+    } else if (key == "preconditioner") {
+        if (value == "none")
+            opts.preconditioner = PRECONDITIONER_NONE;
+        else if (value == "jacobi")
+            opts.preconditioner = PRECONDITIONER_JACOBI;
+        else if (value == "ic")
+            opts.preconditioner = PRECONDITIONER_IC;
+        else if (value == "mg")
+            opts.preconditioner = PRECONDITIONER_MG;
+        else
+            throw std::invalid_argument("preconditioner must be none, jacobi, ic or mg");
+    } else if (key == "cg_tol") {
+        opts.cg_tol = std::stod(value);
+        if (!(opts.cg_tol > 0)) {
+            throw std::invalid_argument("cg_tol must be positive");
+        }
+    } else if (key == "cg_max_iterations") {
+        opts.cg_max_iterations = std::stoi(value);
+        if (opts.cg_max_iterations < 1) {
+            throw std::invalid_argument("cg_max_iterations must be positive");
+        }
+    } else if (key == "lanczos_steps") {
+        opts.lanczos_steps = std::stoi(value);
+        if (opts.lanczos_steps < 1) {
+            throw std::invalid_argument("lanczos_steps must be positive");
+        }
+    } else if (key == "mg_smoother") {
+        if (value == "gauss_seidel")
+            opts.mg_multicolor = false;
+        else if (value == "multicolor")
+            opts.mg_multicolor = true;
+        else
+            throw std::invalid_argument("mg_smoother must be gauss_seidel or multicolor");
+    } else if (key == "threads") {
+        opts.threads = std::stoi(value);
+        if (opts.threads < 0) {
+            throw std::invalid_argument("threads must not be negative");
+        }
+    } else if (key == "affinity") {
+        if (value == "none")
+            opts.pin_threads = false;
+        else if (value == "compact")
+            opts.pin_threads = true;
+        else
+            throw std::invalid_argument("affinity must be none or compact");
+    } else if (key == "idle_tol") {
+        opts.idle_tol = std::stod(value);
+        if (!(opts.idle_tol >= 0)) {
+            throw std::invalid_argument("idle_tol must not be negative");
+        }
+    } else if (key == "pipeline") {
+        if (value == "on")
+            opts.pipeline = true;
+        else if (value == "off")
+            opts.pipeline = false;
+        else
+            throw std::invalid_argument("pipeline must be on or off");
+    } else if (key == "history_memory") {
+        opts.history_memory = std::stod(value);
+        if (!(opts.history_memory >= 0)) {
+            throw std::invalid_argument("history_memory must not be negative");
+        }
+    } else if (key == "history_keyframes") {
+        opts.history_keyframes = std::stoi(value);
+        if (opts.history_keyframes < 1) {
+            throw std::invalid_argument("history_keyframes must be positive");
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static const char *solver_name(Solver_Type solver)
+{
+    switch (solver) {
+        case SOLVER_LU:         return "lu";
+        case SOLVER_LDLT:       return "ldlt";
+        case SOLVER_SUPERNODAL: return "supernodal";
+        case SOLVER_EIGEN_CG:   return "eigen_cg";
+        case SOLVER_BICGSTAB:   return "bicgstab";
+        case SOLVER_CG:         return "cg";
+        case SOLVER_MG:         return "mg";
+        case SOLVER_GS:         return "gs";
+        default:                return "chebyshev";
+    }
+}
+
+template <typename Scalar, typename FactorScalar>
+static Linear_Solver<Scalar> *make_linear_solver(const Smoothing_Options &opts)
+{
+    typedef Eigen::SparseMatrix<FactorScalar> FactorMatrix;
+    typedef Eigen::SparseMatrix<Scalar> Matrix;
+    typedef Eigen::DiagonalPreconditioner<Scalar> Diagonal;
+
+    switch (opts.solver) {
+        case SOLVER_LU:
+            return new Direct_Solver<Scalar, FactorScalar,
+                Counted_SparseLU<FactorMatrix, Eigen::NaturalOrdering<int> > >(
+                    opts.ordering, opts.refine_steps, opts.refine_tol);
+        case SOLVER_LDLT:
+            return new Direct_Solver<Scalar, FactorScalar,
+                Eigen::SimplicialLDLT<FactorMatrix, Eigen::Lower, Eigen::NaturalOrdering<int> > >(
+                    opts.ordering, opts.refine_steps, opts.refine_tol);
+        case SOLVER_SUPERNODAL:
+            return new Direct_Solver<Scalar, FactorScalar, Supernodal_Cholesky<FactorMatrix> >(
+                opts.ordering, opts.refine_steps, opts.refine_tol);
+        case SOLVER_EIGEN_CG:
+            return new Eigen_Iterative_Solver<Scalar,
+                Eigen::ConjugateGradient<Matrix, Eigen::Lower, Diagonal> >(
+                    opts.cg_tol, opts.cg_max_iterations);
+        case SOLVER_BICGSTAB:
+            return new Eigen_Iterative_Solver<Scalar, Eigen::BiCGSTAB<Matrix, Diagonal> >(
+                opts.cg_tol, opts.cg_max_iterations);
+        case SOLVER_MG:
+            return new Multigrid_Solver<Scalar>(opts.cg_tol, opts.cg_max_iterations,
+                                                opts.mg_multicolor);
+        case SOLVER_GS:
+            return new Gauss_Seidel_Solver<Scalar>(opts.cg_tol, opts.cg_max_iterations);
+        case SOLVER_CHEBYSHEV:
+            return new Chebyshev_Solver<Scalar>(opts.cg_tol, opts.cg_max_iterations,
+                                                opts.lanczos_steps);
+        default:
+            return new PCG_Solver<Scalar, FactorScalar>(
+                (typename PCG_Solver<Scalar, FactorScalar>::Preconditioner) opts.preconditioner,
+                opts.cg_tol, opts.cg_max_iterations, opts.mg_multicolor);
+    }
+}
+
+/* Generation metrics */
+
+/* Surface area and enclosed volume. Every face is on the left of three
+ * halfedge slots (i, he_to[k], he_across[k]), so both sums count it three
+ * times. The volume is only meaningful for closed, consistently oriented
+ * meshes.
+ */
+template <typename Scalar>
+static void measure_surface(const Mesh_Topology &topo, const Positions<Scalar> &pos,
+                            double &area, double &volume)
+{
+    // Sums of the area and volume of the faces around every vertex
+    const int GRAIN = 1024;
+    Eigen::Vector2d sums = thread_pool().parallel_reduce(
+        0, topo.num_vertices, GRAIN, Eigen::Vector2d(0, 0),
+        [&](int i, Eigen::Vector2d &partial) {
+            Eigen::Vector3d a = pos.row(i).template cast<double>();
+            for (int k = topo.out_start[i]; k < topo.out_start[i + 1]; k++) {
+                Eigen::Vector3d b = pos.row(topo.he_to[k]).template cast<double>();
+                Eigen::Vector3d c = pos.row(topo.he_across[k]).template cast<double>();
+                partial(0) += (b - a).cross(c - a).norm() / 2;
+                partial(1) += a.dot(b.cross(c)) / 6;
+            }
+        },
+        [](const Eigen::Vector2d &x, const Eigen::Vector2d &y) -> Eigen::Vector2d {
+            return x + y;
+        });
+    area = sums(0) / 3;
+    volume = sums(1) / 3;
+}
+
+template <typename Scalar>
+static Generation_Metrics measure_generation(const Mesh_Topology &topo,
+                                             const Positions<Scalar> &before,
+                                             const Positions<Scalar> &after,
+                                             double length, double area, double volume)
+{
+    Generation_Metrics metrics;
+    Eigen::VectorXd distances = (after - before).template cast<double>().rowwise().norm();
+    metrics.max_displacement = distances.maxCoeff() / length;
+    metrics.rms_displacement = distances.norm() / std::sqrt(double(distances.size())) / length;
+
+    double area_before, volume_before, area_after, volume_after;
+    measure_surface(topo, before, area_before, volume_before);
+    measure_surface(topo, after, area_after, volume_after);
+    metrics.area_change = std::abs(area_after - area_before) / std::max(std::abs(area), 1e-30);
+    metrics.volume_change = std::abs(volume_after - volume_before) /
+                            std::max(std::abs(volume), 1e-30);
+    return metrics;
+}
+
+/* Whether the mesh has stopped changing: every metric is below tol, or one
+ * is not a number because the mesh degenerated. A tol of 0 never converges.
+ */
+static bool converged(const Generation_Metrics &metrics, double tol)
+{
+    double worst = std::max(std::max(metrics.max_displacement, metrics.area_change),
+                            metrics.volume_change);
+    if (!std::isfinite(worst) || !std::isfinite(metrics.rms_displacement)) {
+        return tol > 0;
+    }
+    return worst < tol;
+}
+
+/* Smoother interface */
+
+class Smoother
+{
+public:
+    virtual ~Smoother() {}
+
+    // Copies the vertex positions out of the halfedge vertices
+    virtual void load(std::vector<HEV*> *hevs) = 0;
+    // Advances the positions by one generation with time step h
+    virtual void step(double h) = 0;
+    // Writes the current positions back into the halfedge vertices
+    virtual void store(std::vector<HEV*> *hevs) const = 0;
+    // Sets the positions to the loaded ones smoothed for a total time t, if
+    // the method can do that without stepping there; returns whether it can
+    virtual bool jump_to(double) { return false; }
+    // Whether the positions are those of a finished generation, rather than
+    // an iterate in the middle of one
+    virtual bool settled() const { return true; }
+};
+
+// The topology of the mesh in hevs: a copy of the given one if make_smoother
+// already built it, or else built here
+static void take_topology(std::vector<HEV*> *hevs, const Mesh_Topology *given,
+                          Mesh_Topology &topo)
+{
+    if (given != NULL) {
+        topo = *given;
+    } else {
+        build_topology(hevs, topo);
+    }
+}
+
+/* Implicit fairing with positions and assembly in Scalar and the
+ * factorization or preconditioner of the linear solver in FactorScalar.
+ * The symbolic analysis of the solver runs once, on the first generation.
+ *
+ * With Smoothing_Options::freeze_generations above 1 the operator is frozen:
+ * a generation reuses the last system and its factorization, so it only
+ * costs the weights to measure the drift and a back-substitution, unless
+ * that factorization has served freeze_generations generations, h changed
+ * or the weights drifted too far from the frozen ones. A frozen generation
+ * solves (M_0 - hL_0) x_h = M_0 x with the masses and weights of the
+ * generation that factorized, which drifts from exact implicit fairing as
+ * the mesh moves.
+ *
+ * With Smoothing_Options::dirty_epsilon above 0 a generation that does
+ * refactorize only recomputes the rows of the system around vertices that
+ * moved by more than that (see Smoothing_System::update), and if none did it
+ * keeps the numeric factorization too.
+ */
+template <typename Scalar, typename FactorScalar = Scalar>
+class Implicit_Smoother : public Smoother
+{
+public:
+    Implicit_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                       const Mesh_Topology *topology = NULL)
+        : refactorized(false), weight_drift(0), updated_rows(0), opts(opts), analyzed(false)
+    {
+        take_topology(hevs, topology, topo);
+        load(hevs);
+        solver = make_linear_solver<Scalar, FactorScalar>(opts);
+    }
+
+    ~Implicit_Smoother()
+    {
+        delete solver;
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+        generations_frozen = opts.freeze_generations;
+        dirty_length = opts.dirty_epsilon * (positions.colwise().maxCoeff() -
+                                             positions.colwise().minCoeff()).norm();
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    void step(double h)
+    {
+        refactorized = !keep_factorization(Scalar(h));
+        if (refactorized) {
+            if (dirty_length > 0) {
+                updated_rows = system.update(topo, positions, Scalar(h), dirty_length);
+            } else {
+                system.assign(topo, positions, Scalar(h));
+                updated_rows = topo.num_vertices;
+            }
+            if (!analyzed) {
+                solver->analyze(system);
+                analyzed = true;
+            }
+            refactorized = updated_rows > 0;
+            if (refactorized) {
+                solver->factorize(system);
+            }
+            generations_frozen = 0;
+        }
+        generations_frozen++;
+
+        Positions<Scalar> rhs;
+        system.rhs(positions, rhs);
+        solver->solve(system, rhs, positions);
+        last_stats = solver->stats;
+    }
+
+    const Mesh_Topology &topology() const { return topo; }
+    Linear_Solver<Scalar> &linear_solver() { return *solver; }
+
+    Positions<Scalar> positions;
+    // Iterations and residual of the last generation's solve
+    Solve_Stats last_stats;
+    // Whether the last generation factorized, and the weight drift it measured
+    // if the operator is frozen
+    bool refactorized;
+    double weight_drift;
+    // Rows of the system the last generation recomputed
+    int updated_rows;
+
+private:
+    // Whether the frozen system and its factorization may serve this
+    // generation too
+    bool keep_factorization(Scalar h)
+    {
+        if (!analyzed || generations_frozen >= opts.freeze_generations || h != system.h) {
+            return false;
+        }
+        std::vector<Scalar> weights, areas;
+        compute_cot_weights(topo, positions, weights, areas);
+        double change = 0, norm = 0;
+        for (int k = 0; k < weights.size(); k++) {
+            double frozen = system.weights[k];
+            change += (weights[k] - frozen) * (weights[k] - frozen);
+            norm += frozen * frozen;
+        }
+        weight_drift = std::sqrt(change / std::max(norm, 1e-300));
+        return weight_drift <= opts.freeze_drift;
+    }
+
+    Smoothing_Options opts;
+    Mesh_Topology topo;
+    Smoothing_System<Scalar> system;
+    Linear_Solver<Scalar> *solver;
+    bool analyzed;
+    // Generations the current factorization has served
+    int generations_frozen;
+    // dirty_epsilon in the units of the mesh
+    Scalar dirty_length;
+};
+
+/* Anytime implicit fairing for interactive frames of a fixed budget. Every
+ * step is one frame of at most Smoothing_Options::frame_budget milliseconds:
+ * it runs warm-started preconditioned conjugate gradient iterations (with
+ * Smoothing_Options::preconditioner) on the current generation's system
+ * until the budget is used up and leaves the current iterate in positions
+ * for display, and the next step resumes the same solve. A generation that
+ * converges starts the next one right away if there is time left, so a
+ * small mesh runs several generations per frame and a large one spreads a
+ * generation over several frames, but every frame ends about on time.
+ *
+ * The work of a generation comes in units: assembling the system and its
+ * right-hand side, setting up the preconditioner, and single iterations. A
+ * step stops when the next unit would probably not fit, judging from how
+ * long the last one of its kind took. It always does at least one, so the
+ * smoothing moves on, and a unit cannot be split, so on a mesh whose
+ * assembly or preconditioner setup alone takes longer than the budget those
+ * frames run over. h only changes from the next generation on. The duration
+ * of every step is recorded in frame_ms. Anytime_Stepper holds what does not
+ * depend on the precision, so the viewer can log it.
+ */
+class Anytime_Stepper : public Smoother
+{
+public:
+    // Generations finished so far, iterations of the last step, iterations
+    // and residual of the current generation so far, and the duration of
+    // every step in milliseconds
+    int generations;
+    int last_iterations;
+    Solve_Stats last_stats;
+    std::vector<double> frame_ms;
+
+protected:
+    Anytime_Stepper() : generations(0), last_iterations(0) {}
+};
+
+template <typename Scalar, typename FactorScalar = Scalar>
+class Anytime_Smoother : public Anytime_Stepper
+{
+public:
+    typedef PCG_Solver<Scalar, FactorScalar> Solver;
+    typedef std::chrono::steady_clock Clock;
+
+    Anytime_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts)
+        : solver((typename Solver::Preconditioner) opts.preconditioner, opts.cg_tol,
+                 opts.cg_max_iterations, opts.mg_multicolor),
+          budget(opts.frame_budget / 1000), stage(ASSEMBLE)
+    {
+        stage_seconds[ASSEMBLE] = stage_seconds[FACTORIZE] = stage_seconds[ITERATE] = 0;
+        build_topology(hevs, topo);
+        load(hevs);
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+        stage = ASSEMBLE;
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    void step(double h)
+    {
+        Clock::time_point start = Clock::now();
+        bool worked = false;
+        last_iterations = 0;
+        while (true) {
+            if (worked && seconds_since(start) + stage_seconds[stage] > budget) {
+                break;
+            }
+            worked = true;
+
+            Clock::time_point before = Clock::now();
+            int current = stage;
+            if (stage == ASSEMBLE) {
+                system.assign(topo, positions, Scalar(h));
+                system.rhs(positions, rhs);
+                stage = FACTORIZE;
+            } else if (stage == FACTORIZE) {
+                solver.factorize(system);
+                solver.start(system, rhs, positions);
+                stage = ITERATE;
+            } else {
+                last_iterations++;
+                if (solver.resume(system, positions, 1)) {
+                    stage = ASSEMBLE;
+                    generations++;
+                }
+            }
+            stage_seconds[current] = seconds_since(before);
+        }
+        last_stats = solver.stats;
+        frame_ms.push_back(1000 * seconds_since(start));
+    }
+
+    bool settled() const { return stage == ASSEMBLE; }
+
+    Positions<Scalar> positions;
+
+private:
+    static double seconds_since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    Mesh_Topology topo;
+    Smoothing_System<Scalar> system;
+    Solver solver;
+    // Budget of a step in seconds, and the right-hand side of the current
+    // generation while it is being solved
+    double budget;
+    Positions<Scalar> rhs;
+    // The next unit of work of the current generation, and how long the last
+    // unit of each kind took
+    enum Stage { ASSEMBLE, FACTORIZE, ITERATE };
+    int stage;
+    double stage_seconds[3];
+};
+
+/* Explicit smoothing: every generation splits h into the fewest forward
+ * Euler substeps x <- x + (h / n)Δx that keep (h / n) ρ below
+ * Smoothing_Options::explicit_cfl. Δ and ρ are computed once per generation,
+ * from the positions at its start, like the implicit system. There is no
+ * factorization, so a generation costs n passes over the edges, which wins
+ * as long as h is small enough for n to be small.
+ */
+template <typename Scalar>
+class Explicit_Smoother : public Smoother
+{
+public:
+    Explicit_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                       const Mesh_Topology *topology = NULL)
+        : substeps(0), spectral_radius(0), opts(opts)
+    {
+        take_topology(hevs, topology, topo);
+        load(hevs);
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    void step(double h)
+    {
+        laplacian.assign(topo, positions);
+        spectral_radius = laplacian.spectral_radius(opts.lanczos_steps);
+        substeps = std::max((int) std::ceil(h * spectral_radius / opts.explicit_cfl), 1);
+
+        Scalar substep = Scalar(h / substeps);
+        for (int s = 0; s < substeps; s++) {
+            laplacian.euler_step(substep, positions, next);
+            positions.swap(next);
+        }
+    }
+
+    Positions<Scalar> positions;
+    // Substeps and spectral radius estimate of the last generation
+    int substeps;
+    double spectral_radius;
+
+private:
+    Smoothing_Options opts;
+    Mesh_Topology topo;
+    Laplacian_Operator<Scalar> laplacian;
+    Positions<Scalar> next;
+};
+
+/* Taubin's λ/μ filter: every generation runs Smoothing_Options::
+ * taubin_iterations pairs of the steps x <- x + λΔx and x <- x + μΔx, with
+ * λ > 0 and μ < 0 chosen from the pass-band frequency by
+ *
+ *     1/λ + 1/μ = k_PB
+ *
+ * Frequencies below k_PB pass almost unchanged while the higher ones are
+ * damped, so unlike the diffusion of the other methods the mesh does not
+ * shrink. Δ is the row-normalized uniform or cotangent Laplacian of the
+ * first generation's positions, kept for all later ones so the filter stays
+ * linear. h is not used; the amount of smoothing is set by the iterations.
+ */
+template <typename Scalar>
+class Taubin_Smoother : public Smoother
+{
+public:
+    Taubin_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts)
+        : lambda(opts.taubin_lambda), mu(1 / (opts.taubin_kpb - 1 / opts.taubin_lambda)),
+          opts(opts), cached(false)
+    {
+        build_topology(hevs, topo);
+        load(hevs);
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+        cached = false;
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    void step(double)
+    {
+        if (!cached) {
+            if (opts.taubin_uniform) {
+                laplacian.assign_uniform(topo);
+            } else {
+                laplacian.assign(topo, positions);
+            }
+            laplacian.normalize();
+            cached = true;
+        }
+
+        for (int it = 0; it < opts.taubin_iterations; it++) {
+            laplacian.euler_step(Scalar(lambda), positions, next);
+            laplacian.euler_step(Scalar(mu), next, positions);
+        }
+    }
+
+    Positions<Scalar> positions;
+    // The two factors of a pass pair
+    const double lambda, mu;
+
+private:
+    Smoothing_Options opts;
+    Mesh_Topology topo;
+    Laplacian_Operator<Scalar> laplacian;
+    Positions<Scalar> next;
+    bool cached;
+};
+
+/* Spectral smoothing: the loaded positions are projected once onto the
+ * eigenbasis of spectral.h, X = Φ C + D with C = Φ^T M X, and every mode is
+ * then scaled by the factor implicit fairing with the first generation's
+ * operator would give it. A generation with time step h multiplies the
+ * factor of mode i by 1 / (1 + hλ_i), and jump_to(t) sets it to exp(-λ_i t),
+ * the limit of many small generations, so any amount of smoothing costs one
+ * (n x k) by (k x 3) product. The detail D above the basis is scaled like
+ * the highest mode in it, which keeps at least as much of it as the flow
+ * would.
+ *
+ * The basis is always computed in double, with the supernodal Cholesky, and
+ * cached in Smoothing_Options::spectral_cache if that names a directory.
+ */
+class Spectral_Smoother : public Smoother
+{
+public:
+    Spectral_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts)
+        : loaded_from_cache(false), converged(false), opts(opts)
+    {
+        build_topology(hevs, topo);
+        load(hevs);
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+        int k = std::min(opts.spectral_modes, topo.num_vertices);
+        unsigned long long hash = mesh_hash(topo, positions, k);
+        std::string filename;
+        if (!opts.spectral_cache.empty()) {
+            std::ostringstream name;
+            name << opts.spectral_cache << "/spectral_" << std::hex << std::setw(16)
+                 << std::setfill('0') << hash << ".bin";
+            filename = name.str();
+        }
+
+        loaded_from_cache = !filename.empty() &&
+                            load_eigenbasis(filename, hash, topo.num_vertices, k, basis);
+        converged = true;
+        if (!loaded_from_cache) {
+            Smoothing_Options direct = opts;
+            direct.solver = SOLVER_SUPERNODAL;
+            Linear_Solver<double> *solver = make_linear_solver<double, double>(direct);
+            converged = compute_eigenbasis(topo, positions, k, *solver, basis);
+            delete solver;
+            if (!converged) {
+                std::cerr << "warning: only approximate spectral modes, the " << k
+                          << " lowest did not converge; the basis is not cached" << std::endl;
+            } else if (!filename.empty()) {
+                save_eigenbasis(filename, hash, basis);
+            }
+        }
+
+        Smoothing_System<double> system;
+        system.assign(topo, positions, 0);
+        Eigen::MatrixXd weighted = system.mass.asDiagonal() * positions;
+        project(basis.vectors, weighted, coefficients);
+        detail = positions;
+        subtract_projection(basis.vectors, coefficients, detail);
+        factors.setOnes(basis.values.size());
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    void step(double h)
+    {
+        factors = factors.cwiseQuotient((1 + h * basis.values.array()).matrix());
+        filter();
+    }
+
+    bool jump_to(double t)
+    {
+        factors = (-t * basis.values.array()).exp().matrix();
+        filter();
+        return true;
+    }
+
+    Positions<double> positions;
+    Eigenbasis basis;
+    // Whether the basis came from the cache instead of being computed, and
+    // whether all of its pairs converged (cached ones always did)
+    bool loaded_from_cache;
+    bool converged;
+
+private:
+    void filter()
+    {
+        // Blocks of rows in parallel, and one column at a time like project
+        // in spectral.h
+        const int ROWS = 2048;
+        Eigen::MatrixXd filtered = factors.asDiagonal() * coefficients;
+        positions = factors(factors.size() - 1) * detail;
+        int n = positions.rows();
+        thread_pool().parallel_for(0, (n + ROWS - 1) / ROWS, 1, [&](int b) {
+            int rows = std::min(ROWS, n - b * ROWS);
+            for (int c = 0; c < 3; c++) {
+                positions.col(c).segment(b * ROWS, rows).noalias() +=
+                    basis.vectors.middleRows(b * ROWS, rows) * filtered.col(c);
+            }
+        });
+    }
+
+    Smoothing_Options opts;
+    Mesh_Topology topo;
+    // Coordinates of the loaded positions in the basis, the part of them the
+    // basis cannot represent, and the current factor of every mode
+    Eigen::MatrixXd coefficients;
+    Positions<double> detail;
+    Eigen::VectorXd factors;
+};
+
+/* Fourth-order implicit fairing, (M + h L M^-1 L) x_h = M x_0 from
+ * bilaplacian.h, with one of the direct backends as Solver. The matrix is
+ * reassembled every generation but keeps its pattern, so the ordering and
+ * symbolic analysis of the first generation are reused.
+ */
+template <typename Scalar, typename Solver>
+class Bilaplacian_Smoother : public Smoother
+{
+public:
+    Bilaplacian_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                          const Mesh_Topology *topology = NULL)
+        : solver(opts.ordering, opts.refine_steps, opts.refine_tol), analyzed(false)
+    {
+        take_topology(hevs, topology, topo);
+        load(hevs);
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    void step(double h)
+    {
+        system.assign(topo, positions, Scalar(h));
+        if (!analyzed) {
+            solver.analyze_system(system);
+            analyzed = true;
+        }
+        solver.factorize_system(system);
+
+        Positions<Scalar> rhs;
+        system.rhs(positions, rhs);
+        solver.solve_system(system, rhs, positions);
+        last_stats = solver.stats;
+    }
+
+    const Mesh_Topology &topology() const { return topo; }
+    const Bilaplacian_System<Scalar> &bilaplacian_system() const { return system; }
+    Solver &linear_solver() { return solver; }
+
+    Positions<Scalar> positions;
+    // Refinement steps and residual of the last generation's solve
+    Solve_Stats last_stats;
+
+private:
+    Mesh_Topology topo;
+    Bilaplacian_System<Scalar> system;
+    Solver solver;
+    bool analyzed;
+};
+
+/* Implicit fairing of the region of interest of roi.h only: the vertices
+ * within Smoothing_Options::roi_rings rings of Smoothing_Options::roi_seeds
+ * (or the whole mesh without seeds) except the Smoothing_Options::pinned
+ * ones, with every other vertex held in place, so a generation assembles,
+ * factorizes and solves a system the size of the region. Like fourth-order
+ * fairing it takes one of the direct backends as Solver, and the region's
+ * pattern never changes, so the ordering and symbolic analysis of the first
+ * generation are reused.
+ *
+ * The region is split into its independent blocks (see split_region), like
+ * the connected components of a mesh of several shells, and every block gets
+ * its own system and solver. A generation assembles, factorizes and solves
+ * the blocks at the same time on the shared pool, largest first; the solvers
+ * inside then run serially, which is what the blocks are small enough for.
+ */
+template <typename Scalar, typename Solver>
+class Region_Smoother : public Smoother
+{
+public:
+    Region_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                     const Mesh_Topology *topology = NULL)
+        : analyzed(false)
+    {
+        take_topology(hevs, topology, topo);
+        constrained_region(topo, opts.roi_seeds, opts.roi_rings, opts.pinned, region);
+        split_region(topo, region, blocks);
+        systems.resize(blocks.size());
+        for (int b = 0; b < blocks.size(); b++) {
+            solvers.push_back(new Solver(opts.ordering, opts.refine_steps, opts.refine_tol));
+        }
+        load(hevs);
+    }
+
+    ~Region_Smoother()
+    {
+        for (int b = 0; b < solvers.size(); b++) {
+            delete solvers[b];
+        }
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        gather_positions(hevs, positions);
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        scatter_positions(positions, hevs);
+    }
+
+    // The blocks only read and write the rows of their own vertices and of
+    // held ones, so they can share the positions
+    void step(double h)
+    {
+        std::vector<Solve_Stats> stats(blocks.size());
+        thread_pool().parallel_for(0, blocks.size(), 1, [&](int b) {
+            Region_System<Scalar> &system = systems[b];
+            system.assign(topo, blocks[b], positions, Scalar(h));
+            if (!analyzed) {
+                solvers[b]->analyze_system(system);
+            }
+            solvers[b]->factorize_system(system);
+
+            Positions<Scalar> rhs, X;
+            system.rhs(positions, rhs);
+            system.gather(positions, X);
+            solvers[b]->solve_system(system, rhs, X);
+            system.scatter(X, positions);
+            stats[b] = solvers[b]->stats;
+        });
+        analyzed = true;
+
+        last_stats = Solve_Stats();
+        for (int b = 0; b < stats.size(); b++) {
+            last_stats.iterations = std::max(last_stats.iterations, stats[b].iterations);
+            last_stats.residual = std::max(last_stats.residual, stats[b].residual);
+        }
+    }
+
+    const Mesh_Topology &topology() const { return topo; }
+    // The mesh vertices being smoothed, in increasing order
+    const std::vector<int> &region_vertices() const { return region; }
+    // The independent blocks of the region and their solvers
+    int num_blocks() const { return blocks.size(); }
+    Solver &linear_solver(int block = 0) { return *solvers[block]; }
+
+    Positions<Scalar> positions;
+    // Largest refinement steps and residual of the last generation's solves
+    Solve_Stats last_stats;
+
+private:
+    Mesh_Topology topo;
+    std::vector<int> region;
+    std::vector< std::vector<int> > blocks;
+    std::vector< Region_System<Scalar> > systems;
+    std::vector<Solver *> solvers;
+    bool analyzed;
+};
+
+/* Batched implicit fairing of many small meshes, like the assets of a
+ * pipeline, that are all smoothed with the same h. Smoothing them one at a
+ * time spends most of every generation on setting up and calling a solver
+ * for a tiny system, so the meshes are packed into a few batches instead:
+ * the topologies of a batch are appended into one (see append_topology), so
+ * its system is block-diagonal with one block per mesh, and a generation
+ * assembles, factorizes and solves every batch in a single pass. The batches
+ * run at the same time on the shared pool, each solver serially inside.
+ *
+ * The meshes are dealt out to the batches largest first, each to the batch
+ * with the fewest vertices so far, so the batches cost about the same. With
+ * num_batches 0 there is one batch per thread of the pool, and 1 packs
+ * everything into one system whose solver gets the whole pool.
+ */
+class Batch_Smoother
+{
+public:
+    virtual ~Batch_Smoother() {}
+
+    // Copies the positions out of the halfedge vertices of every mesh
+    virtual void load(const std::vector< std::vector<HEV*> * > &meshes) = 0;
+    // Advances every mesh by one generation with time step h
+    virtual void step(double h) = 0;
+    // Writes the current positions back into every mesh
+    virtual void store(const std::vector< std::vector<HEV*> * > &meshes) const = 0;
+    virtual int num_batches() const = 0;
+};
+
+template <typename Scalar, typename FactorScalar = Scalar>
+class Implicit_Batch_Smoother : public Batch_Smoother
+{
+public:
+    Implicit_Batch_Smoother(const std::vector< std::vector<HEV*> * > &meshes,
+                            const Smoothing_Options &opts, int batches)
+        : analyzed(false)
+    {
+        int num_meshes = meshes.size();
+        std::vector<Mesh_Topology> parts(num_meshes);
+        std::vector<int> order(num_meshes);
+        for (int m = 0; m < num_meshes; m++) {
+            build_topology(meshes[m], parts[m]);
+            order[m] = m;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return parts[a].num_vertices > parts[b].num_vertices;
+        });
+
+        if (batches <= 0) {
+            batches = thread_pool().size();
+        }
+        batches = std::max(std::min(batches, num_meshes), 1);
+        topos.resize(batches);
+        for (int b = 0; b < batches; b++) {
+            topos[b].num_vertices = 0;
+            topos[b].num_components = 0;
+            topos[b].out_start.assign(1, 0);
+        }
+        batch.resize(num_meshes);
+        offset.resize(num_meshes);
+        for (int o = 0; o < num_meshes; o++) {
+            int m = order[o], lightest = 0;
+            for (int b = 1; b < batches; b++) {
+                if (topos[b].num_vertices < topos[lightest].num_vertices) {
+                    lightest = b;
+                }
+            }
+            batch[m] = lightest;
+            offset[m] = topos[lightest].num_vertices;
+            append_topology(parts[m], topos[lightest]);
+        }
+
+        systems.resize(batches);
+        positions.resize(batches);
+        for (int b = 0; b < batches; b++) {
+            positions[b].resize(topos[b].num_vertices, 3);
+            solvers.push_back(make_linear_solver<Scalar, FactorScalar>(opts));
+        }
+        load(meshes);
+    }
+
+    ~Implicit_Batch_Smoother()
+    {
+        for (int b = 0; b < solvers.size(); b++) {
+            delete solvers[b];
+        }
+    }
+
+    void load(const std::vector< std::vector<HEV*> * > &meshes)
+    {
+        Positions<Scalar> pos;
+        for (int m = 0; m < meshes.size(); m++) {
+            gather_positions(meshes[m], pos);
+            positions[batch[m]].middleRows(offset[m], pos.rows()) = pos;
+        }
+    }
+
+    void store(const std::vector< std::vector<HEV*> * > &meshes) const
+    {
+        for (int m = 0; m < meshes.size(); m++) {
+            Positions<Scalar> pos = positions[batch[m]].middleRows(offset[m],
+                                                                   meshes[m]->size() - 1);
+            scatter_positions(pos, meshes[m]);
+        }
+    }
+
+    void step(double h)
+    {
+        std::vector<Solve_Stats> stats(topos.size());
+        thread_pool().parallel_for(0, topos.size(), 1, [&](int b) {
+            systems[b].assign(topos[b], positions[b], Scalar(h));
+            if (!analyzed) {
+                solvers[b]->analyze(systems[b]);
+            }
+            solvers[b]->factorize(systems[b]);
+
+            Positions<Scalar> rhs;
+            systems[b].rhs(positions[b], rhs);
+            solvers[b]->solve(systems[b], rhs, positions[b]);
+            stats[b] = solvers[b]->stats;
+        });
+        analyzed = true;
+
+        last_stats = Solve_Stats();
+        for (int b = 0; b < stats.size(); b++) {
+            last_stats.iterations = std::max(last_stats.iterations, stats[b].iterations);
+            last_stats.residual = std::max(last_stats.residual, stats[b].residual);
+        }
+    }
+
+    int num_batches() const { return topos.size(); }
+
+    // Largest iterations and residual of the last generation's solves
+    Solve_Stats last_stats;
+
+private:
+    // Topology, system, positions and solver of every batch
+    std::vector<Mesh_Topology> topos;
+    std::vector< Smoothing_System<Scalar> > systems;
+    std::vector< Positions<Scalar> > positions;
+    std::vector< Linear_Solver<Scalar> * > solvers;
+    // Batch of every mesh and the row of its first vertex in the batch
+    std::vector<int> batch, offset;
+    bool analyzed;
+};
+
+/* Adaptive time stepping by step doubling. Every generation advances the
+ * positions once by h and, from the same start, twice by h / 2; the two
+ * results differ by about the local error of the larger step, and the
+ * generation keeps the more accurate one. If the difference is more than
+ * Smoothing_Options::adaptive_tol, h is halved and the generation retried.
+ * Otherwise the next h is scaled towards moving the vertices by
+ * Smoothing_Options::adaptive_target per generation, but by no more than the
+ * error allows (the local error of backward Euler grows like h^2) and at most
+ * by a factor of two either way. Both are measured as the largest vertex
+ * distance relative to the bounding box diagonal. h given to step only seeds
+ * the first generation.
+ *
+ * Each generation costs three solves, but the systems keep their pattern
+ * whatever h is, so the ordering and symbolic analysis stay valid and a
+ * changed h only costs the numeric factorization. Adaptive_Stepper holds
+ * what does not depend on the wrapped smoother, so the viewer can log it.
+ */
+class Adaptive_Stepper : public Smoother
+{
+public:
+    // h of the next generation, total time smoothed so far, h of every
+    // generation so far and the number of retried steps
+    double next_h, elapsed;
+    std::vector<double> steps;
+    int rejections;
+
+protected:
+    explicit Adaptive_Stepper(const Smoothing_Options &opts)
+        : next_h(0), elapsed(0), rejections(0), opts(opts), retries(0) {}
+
+    // Whether a step of h with the given local error is kept; if so, picks
+    // the next h from the displacement
+    bool accept(double h, double error, double displacement)
+    {
+        const int MAX_RETRIES = 20;
+        if (error > opts.adaptive_tol && retries < MAX_RETRIES) {
+            next_h = h / 2;
+            retries++;
+            rejections++;
+            return false;
+        }
+        elapsed += h;
+        steps.push_back(h);
+        retries = 0;
+
+        double scale = 2;
+        if (displacement > 0) {
+            scale = std::min(scale, opts.adaptive_target / displacement);
+        }
+        if (error > 0) {
+            scale = std::min(scale, 0.9 * std::sqrt(opts.adaptive_tol / error));
+        }
+        next_h = h * std::max(scale, 0.5);
+        return true;
+    }
+
+    Smoothing_Options opts;
+
+private:
+    // Retries of the current generation
+    int retries;
+};
+
+/* Step doubling around any smoother whose whole state is its positions */
+template <typename Scalar, typename Inner>
+class Adaptive_Smoother : public Adaptive_Stepper
+{
+public:
+    Adaptive_Smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                      const Mesh_Topology *topology = NULL)
+        : Adaptive_Stepper(opts), inner(hevs, opts, topology)
+    {
+        measure_diagonal();
+    }
+
+    void load(std::vector<HEV*> *hevs)
+    {
+        inner.load(hevs);
+        measure_diagonal();
+    }
+
+    void store(std::vector<HEV*> *hevs) const
+    {
+        inner.store(hevs);
+    }
+
+    void step(double h)
+    {
+        if (next_h == 0) {
+            next_h = h;
+        }
+        Positions<Scalar> start = inner.positions, full;
+        while (true) {
+            double dt = next_h;
+            inner.step(dt);
+            full.swap(inner.positions);
+            inner.positions = start;
+            inner.step(dt / 2);
+            inner.step(dt / 2);
+
+            double error = largest_distance(inner.positions, full);
+            double displacement = largest_distance(inner.positions, start);
+            if (accept(dt, error, displacement)) {
+                return;
+            }
+            inner.positions = start;
+        }
+    }
+
+    Inner inner;
+
+private:
+    void measure_diagonal()
+    {
+        diagonal = (inner.positions.colwise().maxCoeff() -
+                    inner.positions.colwise().minCoeff()).template cast<double>().norm();
+    }
+
+    // Largest distance between corresponding rows, relative to the diagonal
+    double largest_distance(const Positions<Scalar> &A, const Positions<Scalar> &B) const
+    {
+        return (A - B).rowwise().norm().maxCoeff() / std::max(diagonal, 1e-30);
+    }
+
+    double diagonal;
+};
+
+// The smoother on its own, or inside adaptive time stepping
+template <typename Scalar, typename Inner>
+static Smoother *make_stepping(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                               const Mesh_Topology *topology = NULL)
+{
+    if (opts.adaptive_step) {
+        return new Adaptive_Smoother<Scalar, Inner>(hevs, opts, topology);
+    }
+    return new Inner(hevs, opts, topology);
+}
+
+// The direct backends the smoothers that take a Solver type are built with
+template <typename Scalar, typename FactorScalar>
+struct Direct_Backends
+{
+    typedef Eigen::SparseMatrix<FactorScalar> FactorMatrix;
+    typedef Direct_Solver<Scalar, FactorScalar,
+        Counted_SparseLU<FactorMatrix, Eigen::NaturalOrdering<int> > > LU;
+    typedef Direct_Solver<Scalar, FactorScalar,
+        Eigen::SimplicialLDLT<FactorMatrix, Eigen::Lower, Eigen::NaturalOrdering<int> > > LDLT;
+    typedef Direct_Solver<Scalar, FactorScalar, Supernodal_Cholesky<FactorMatrix> > Supernodal;
+};
+
+// Smoothing_Options::solver picks the backend; any other than lu and ldlt
+// falls back to supernodal
+template <typename Scalar, typename FactorScalar,
+          template <typename, typename> class Direct_Smoother>
+static Smoother *make_direct_smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                                      const Mesh_Topology *topology = NULL)
+{
+    typedef Direct_Backends<Scalar, FactorScalar> Backends;
+    typedef Direct_Smoother<Scalar, typename Backends::LU> LU_Smoother;
+    typedef Direct_Smoother<Scalar, typename Backends::LDLT> LDLT_Smoother;
+    typedef Direct_Smoother<Scalar, typename Backends::Supernodal> Supernodal_Smoother;
+
+    switch (opts.solver) {
+        case SOLVER_LU:
+            return make_stepping<Scalar, LU_Smoother>(hevs, opts, topology);
+        case SOLVER_LDLT:
+            return make_stepping<Scalar, LDLT_Smoother>(hevs, opts, topology);
+        default:
+            return make_stepping<Scalar, Supernodal_Smoother>(hevs, opts, topology);
+    }
+}
+
+template <template <typename, typename> class Direct_Smoother>
+static Smoother *make_direct_smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts,
+                                      const Mesh_Topology *topology = NULL)
+{
+    switch (opts.precision) {
+        case PRECISION_DOUBLE:
+            return make_direct_smoother<double, double, Direct_Smoother>(hevs, opts, topology);
+        case PRECISION_MIXED:
+            return make_direct_smoother<double, float, Direct_Smoother>(hevs, opts, topology);
+        default:
+            return make_direct_smoother<float, float, Direct_Smoother>(hevs, opts, topology);
+    }
+}
+
+/* Whether implicit fairing may solve the connected components separately,
+ * which needs a direct solver without the frozen or incremental operator. It
+ * does if the mesh turns out to have several of them.
+ */
+static bool may_split_components(const Smoothing_Options &opts)
+{
+    bool direct = opts.solver == SOLVER_LU || opts.solver == SOLVER_LDLT ||
+                  opts.solver == SOLVER_SUPERNODAL;
+    return opts.split_components && direct && opts.freeze_generations <= 1 &&
+           opts.dirty_epsilon <= 0;
+}
+
+/* Throws if options that anytime smoothing cannot follow come with a
+ * frame_budget: it is its own way of running implicit fairing of the whole
+ * mesh, with the cg solver and a fixed h, and of every generation anew
+ */
+static void check_frame_budget(const Smoothing_Options &opts)
+{
+    if (opts.frame_budget <= 0) {
+        return;
+    }
+    if (opts.method != METHOD_IMPLICIT) {
+        throw std::invalid_argument("frame_budget only applies to implicit fairing");
+    }
+    if (opts.solver != SOLVER_CG) {
+        throw std::invalid_argument("frame_budget needs solver cg, which it runs");
+    }
+    if (!opts.roi_seeds.empty() || !opts.pinned.empty()) {
+        throw std::invalid_argument("frame_budget cannot be combined with roi or pin");
+    }
+    if (opts.adaptive_step) {
+        throw std::invalid_argument("frame_budget cannot be combined with adaptive_step");
+    }
+    if (opts.freeze_generations > 1 || opts.dirty_epsilon > 0) {
+        throw std::invalid_argument(
+            "frame_budget cannot be combined with freeze_generations or dirty_epsilon");
+    }
+}
+
+static Smoother *make_smoother(std::vector<HEV*> *hevs, const Smoothing_Options &opts)
+{
+    // A mistyped vertex would otherwise just not take part
+    check_vertex_list("roi", opts.roi_seeds, hevs->size() - 1);
+    check_vertex_list("pin", opts.pinned, hevs->size() - 1);
+    check_frame_budget(opts);
+    set_num_threads(opts.threads, opts.pin_threads);
+    // The methods without a solve have nothing to factorize, so for them
+    // mixed precision is just double
+    if (opts.method == METHOD_EXPLICIT) {
+        if (opts.precision == PRECISION_FLOAT) {
+            return make_stepping<float, Explicit_Smoother<float> >(hevs, opts);
+        }
+        return make_stepping<double, Explicit_Smoother<double> >(hevs, opts);
+    }
+    if (opts.method == METHOD_TAUBIN) {
+        if (opts.precision == PRECISION_FLOAT) {
+            return new Taubin_Smoother<float>(hevs, opts);
+        }
+        return new Taubin_Smoother<double>(hevs, opts);
+    }
+    if (opts.method == METHOD_SPECTRAL) {
+        return new Spectral_Smoother(hevs, opts);
+    }
+    if (opts.method == METHOD_BILAPLACIAN) {
+        return make_direct_smoother<Bilaplacian_Smoother>(hevs, opts);
+    }
+    if (opts.frame_budget > 0) {
+        switch (opts.precision) {
+            case PRECISION_DOUBLE:
+                return new Anytime_Smoother<double>(hevs, opts);
+            case PRECISION_MIXED:
+                return new Anytime_Smoother<double, float>(hevs, opts);
+            default:
+                return new Anytime_Smoother<float>(hevs, opts);
+        }
+    }
+    bool whole_mesh = opts.roi_seeds.empty() && opts.pinned.empty();
+    if (!whole_mesh) {
+        return make_direct_smoother<Region_Smoother>(hevs, opts);
+    }
+
+    // The components come with the topology, which the smoother then takes
+    // over instead of building it again
+    Mesh_Topology topo;
+    const Mesh_Topology *topology = NULL;
+    if (may_split_components(opts)) {
+        build_topology(hevs, topo);
+        topology = &topo;
+        if (topo.num_components > 1) {
+            return make_direct_smoother<Region_Smoother>(hevs, opts, topology);
+        }
+    }
+    switch (opts.precision) {
+        case PRECISION_DOUBLE:
+            return make_stepping<double, Implicit_Smoother<double> >(hevs, opts, topology);
+        case PRECISION_MIXED:
+            return make_stepping<double, Implicit_Smoother<double, float> >(hevs, opts, topology);
+        default:
+            return make_stepping<float, Implicit_Smoother<float> >(hevs, opts, topology);
+    }
+}
+
+/* Implicit fairing of many meshes in the given number of batches (0 for one
+ * per thread). Only Smoothing_Options::precision, solver and the options of
+ * the solvers apply; every batch is one system of implicit fairing.
+ */
+static Batch_Smoother *make_batch_smoother(const std::vector< std::vector<HEV*> * > &meshes,
+                                           const Smoothing_Options &opts, int batches)
+{
+    set_num_threads(opts.threads, opts.pin_threads);
+    switch (opts.precision) {
+        case PRECISION_DOUBLE:
+            return new Implicit_Batch_Smoother<double>(meshes, opts, batches);
+        case PRECISION_MIXED:
+            return new Implicit_Batch_Smoother<double, float>(meshes, opts, batches);
+        default:
+            return new Implicit_Batch_Smoother<float>(meshes, opts, batches);
+    }
+}
+
+#endif
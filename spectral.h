@@ -0,0 +1,252 @@
+/* This header file contains the low-frequency eigenbasis of the cotangent
+ * Laplacian that spectral smoothing filters the mesh in. It only depends on
+ * Eigen and the rest of the smoothing code.
+ *
+ * The basis is the k smallest eigenpairs of the generalized problem
+ *
+ *     K φ = λ M φ,    K = -L,    φ^T M φ = 1
+ *
+ * with L and M the cotangent weights and lumped masses of laplacian.h, so Δ
+ * = M^-1 L has eigenvectors φ and eigenvalues -λ. compute_eigenbasis finds
+ * them with a shift-invert block Lanczos: the implicit fairing matrix M + hK
+ * (exactly the Smoothing_System with time step h) is factorized once with
+ * the supernodal Cholesky, and every Lanczos step solves with it, so the
+ * iteration sees the eigenvalues 1 / (1 + hλ), the largest of which belong
+ * to the smallest λ and converge first. h is picked from Weyl's law so that
+ * 1/h is far below the k-th eigenvalue. The blocks have three columns to match
+ * the solvers' right-hand sides, and are kept M-orthogonal to all earlier
+ * ones (full reorthogonalization, twice).
+ *
+ * A basis takes a while to compute, so it can be cached in a file named
+ * after mesh_hash, a hash of the connectivity, the positions and k. Only
+ * converged bases are cached, so a bad one is not reused under that name,
+ * and the file holds the hash too, so it is only loaded for that mesh.
+ */
+
+#ifndef SPECTRAL_H
+#define SPECTRAL_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "laplacian.h"
+#include "linear_solvers.h"
+
+/* The k smallest eigenpairs, in increasing order of the eigenvalues */
+struct Eigenbasis
+{
+    Eigen::VectorXd values;
+    // One M-orthonormal eigenvector per column (n x k)
+    Eigen::MatrixXd vectors;
+};
+
+/* Function prototypes */
+
+static unsigned long long mesh_hash(const Mesh_Topology &topo, const Positions<double> &pos, int k);
+static bool load_eigenbasis(const std::string &filename, unsigned long long hash, int n, int k,
+                            Eigenbasis &basis);
+static bool save_eigenbasis(const std::string &filename, unsigned long long hash,
+                            const Eigenbasis &basis);
+static bool compute_eigenbasis(const Mesh_Topology &topo, const Positions<double> &pos, int k,
+                               Linear_Solver<double> &solver, Eigenbasis &basis);
+
+/* Function implementations */
+
+// 64-bit FNV-1a hash of a range of bytes, continuing from hash
+static unsigned long long fnv1a(const void *data, size_t size, unsigned long long hash)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static unsigned long long mesh_hash(const Mesh_Topology &topo, const Positions<double> &pos, int k)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = fnv1a(&topo.num_vertices, sizeof(int), hash);
+    hash = fnv1a(topo.out_start.data(), topo.out_start.size() * sizeof(int), hash);
+    hash = fnv1a(topo.he_to.data(), topo.he_to.size() * sizeof(int), hash);
+    hash = fnv1a(pos.data(), pos.size() * sizeof(double), hash);
+    return fnv1a(&k, sizeof(int), hash);
+}
+
+/* The file holds the mesh_hash of the mesh, n and k, the eigenvalues and
+ * the eigenvectors column by column, all in native byte order. Returns false
+ * if the file is missing or short, belongs to another mesh or holds a basis
+ * of other dimensions or non-finite numbers.
+ */
+static bool load_eigenbasis(const std::string &filename, unsigned long long hash, int n, int k,
+                            Eigenbasis &basis)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    unsigned long long file_hash;
+    int dims[2];
+    if (!file.read((char *) &file_hash, sizeof(file_hash)) || file_hash != hash ||
+            !file.read((char *) dims, sizeof(dims)) || dims[0] != n || dims[1] != k) {
+        return false;
+    }
+    basis.values.resize(k);
+    basis.vectors.resize(n, k);
+    file.read((char *) basis.values.data(), k * sizeof(double));
+    file.read((char *) basis.vectors.data(), (size_t) n * k * sizeof(double));
+    return file && basis.values.allFinite() && basis.vectors.allFinite();
+}
+
+static bool save_eigenbasis(const std::string &filename, unsigned long long hash,
+                            const Eigenbasis &basis)
+{
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    int dims[2] = {(int) basis.vectors.rows(), (int) basis.vectors.cols()};
+    file.write((const char *) &hash, sizeof(hash));
+    file.write((const char *) dims, sizeof(dims));
+    file.write((const char *) basis.values.data(), dims[1] * sizeof(double));
+    file.write((const char *) basis.vectors.data(), (size_t) dims[0] * dims[1] * sizeof(double));
+    return bool(file);
+}
+
+/* Makes the columns of W M-orthonormal to each other in place, with the
+ * Cholesky factor R of their M-Gram matrix, so that the old W is the new W
+ * times R. Returns false if they are (close to) linearly dependent.
+ */
+static bool m_orthonormalize(const Eigen::VectorXd &mass, Eigen::MatrixXd &W, Eigen::MatrixXd &R)
+{
+    Eigen::MatrixXd MW = mass.asDiagonal() * W;
+    Eigen::MatrixXd gram = W.transpose() * MW;
+    Eigen::LLT<Eigen::MatrixXd> llt(gram);
+    R = llt.matrixU();
+    if (llt.info() != Eigen::Success ||
+            R.diagonal().minCoeff() < 1e-10 * std::sqrt(gram.trace())) {
+        return false;
+    }
+    W = R.triangularView<Eigen::Upper>().solve<Eigen::OnTheRight>(W);
+    return true;
+}
+
+/* C = Q^T Y and Y -= Q C, one column of Y at a time. With only three
+ * columns, Eigen's matrix products are several times slower than its
+ * matrix-vector products, and these two are most of the Lanczos time.
+ */
+template <typename Basis, typename Block>
+static void project(const Basis &Q, const Block &Y, Eigen::MatrixXd &C)
+{
+    C.resize(Q.cols(), Y.cols());
+    for (int c = 0; c < Y.cols(); c++) {
+        C.col(c).noalias() = Q.transpose() * Y.col(c);
+    }
+}
+
+template <typename Basis, typename Block>
+static void subtract_projection(const Basis &Q, const Eigen::MatrixXd &C, Block &Y)
+{
+    for (int c = 0; c < Y.cols(); c++) {
+        Y.col(c).noalias() -= Q * C.col(c);
+    }
+}
+
+/* Computes the k smallest eigenpairs of K φ = λ M φ for the cotangent
+ * weights and masses of the given positions. The solver must be a direct
+ * one; it is analyzed and factorized here. Returns whether all of them
+ * converged: if the Krylov space fills up first, basis holds the Ritz pairs
+ * it got to, which are only approximations of the wanted ones.
+ */
+static bool compute_eigenbasis(const Mesh_Topology &topo, const Positions<double> &pos, int k,
+                               Linear_Solver<double> &solver, Eigenbasis &basis)
+{
+    const int BLOCK = 3;
+    const double TOL = 1e-8;
+    int n = topo.num_vertices;
+    k = std::min(k, n);
+
+    // λ_k is about 4πk / area (Weyl's law), and with the masses of
+    // laplacian.h the total mass is 6 times the area. A shift far below it
+    // spreads the wanted θ apart the most, and converges in the fewest steps.
+    Smoothing_System<double> system;
+    system.assign(topo, pos, 0);
+    double area = system.mass.sum() / 6;
+    double h = 100 * area / (4 * M_PI * std::max(k, 1));
+    system.assign(topo, pos, h);
+    solver.analyze(system);
+    solver.factorize(system);
+
+    // Basis Q of the Krylov space, one block at a time, and the projection
+    // H = Q^T M (M + hK)^-1 M Q, which is symmetric
+    int max_dim = std::min(n, std::max(4 * k + 60, 3 * BLOCK));
+    max_dim -= max_dim % BLOCK;
+    Eigen::MatrixXd Q(n, max_dim), H(max_dim, max_dim);
+
+    Eigen::MatrixXd W(n, BLOCK);
+    unsigned int seed = 12345;
+    for (int c = 0; c < BLOCK; c++) {
+        for (int i = 0; i < n; i++) {
+            seed = seed * 1103515245u + 12345u;
+            W(i, c) = double((seed >> 16) & 0x7fff) / 0x7fff - 0.5;
+        }
+    }
+    Eigen::MatrixXd R;
+    m_orthonormalize(system.mass, W, R);
+    Q.leftCols(BLOCK) = W;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> ritz;
+    int dim = BLOCK, next_check = k + 2 * BLOCK;
+    bool converged = false;
+    while (true) {
+        Positions<double> B = system.mass.asDiagonal() * Q.middleCols(dim - BLOCK, BLOCK);
+        Positions<double> X = Positions<double>::Zero(n, BLOCK);
+        solver.solve(system, B, X);
+        Eigen::MatrixXd MX = system.mass.asDiagonal() * X, C;
+        project(Q.leftCols(dim), MX, C);
+        H.block(0, dim - BLOCK, dim, BLOCK) = C;
+        H.block(dim - BLOCK, 0, BLOCK, dim) = C.transpose();
+
+        // The next block, whose first reorthogonalization pass reuses the
+        // column of H
+        W = X;
+        subtract_projection(Q.leftCols(dim), C, W);
+        Eigen::MatrixXd MW = system.mass.asDiagonal() * W;
+        project(Q.leftCols(dim), MW, C);
+        subtract_projection(Q.leftCols(dim), C, W);
+        bool invariant = !m_orthonormalize(system.mass, W, R);
+        bool full = invariant || dim + BLOCK > max_dim;
+
+        // Rayleigh-Ritz once the space can hold k vectors and then whenever
+        // it has grown by a tenth. The M-norm of the residual of a Ritz pair
+        // (θ, Q y) is the norm of R times the last block of y.
+        if (dim >= next_check || full) {
+            ritz.compute(H.topLeftCorner(dim, dim));
+            converged = true;
+            for (int j = 0; j < std::min(k, dim) && converged; j++) {
+                int c = dim - 1 - j;
+                double residual = (R * ritz.eigenvectors().block(dim - BLOCK, c, BLOCK, 1)).norm();
+                converged = invariant || residual <= TOL * ritz.eigenvalues()(c);
+            }
+            if (converged || full) {
+                break;
+            }
+            next_check = std::max(dim + BLOCK, dim + dim / 10);
+        }
+
+        Q.middleCols(dim, BLOCK) = W;
+        dim += BLOCK;
+    }
+
+    // θ = 1 / (1 + hλ), in decreasing order of θ
+    int found = std::min(k, (int) ritz.eigenvalues().size());
+    basis.values.resize(found);
+    basis.vectors.resize(n, found);
+    int space = ritz.eigenvalues().size();
+    for (int j = 0; j < found; j++) {
+        double theta = ritz.eigenvalues()(space - 1 - j);
+        basis.values(j) = std::max((1 / theta - 1) / h, 0.0);
+    }
+    basis.vectors = Q.leftCols(space) * ritz.eigenvectors().rightCols(found).rowwise().reverse();
+    return converged;
+}
+
+#endif
@@ -0,0 +1,457 @@
+/* This header file contains a supernodal Cholesky factorization A = L L^T of
+ * a sparse symmetric positive definite matrix. It only depends on Eigen and
+ * the thread pool of parallel.h.
+ *
+ * Eigen's SimplicialLDLT updates the factor one column at a time with sparse
+ * scatter loops. Neighboring columns of L often share their row structure
+ * though: a whole run of columns along a chain of the elimination tree ends
+ * up with the same rows below it. Such a run is a supernode, and storing it
+ * as one dense column-major block turns the column updates into dense
+ * matrix products, which run close to the peak rate of the processor.
+ *
+ * analyzePattern does all the symbolic work once per pattern:
+ *
+ *     1. the elimination tree, and a postorder of it that the matrix is
+ *        permuted by internally; this does not change the fill but makes
+ *        every chain of the tree a run of consecutive columns
+ *     2. the column counts of L, by walking the row subtrees of the tree
+ *     3. the fundamental supernodes, chains of columns whose counts drop by
+ *        exactly one, which are then merged with their parent supernode as
+ *        long as the merged block would not store too many explicit zeros
+ *        (small supernodes are merged more eagerly, as in CHOLMOD)
+ *     4. the row structure of every supernode, and for every supernode the
+ *        list of descendants that update it, with the slice of their rows
+ *        that falls into its columns
+ *
+ * factorize is left-looking: a supernode gathers its columns of A, subtracts
+ * the updates of all its descendants with dense products, factorizes its
+ * diagonal block with a dense blocked Cholesky and solves for the rows
+ * below. A supernode only reads the finished blocks of its own descendants,
+ * so the supernodes are factorized with parallel_tree on the shared pool,
+ * which runs independent subtrees of the supernodal elimination tree on
+ * different threads.
+ *
+ * The interface matches Eigen's sparse solvers (analyzePattern, factorize,
+ * solve, info), so Direct_Solver can use it in their place. Like them, it
+ * expects an already permuted matrix; it uses the lower triangle.
+ */
+
+#ifndef SUPERNODAL_H
+#define SUPERNODAL_H
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include "parallel.h"
+
+template <typename MatrixType>
+class Supernodal_Cholesky
+{
+public:
+    typedef typename MatrixType::Scalar Scalar;
+    typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> Dense;
+    typedef Eigen::Map<Dense> Block_Map;
+
+    Supernodal_Cholesky() : n(0), status(Eigen::Success) {}
+
+    void analyzePattern(const MatrixType &A)
+    {
+        n = A.rows();
+        std::vector<int> parent, counts;
+        elimination_tree(A, parent);
+        postorder(parent);
+        permuted = A.twistedBy(inverse_perm.inverse());
+
+        elimination_tree(permuted, parent);
+        column_counts(permuted, parent, counts);
+        find_supernodes(parent, counts);
+        supernode_structure(permuted);
+    }
+
+    void factorize(const MatrixType &input)
+    {
+        permuted = input.twistedBy(inverse_perm.inverse());
+        const MatrixType &A = permuted;
+        int num_threads = thread_pool().size();
+        std::vector< std::vector<int> > positions(num_threads, std::vector<int>(n));
+        std::vector<Dense> products(num_threads);
+        std::atomic<bool> failed(false);
+
+        thread_pool().parallel_tree(super_parent, [&](int s, int thread) {
+            if (!failed && !factorize_supernode(A, s, positions[thread], products[thread])) {
+                failed = true;
+            }
+        });
+        status = failed ? Eigen::NumericalIssue : Eigen::Success;
+    }
+
+    // Solves A X = B with the factors, column by column of B
+    template <typename Rhs>
+    Rhs solve(const Rhs &B) const
+    {
+        Dense X = inverse_perm.inverse() * B.template cast<Scalar>();
+        int num_cols = X.cols();
+        Dense gathered;
+
+        // Forward substitution L Y = B
+        for (int s = 0; s < supernodes.size(); s++) {
+            const Supernode &sn = supernodes[s];
+            int width = sn.last - sn.first, below = sn.rows.size() - width;
+            Block_Map L = block(s);
+            X.middleRows(sn.first, width) =
+                L.topRows(width).template triangularView<Eigen::Lower>().solve(X.middleRows(sn.first, width));
+            if (below > 0) {
+                gathered.noalias() = L.bottomRows(below) * X.middleRows(sn.first, width);
+                for (int r = 0; r < below; r++) {
+                    X.row(sn.rows[width + r]) -= gathered.row(r);
+                }
+            }
+        }
+
+        // Backward substitution L^T X = Y
+        for (int s = supernodes.size() - 1; s >= 0; s--) {
+            const Supernode &sn = supernodes[s];
+            int width = sn.last - sn.first, below = sn.rows.size() - width;
+            Block_Map L = block(s);
+            if (below > 0) {
+                gathered.resize(below, num_cols);
+                for (int r = 0; r < below; r++) {
+                    gathered.row(r) = X.row(sn.rows[width + r]);
+                }
+                X.middleRows(sn.first, width).noalias() -= L.bottomRows(below).transpose() * gathered;
+            }
+            X.middleRows(sn.first, width) =
+                L.topRows(width).transpose().template triangularView<Eigen::Upper>().solve(
+                    X.middleRows(sn.first, width));
+        }
+        return (inverse_perm * X).template cast<typename Rhs::Scalar>();
+    }
+
+    Eigen::ComputationInfo info() const { return status; }
+
+    // Entries of L, including the explicit zeros the merged supernodes store
+    long nonzeros() const
+    {
+        long total = 0;
+        for (int s = 0; s < supernodes.size(); s++) {
+            long width = supernodes[s].last - supernodes[s].first;
+            total += width * supernodes[s].rows.size() - width * (width - 1) / 2;
+        }
+        return total;
+    }
+
+    int num_supernodes() const { return supernodes.size(); }
+
+private:
+    struct Update
+    {
+        // Descendant supernode, and the slice [start, start + count) of its
+        // rows that lies in the columns of the updated supernode
+        int source, start, count;
+    };
+
+    struct Supernode
+    {
+        // Columns [first, last)
+        int first, last;
+        // Rows of the block: the columns themselves, then the rows below
+        std::vector<int> rows;
+        // Offset of the block in values
+        long offset;
+        std::vector<Update> updates;
+    };
+
+    Block_Map block(int s) const
+    {
+        const Supernode &sn = supernodes[s];
+        return Block_Map(const_cast<Scalar *>(values.data()) + sn.offset,
+                         sn.rows.size(), sn.last - sn.first);
+    }
+
+    // Liu's algorithm with path compression on the upper triangle
+    void elimination_tree(const MatrixType &A, std::vector<int> &parent)
+    {
+        parent.assign(n, -1);
+        std::vector<int> ancestor(n, -1);
+        for (int j = 0; j < n; j++) {
+            for (typename MatrixType::InnerIterator it(A, j); it; ++it) {
+                int i = it.row();
+                while (i < j && i != -1) {
+                    int next = ancestor[i];
+                    ancestor[i] = j;
+                    if (next == -1) {
+                        parent[i] = j;
+                    }
+                    i = next;
+                }
+            }
+        }
+    }
+
+    // Sets inverse_perm to a postorder of the forest: inverse_perm(k) is the
+    // k-th column visited, and every node comes right after its last child
+    void postorder(const std::vector<int> &parent)
+    {
+        std::vector<int> first_child(n, -1), next_sibling(n, -1);
+        for (int j = n - 1; j >= 0; j--) {
+            if (parent[j] >= 0) {
+                next_sibling[j] = first_child[parent[j]];
+                first_child[parent[j]] = j;
+            }
+        }
+
+        inverse_perm.resize(n);
+        int k = 0;
+        std::vector<int> stack;
+        for (int root = 0; root < n; root++) {
+            if (parent[root] >= 0) {
+                continue;
+            }
+            // Every node is pushed once on the way down and numbered when
+            // it is popped after all of its children
+            stack.push_back(root);
+            while (!stack.empty()) {
+                int j = stack.back();
+                if (first_child[j] >= 0) {
+                    int child = first_child[j];
+                    first_child[j] = next_sibling[child];
+                    stack.push_back(child);
+                } else {
+                    stack.pop_back();
+                    inverse_perm.indices()(k++) = j;
+                }
+            }
+        }
+    }
+
+    /* Nonzeros of every column of L, diagonal included. Row j of L has an
+     * entry in column k exactly when k lies on the tree path from some
+     * i < j with A(i, j) != 0 up to j, so marking those paths row by row
+     * counts every entry once.
+     */
+    void column_counts(const MatrixType &A, const std::vector<int> &parent, std::vector<int> &counts)
+    {
+        counts.assign(n, 1);
+        std::vector<int> mark(n, -1);
+        for (int j = 0; j < n; j++) {
+            mark[j] = j;
+            for (typename MatrixType::InnerIterator it(A, j); it; ++it) {
+                for (int k = it.row(); k < j && mark[k] != j; k = parent[k]) {
+                    mark[k] = j;
+                    counts[k]++;
+                }
+            }
+        }
+    }
+
+    void find_supernodes(const std::vector<int> &parent, const std::vector<int> &counts)
+    {
+        std::vector<int> children(n, 0);
+        for (int j = 0; j < n; j++) {
+            if (parent[j] >= 0) {
+                children[parent[j]]++;
+            }
+        }
+
+        // Fundamental supernodes: column j continues the one of j - 1 if it
+        // is j - 1's only child and has exactly one row less
+        std::vector<int> first;
+        for (int j = 0; j < n; j++) {
+            if (j == 0 || parent[j - 1] != j || counts[j - 1] != counts[j] + 1 || children[j] != 1) {
+                first.push_back(j);
+            }
+        }
+        first.push_back(n);
+        int num_fundamental = first.size() - 1;
+
+        // Merge supernodes into the parent they end next to, from the root
+        // down. A merged group keeps its width, height (rows of its first
+        // column, as stored) and true nonzeros.
+        std::vector<long> group_width(num_fundamental), group_height(num_fundamental);
+        std::vector<long> group_nonzeros(num_fundamental);
+        std::vector<int> group_of(num_fundamental);
+        for (int s = 0; s < num_fundamental; s++) {
+            group_of[s] = s;
+            group_width[s] = first[s + 1] - first[s];
+            group_height[s] = counts[first[s]];
+            group_nonzeros[s] = 0;
+            for (int j = first[s]; j < first[s + 1]; j++) {
+                group_nonzeros[s] += counts[j];
+            }
+        }
+        std::vector<char> merged(num_fundamental, 0);
+        for (int s = num_fundamental - 2; s >= 0; s--) {
+            int last = first[s + 1] - 1;
+            if (parent[last] != first[s + 1]) {
+                continue;
+            }
+            int g = group_of[s + 1];
+            long width = group_width[s];
+            long merged_width = width + group_width[g];
+            long merged_height = width + group_height[g];
+            long stored = merged_width * merged_height - merged_width * (merged_width - 1) / 2;
+            long nonzeros = group_nonzeros[g] + group_nonzeros[s];
+            double zeros = double(stored - nonzeros) / stored;
+
+            // The bottom supernodes of a mesh are a few columns wide, and
+            // their updates are slow, skinny products; merging them pays for
+            // quite a few stored zeros
+            if (merged_width <= 16 || (merged_width <= 48 && zeros < 0.3) || zeros < 0.15) {
+                merged[s + 1] = 1;
+                group_of[s] = g;
+                group_width[g] = merged_width;
+                group_height[g] = merged_height;
+                group_nonzeros[g] = nonzeros;
+            }
+        }
+
+        supernodes.clear();
+        column_supernode.resize(n);
+        for (int s = 0; s < num_fundamental; s++) {
+            if (!merged[s]) {
+                supernodes.push_back(Supernode());
+                supernodes.back().first = first[s];
+            }
+            supernodes.back().last = first[s + 1];
+            for (int j = first[s]; j < first[s + 1]; j++) {
+                column_supernode[j] = supernodes.size() - 1;
+            }
+        }
+    }
+
+    /* The rows of a supernode are its columns, the rows of A below them and
+     * the rows of its children below them. Supernodes are numbered in column
+     * order, so every child is done before its parent.
+     */
+    void supernode_structure(const MatrixType &A)
+    {
+        int num_supernodes = supernodes.size();
+        super_parent.assign(num_supernodes, -1);
+        std::vector< std::vector<int> > children(num_supernodes);
+        std::vector<int> mark(n, -1);
+
+        long offset = 0;
+        for (int s = 0; s < num_supernodes; s++) {
+            Supernode &sn = supernodes[s];
+            std::vector<int> below;
+            for (int j = sn.first; j < sn.last; j++) {
+                for (typename MatrixType::InnerIterator it(A, j); it; ++it) {
+                    if (it.row() >= sn.last && mark[it.row()] != s) {
+                        mark[it.row()] = s;
+                        below.push_back(it.row());
+                    }
+                }
+            }
+            for (int c = 0; c < children[s].size(); c++) {
+                const Supernode &child = supernodes[children[s][c]];
+                for (int r = child.last - child.first; r < child.rows.size(); r++) {
+                    int row = child.rows[r];
+                    if (row >= sn.last && mark[row] != s) {
+                        mark[row] = s;
+                        below.push_back(row);
+                    }
+                }
+            }
+            std::sort(below.begin(), below.end());
+
+            sn.rows.clear();
+            for (int j = sn.first; j < sn.last; j++) {
+                sn.rows.push_back(j);
+            }
+            sn.rows.insert(sn.rows.end(), below.begin(), below.end());
+            sn.offset = offset;
+            offset += (long) sn.rows.size() * (sn.last - sn.first);
+
+            if (!below.empty()) {
+                super_parent[s] = column_supernode[below[0]];
+                children[super_parent[s]].push_back(s);
+            }
+        }
+        values.assign(offset, 0);
+
+        // Split the rows below every supernode into the runs that fall into
+        // the columns of one ancestor
+        for (int s = 0; s < num_supernodes; s++) {
+            supernodes[s].updates.clear();
+        }
+        for (int d = 0; d < num_supernodes; d++) {
+            const Supernode &sn = supernodes[d];
+            int r = sn.last - sn.first;
+            while (r < sn.rows.size()) {
+                int target = column_supernode[sn.rows[r]];
+                int start = r;
+                while (r < sn.rows.size() && sn.rows[r] < supernodes[target].last) {
+                    r++;
+                }
+                Update update = {d, start, r - start};
+                supernodes[target].updates.push_back(update);
+            }
+        }
+    }
+
+    /* Factorizes supernode s. position and product are scratch space of the
+     * calling thread. Returns false if the block is not positive definite.
+     */
+    bool factorize_supernode(const MatrixType &A, int s, std::vector<int> &position, Dense &product)
+    {
+        const Supernode &sn = supernodes[s];
+        int width = sn.last - sn.first, height = sn.rows.size();
+        Block_Map L = block(s);
+        L.setZero();
+        for (int r = 0; r < height; r++) {
+            position[sn.rows[r]] = r;
+        }
+
+        // Lower triangle of the columns of A
+        for (int j = sn.first; j < sn.last; j++) {
+            for (typename MatrixType::InnerIterator it(A, j); it; ++it) {
+                if (it.row() >= j) {
+                    L(position[it.row()], j - sn.first) = it.value();
+                }
+            }
+        }
+
+        // Updates L(rows, cols) -= L_d(rows, slice) L_d(cols, slice)^T from
+        // every descendant d
+        for (int u = 0; u < sn.updates.size(); u++) {
+            const Update &update = sn.updates[u];
+            const Supernode &source = supernodes[update.source];
+            Block_Map L_d = block(update.source);
+            int rows = source.rows.size() - update.start;
+            product.noalias() = L_d.bottomRows(rows) * L_d.middleRows(update.start, update.count).transpose();
+
+            for (int k = 0; k < update.count; k++) {
+                int col = source.rows[update.start + k] - sn.first;
+                for (int r = k; r < rows; r++) {
+                    L(position[source.rows[update.start + r]], col) -= product(r, k);
+                }
+            }
+        }
+
+        // Dense Cholesky of the diagonal block, then L21 = A21 L11^-T
+        Eigen::Block<Block_Map> diagonal = L.topRows(width);
+        if (Eigen::internal::llt_inplace<Scalar, Eigen::Lower>::blocked(diagonal) >= 0) {
+            return false;
+        }
+        if (height > width) {
+            diagonal.transpose().template triangularView<Eigen::Upper>()
+                .template solveInPlace<Eigen::OnTheRight>(L.bottomRows(height - width));
+        }
+        return true;
+    }
+
+    int n;
+    // Postorder of the elimination tree, and the matrix permuted by it
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> inverse_perm;
+    MatrixType permuted;
+    std::vector<Supernode> supernodes;
+    // Supernode of every column, and parent of every supernode (-1 at roots)
+    std::vector<int> column_supernode, super_parent;
+    std::vector<Scalar> values;
+    Eigen::ComputationInfo status;
+};
+
+#endif